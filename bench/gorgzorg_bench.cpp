@@ -0,0 +1,535 @@
+/*
+* This file is part of GorgZorg, a simple multiplatform CLI network file transfer tool.
+* Copyright (C) 2021 Alexandre Albuquerque Arnt
+*
+* This program is distributed in the hope that it will be useful,
+* but WITHOUT ANY WARRANTY; without even the implied warranty of
+* MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.
+*
+* Source code hosted on: https://github.com/aarnt/gorgzorg
+*/
+
+/*
+ * Loopback benchmark: generates representative datasets, gorgs each one to a zorg running on 127.0.0.1
+ * and reports MB/s, files/s, CPU time and peak RSS (of both processes) as JSON.
+ *
+ * Datasets are generated from fixed seeds, so runs are comparable. "-baseline" compares this run against
+ * the JSON of an earlier one and exits with 1 if any dataset got slower than the tolerance allows
+ */
+
+#include "argumentlist.h"
+
+#include <QCoreApplication>
+#include <QDir>
+#include <QFile>
+#include <QFileInfo>
+#include <QJsonArray>
+#include <QJsonDocument>
+#include <QJsonObject>
+#include <QThread>
+#include <QVector>
+
+#include <iostream>
+
+#include <fcntl.h>
+#include <signal.h>
+#include <sys/resource.h>
+#include <sys/time.h>
+#include <sys/wait.h>
+#include <unistd.h>
+
+const int ctn_BENCH_PORT = 10777;
+const int ctn_ZORG_START_TIMEOUT = 10000; //ms zorg has to start listening
+const double ctn_DEFAULT_TOLERANCE = 10.0; //% of MB/s a dataset may lose against the baseline
+const qint64 ctn_MB = 1024 * 1024;
+
+//A dataset gorged by a benchmark run
+struct Dataset
+{
+  QString name;
+  QString description;
+  QStringList gorgArgs;     //Params gorg needs for it, besides the ones the user passed
+  qint64 files = 0;
+  qint64 bytes = 0;
+};
+
+//What a process cost, as wait4 tells
+struct Usage
+{
+  int status = -1;
+  double cpuSeconds = 0;
+  qint64 peakRssKb = 0;
+};
+
+/*
+ * Small xorshift generator, so datasets are the same on every run and machine
+ */
+class Random
+{
+public:
+  explicit Random(quint64 seed): m_state(seed * 0x9e3779b97f4a7c15ULL + 1) {}
+
+  quint64 next()
+  {
+    m_state ^= m_state << 13;
+    m_state ^= m_state >> 7;
+    m_state ^= m_state << 17;
+    return m_state;
+  }
+
+  qint64 range(qint64 min, qint64 max) { return min + qint64(next() % quint64(max - min + 1)); }
+
+private:
+  quint64 m_state;
+};
+
+/*
+ * Writes a file of size bytes: random bytes, or text made of a small vocabulary when compressible
+ */
+static bool writeFile(const QString &path, qint64 size, bool compressible, Random &random)
+{
+  static const char *words[] = {"gorg ", "zorg ", "file ", "transfer ", "network ", "socket ", "block ", "stream ",
+                                "header ", "body ", "digest ", "chunk\n"};
+  QFile file(path);
+  if (!file.open(QFile::WriteOnly)) return false;
+
+  QByteArray block;
+  block.reserve(int(qMin(size, ctn_MB)) + 16);
+
+  while (size > 0)
+  {
+    block.clear();
+
+    while (block.size() < qMin(size, ctn_MB))
+    {
+      if (compressible)
+      {
+        block.append(words[random.next() % (sizeof(words) / sizeof(words[0]))]);
+      }
+      else
+      {
+        quint64 value = random.next();
+        block.append(reinterpret_cast<const char *>(&value), sizeof(value));
+      }
+    }
+
+    block.truncate(int(qMin(size, ctn_MB)));
+    if (file.write(block) != block.size()) return false;
+    size -= block.size();
+  }
+
+  return true;
+}
+
+/*
+ * Creates the datasets under dataDir, scaled by scale. Datasets already there (from an earlier run with
+ * the same scale) are reused
+ */
+static bool createDatasets(const QString &dataDir, double scale, QVector<Dataset> &datasets)
+{
+  Dataset huge;
+  huge.name = QLatin1String("huge");
+  huge.description = QLatin1String("One big file of random bytes");
+
+  Dataset tiny;
+  tiny.name = QLatin1String("tiny");
+  tiny.description = QLatin1String("Many files of 512 bytes");
+
+  Dataset mixed;
+  mixed.name = QLatin1String("mixed");
+  mixed.description = QLatin1String("A tree of files from 1 KB to 16 MB (log-uniform)");
+
+  Dataset compressible;
+  compressible.name = QLatin1String("compressible");
+  compressible.description = QLatin1String("Text files gorged with -zip");
+  compressible.gorgArgs << QLatin1String("-zip");
+
+  Dataset incompressible;
+  incompressible.name = QLatin1String("incompressible");
+  incompressible.description = QLatin1String("Random files gorged with -zip");
+  incompressible.gorgArgs << QLatin1String("-zip");
+
+  datasets << huge << tiny << mixed << compressible << incompressible;
+  quint64 seed = 0;
+
+  for (Dataset &dataset: datasets)
+  {
+    QString path = dataDir + QDir::separator() + dataset.name;
+    QFile stamp(path + QLatin1String(".done"));
+    Random random(++seed);
+    bool reuse = stamp.open(QFile::ReadOnly) && stamp.readAll() == QByteArray::number(scale);
+    stamp.close();
+
+    if (!reuse)
+    {
+      std::cerr << "Creating dataset " << dataset.name.toLatin1().data() << "..." << std::endl;
+      QDir(path).removeRecursively();
+      QFile::remove(path);
+    }
+
+    if (dataset.name == QLatin1String("huge"))
+    {
+      dataset.files = 1;
+      dataset.bytes = qint64(1024 * scale) * ctn_MB;
+      if (!reuse && !writeFile(path, dataset.bytes, false, random)) return false;
+    }
+    else if (dataset.name == QLatin1String("tiny"))
+    {
+      dataset.files = qint64(100000 * scale);
+      dataset.bytes = dataset.files * 512;
+
+      for (qint64 i=0; i<dataset.files && !reuse; ++i)
+      {
+        //No dir holds more than 1000 of them
+        QString dir = path + QDir::separator() + QString::number(i / 1000);
+        if (i % 1000 == 0) QDir().mkpath(dir);
+        if (!writeFile(dir + QDir::separator() + QString::number(i), 512, false, random)) return false;
+      }
+    }
+    else if (dataset.name == QLatin1String("mixed"))
+    {
+      dataset.files = qint64(500 * scale);
+
+      for (qint64 i=0; i<dataset.files; ++i)
+      {
+        //Sizes between 2^10 and 2^24, every magnitude as likely as the others
+        qint64 size = qint64(1) << random.range(10, 23);
+        size += random.range(0, size);
+        dataset.bytes += size;
+
+        if (reuse) continue;
+
+        QString dir = path + QDir::separator() + QString::number(i % 10) + QDir::separator() + QString::number(i % 7);
+        QDir().mkpath(dir);
+        if (!writeFile(dir + QDir::separator() + QString::number(i), size, (i % 3) == 0, random)) return false;
+      }
+    }
+    else
+    {
+      bool text = dataset.name == QLatin1String("compressible");
+      dataset.files = 16;
+      dataset.bytes = dataset.files * qint64(16 * scale) * ctn_MB;
+
+      if (!reuse) QDir().mkpath(path);
+
+      for (qint64 i=0; i<dataset.files && !reuse; ++i)
+      {
+        if (!writeFile(path + QDir::separator() + QString::number(i), dataset.bytes / dataset.files, text, random)) return false;
+      }
+    }
+
+    if (!reuse)
+    {
+      stamp.open(QFile::WriteOnly);
+      stamp.write(QByteArray::number(scale));
+    }
+  }
+
+  return true;
+}
+
+/*
+ * Starts binary with args on workDir, its output going to logFile. Returns its pid, or -1
+ */
+static pid_t startProcess(const QString &binary, const QStringList &args, const QString &workDir, const QString &logFile)
+{
+  QByteArray program = QFile::encodeName(binary);
+  QByteArray dir = QFile::encodeName(workDir);
+  QByteArray log = QFile::encodeName(logFile);
+  QList<QByteArray> encoded;
+  QVector<char *> argv;
+
+  encoded << program;
+  for (const QString &arg: args) encoded << arg.toLocal8Bit();
+  for (QByteArray &arg: encoded) argv << arg.data();
+  argv << nullptr;
+
+  pid_t pid = fork();
+
+  if (pid == 0)
+  {
+    int fd = ::open(log.constData(), O_WRONLY | O_CREAT | O_TRUNC, 0644);
+    int null = ::open("/dev/null", O_RDONLY);
+
+    if (fd < 0 || null < 0 || ::chdir(dir.constData()) != 0) _exit(127);
+
+    ::dup2(null, 0);
+    ::dup2(fd, 1);
+    ::dup2(fd, 2);
+    ::execv(program.constData(), argv.data());
+    _exit(127);
+  }
+
+  return pid;
+}
+
+static Usage waitProcess(pid_t pid)
+{
+  Usage usage;
+  struct rusage rusage;
+  int status = 0;
+
+  if (pid > 0 && ::wait4(pid, &status, 0, &rusage) == pid)
+  {
+    usage.status = WIFEXITED(status) ? WEXITSTATUS(status) : -1;
+    usage.cpuSeconds = rusage.ru_utime.tv_sec + rusage.ru_utime.tv_usec / 1e6 + rusage.ru_stime.tv_sec + rusage.ru_stime.tv_usec / 1e6;
+    usage.peakRssKb = rusage.ru_maxrss;
+  }
+
+  return usage;
+}
+
+/*
+ * Waits for zorg to tell it is listening
+ */
+static bool waitForZorg(const QString &logFile)
+{
+  for (int elapsed=0; elapsed<ctn_ZORG_START_TIMEOUT; elapsed+=10)
+  {
+    QFile log(logFile);
+    if (log.open(QFile::ReadOnly) && log.readAll().contains("Start zorging")) return true;
+    QThread::msleep(10);
+  }
+
+  return false;
+}
+
+static double now()
+{
+  struct timeval tv;
+  gettimeofday(&tv, nullptr);
+  return tv.tv_sec + tv.tv_usec / 1e6;
+}
+
+/*
+ * Gorgs dataset to a new zorg, returning what it took
+ */
+static QJsonObject run(const QString &binary, const QString &workDir, const Dataset &dataset, int port,
+                       const QStringList &gorgArgs, const QStringList &zorgArgs)
+{
+  QString receiveDir = workDir + QDir::separator() + QLatin1String("received");
+  QDir(receiveDir).removeRecursively();
+  QDir().mkpath(receiveDir);
+
+  QString zorgLog = workDir + QDir::separator() + QLatin1String("zorg.log");
+  QString gorgLog = workDir + QDir::separator() + QLatin1String("gorg.log");
+
+  QStringList zorg;
+  zorg << QLatin1String("-z") << QLatin1String("127.0.0.1") << QLatin1String("-p") << QString::number(port) <<
+          QLatin1String("-y") << QLatin1String("-q") << QLatin1String("-d") << receiveDir << zorgArgs;
+
+  QStringList gorg;
+  gorg << QLatin1String("-c") << QLatin1String("127.0.0.1") << QLatin1String("-p") << QString::number(port) <<
+          QLatin1String("-g") << dataset.name << dataset.gorgArgs << gorgArgs;
+
+  QJsonObject result;
+  result.insert(QLatin1String("name"), dataset.name);
+  result.insert(QLatin1String("description"), dataset.description);
+  result.insert(QLatin1String("files"), dataset.files);
+  result.insert(QLatin1String("bytes"), dataset.bytes);
+
+  pid_t zorgPid = startProcess(binary, zorg, workDir, zorgLog);
+
+  if (zorgPid < 0 || !waitForZorg(zorgLog))
+  {
+    if (zorgPid > 0)
+    {
+      ::kill(zorgPid, SIGKILL);
+      waitProcess(zorgPid);
+    }
+
+    result.insert(QLatin1String("ok"), false);
+    return result;
+  }
+
+  //The clock runs until zorg quits, which is when the last file is on its disk
+  double start = now();
+  pid_t gorgPid = startProcess(binary, gorg, workDir + QDir::separator() + QLatin1String("data"), gorgLog);
+  Usage gorgUsage = waitProcess(gorgPid);
+
+  if (gorgUsage.status != 0) ::kill(zorgPid, SIGKILL);
+
+  Usage zorgUsage = waitProcess(zorgPid);
+  double seconds = qMax(now() - start, 1e-6);
+
+  result.insert(QLatin1String("ok"), gorgUsage.status == 0 && zorgUsage.status == 0);
+  result.insert(QLatin1String("seconds"), seconds);
+  result.insert(QLatin1String("mbPerSec"), (dataset.bytes / double(ctn_MB)) / seconds);
+  result.insert(QLatin1String("filesPerSec"), dataset.files / seconds);
+  result.insert(QLatin1String("gorgCpuSeconds"), gorgUsage.cpuSeconds);
+  result.insert(QLatin1String("zorgCpuSeconds"), zorgUsage.cpuSeconds);
+  result.insert(QLatin1String("gorgPeakRssKb"), gorgUsage.peakRssKb);
+  result.insert(QLatin1String("zorgPeakRssKb"), zorgUsage.peakRssKb);
+
+  return result;
+}
+
+/*
+ * Compares results against the ones of baseline, telling which datasets lost more than tolerance % of their MB/s.
+ * Returns false if any did
+ */
+static bool compare(const QJsonArray &results, const QJsonArray &baseline, double tolerance)
+{
+  bool ok = true;
+
+  for (const QJsonValue &value: results)
+  {
+    QJsonObject result = value.toObject();
+
+    for (const QJsonValue &baseValue: baseline)
+    {
+      QJsonObject base = baseValue.toObject();
+      if (base.value(QLatin1String("name")) != result.value(QLatin1String("name"))) continue;
+
+      double before = base.value(QLatin1String("mbPerSec")).toDouble();
+      double after = result.value(QLatin1String("mbPerSec")).toDouble();
+      double change = before > 0 ? (after - before) * 100.0 / before : 0;
+      bool regressed = change < -tolerance || !result.value(QLatin1String("ok")).toBool();
+
+      std::cerr << (regressed ? "REGRESSION " : "ok         ") << result.value(QLatin1String("name")).toString().toLatin1().data() <<
+                   ": " << QString::number(before, 'f', 2).toLatin1().data() << " -> " <<
+                   QString::number(after, 'f', 2).toLatin1().data() << " MB/s (" <<
+                   QString::number(change, 'f', 1).toLatin1().data() << "%)" << std::endl;
+
+      if (regressed) ok = false;
+    }
+  }
+
+  return ok;
+}
+
+/*
+ * Splits the params passed (quoted) to "-gorg" or "-zorg"
+ */
+static QStringList params(const QString &value)
+{
+  QStringList list = value.split(QLatin1Char(' '));
+  list.removeAll(QString());
+
+  return list;
+}
+
+static void showHelp()
+{
+  std::cout << std::endl << "  gorgzorg_bench, loopback throughput benchmark of GorgZorg" << std::endl;
+  std::cout << std::endl << "    -baseline <file>: Compare MB/s against the JSON of an earlier run and exit with 1 on regressions" << std::endl;
+  std::cout << "    -binary <path>: gorgzorg binary to benchmark (default is the one next to gorgzorg_bench)" << std::endl;
+  std::cout << "    -gorg \"<params>\": Extra params of every gorg run (ex: \"-window 64 -sendfile\")" << std::endl;
+  std::cout << "    -h: Show this help" << std::endl;
+  std::cout << "    -o <file>: Write the JSON results to file instead of stdout" << std::endl;
+  std::cout << "    -only <dataset>: Run only this dataset (huge, tiny, mixed, compressible or incompressible)" << std::endl;
+  std::cout << "    -p <portnumber>: Port zorg listens to (default is " << ctn_BENCH_PORT << ")" << std::endl;
+  std::cout << "    -scale <factor>: Scale the size of the datasets (default is 1: 1 GB, 100k tiny files...)" << std::endl;
+  std::cout << "    -tolerance <percent>: MB/s a dataset may lose against the baseline (default is " << ctn_DEFAULT_TOLERANCE << ")" << std::endl;
+  std::cout << "    -work <dir>: Directory where datasets are kept between runs (default is a temporary one)" << std::endl;
+  std::cout << "    -zorg \"<params>\": Extra params of every zorg run (ex: \"-splice\")" << std::endl;
+  std::cout << std::endl;
+}
+
+int main(int argc, char *argv[])
+{
+  QCoreApplication a(argc, argv);
+  ArgumentList *argList = new ArgumentList(argc, argv);
+
+  if (argList->getSwitch("-h"))
+  {
+    showHelp();
+    exit(0);
+  }
+
+  QString binary = argList->getSwitchArg(QLatin1String("-binary"),
+                                         QCoreApplication::applicationDirPath() + QDir::separator() + QLatin1String("gorgzorg"));
+  QString baselineFile = argList->getSwitchArg(QLatin1String("-baseline"));
+  QString outputFile = argList->getSwitchArg(QLatin1String("-o"));
+  QString only = argList->getSwitchArg(QLatin1String("-only"));
+  QString workDir = argList->getSwitchArg(QLatin1String("-work"));
+  QStringList gorgArgs = params(argList->getSwitchArg(QLatin1String("-gorg")));
+  QStringList zorgArgs = params(argList->getSwitchArg(QLatin1String("-zorg")));
+  double scale = argList->getSwitchArg(QLatin1String("-scale"), QLatin1String("1")).toDouble();
+  double tolerance = argList->getSwitchArg(QLatin1String("-tolerance"), QString::number(ctn_DEFAULT_TOLERANCE)).toDouble();
+  int port = argList->getSwitchArg(QLatin1String("-p"), QString::number(ctn_BENCH_PORT)).toInt();
+
+  if (!QFileInfo(binary).isExecutable())
+  {
+    std::cout << "ERROR: " << binary.toLatin1().data() << " is not a GorgZorg binary!" << std::endl;
+    exit(1);
+  }
+
+  if (scale <= 0 || port <= 0)
+  {
+    std::cout << "ERROR: The scale and the port must be positive numbers!" << std::endl;
+    exit(1);
+  }
+
+  QJsonArray baseline;
+  if (!baselineFile.isEmpty())
+  {
+    QFile file(baselineFile);
+
+    if (!file.open(QFile::ReadOnly))
+    {
+      std::cout << "ERROR: " << baselineFile.toLatin1().data() << " could not be opened" << std::endl;
+      exit(1);
+    }
+
+    baseline = QJsonDocument::fromJson(file.readAll()).object().value(QLatin1String("results")).toArray();
+  }
+
+  bool temporary = workDir.isEmpty();
+  if (temporary) workDir = QDir::tempPath() + QDir::separator() + QLatin1String("gorgzorg_bench_") + QString::number(getpid());
+  workDir = QFileInfo(workDir).absoluteFilePath();
+  QString dataDir = workDir + QDir::separator() + QLatin1String("data");
+  QDir().mkpath(dataDir);
+
+  QVector<Dataset> datasets;
+  if (!createDatasets(dataDir, scale, datasets))
+  {
+    std::cout << "ERROR: Datasets could not be created on " << dataDir.toLatin1().data() << std::endl;
+    exit(1);
+  }
+
+  QJsonArray results;
+
+  for (const Dataset &dataset: datasets)
+  {
+    if (!only.isEmpty() && dataset.name != only) continue;
+
+    std::cerr << "Gorging " << dataset.name.toLatin1().data() << "..." << std::endl;
+    QJsonObject result = run(binary, workDir, dataset, port, gorgArgs, zorgArgs);
+
+    if (!result.value(QLatin1String("ok")).toBool())
+      std::cerr << "WARNING: " << dataset.name.toLatin1().data() << " failed, see the logs on " << workDir.toLatin1().data() << std::endl;
+
+    results.append(result);
+  }
+
+  QDir(workDir + QDir::separator() + QLatin1String("received")).removeRecursively();
+  if (temporary) QDir(workDir).removeRecursively();
+
+  QJsonObject report;
+  report.insert(QLatin1String("binary"), binary);
+  report.insert(QLatin1String("scale"), scale);
+  report.insert(QLatin1String("gorgParams"), gorgArgs.join(QLatin1Char(' ')));
+  report.insert(QLatin1String("zorgParams"), zorgArgs.join(QLatin1Char(' ')));
+  report.insert(QLatin1String("results"), results);
+
+  QByteArray json = QJsonDocument(report).toJson();
+
+  if (outputFile.isEmpty())
+  {
+    std::cout << json.constData();
+  }
+  else
+  {
+    QFile file(outputFile);
+
+    if (!file.open(QFile::WriteOnly) || file.write(json) != json.size())
+    {
+      std::cout << "ERROR: " << outputFile.toLatin1().data() << " could not be written" << std::endl;
+      exit(1);
+    }
+  }
+
+  bool ok = baseline.isEmpty() || compare(results, baseline, tolerance);
+  return ok ? 0 : 1;
+}
@@ -0,0 +1,47 @@
+#!/bin/sh
+#
+# This file is part of GorgZorg, a simple multiplatform CLI network file transfer tool.
+# Copyright (C) 2021 Alexandre Albuquerque Arnt
+#
+# Gorgs a directory of many small files to a local zorg, first writing them the usual way and then through
+# io_uring ("-uring"), and prints how many files per second zorg received each time.
+#
+# Usage: bench/small_files.sh [path/to/gorgzorg] [files] [size in bytes]
+#
+
+GORGZORG=${1:-./gorgzorg}
+FILES=${2:-100000}
+SIZE=${3:-4096}
+PORT=${PORT:-10777}
+WORK=$(mktemp -d)
+
+trap 'rm -rf "$WORK"' EXIT
+
+echo "Creating $FILES files of $SIZE bytes..."
+mkdir -p "$WORK/src/storm" "$WORK/dst"
+head -c "$SIZE" /dev/urandom > "$WORK/sample"
+i=0
+while [ $i -lt "$FILES" ]; do
+  cp "$WORK/sample" "$WORK/src/storm/f$i"
+  i=$((i + 1))
+done
+
+run()
+{
+  rm -rf "$WORK/dst" && mkdir -p "$WORK/dst"
+  "$GORGZORG" -z 127.0.0.1 -p "$PORT" -y -q -d "$WORK/dst" "$@" > /dev/null &
+  ZORG=$!
+  sleep 1
+
+  START=$(date +%s.%N)
+  (cd "$WORK/src" && "$GORGZORG" -c 127.0.0.1 -p "$PORT" -g storm -window 256 > /dev/null)
+  wait $ZORG
+  END=$(date +%s.%N)
+
+  RECEIVED=$(find "$WORK/dst" -type f | wc -l)
+  echo "$RECEIVED $START $END" | awk -v name="$NAME" '{ printf "%-12s %8d files in %7.2f s = %10.0f files/s\n", name, $1, $3 - $2, $1 / ($3 - $2) }'
+}
+
+sync
+NAME="write loop" run
+NAME="io_uring" run -uring
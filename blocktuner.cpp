@@ -0,0 +1,87 @@
+/*
+* This file is part of GorgZorg, a simple multiplatform CLI network file transfer tool.
+* Copyright (C) 2021 Alexandre Albuquerque Arnt
+*
+* This program is distributed in the hope that it will be useful,
+* but WITHOUT ANY WARRANTY; without even the implied warranty of
+* MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.
+*
+* Source code hosted on: https://github.com/aarnt/gorgzorg
+*/
+
+#include "blocktuner.h"
+
+BlockTuner::BlockTuner():
+  m_windowBytes(0), m_rtt(0), m_bestThroughput(0), m_bestBlockSize(ctn_TUNE_MIN_BLOCK_SIZE),
+  m_bestBufferSize(ctn_TUNE_MIN_BUFFER_SIZE), m_blockSize(ctn_TUNE_MIN_BLOCK_SIZE),
+  m_bufferSize(ctn_TUNE_MIN_BUFFER_SIZE), m_misses(0), m_tuning(false)
+{
+}
+
+/*
+ * Starts tuning from the smallest block, bufferSize being what the OS gave the socket
+ */
+void BlockTuner::start(qint64 rttUsecs, int bufferSize)
+{
+  m_rtt = rttUsecs;
+  m_blockSize = ctn_TUNE_MIN_BLOCK_SIZE;
+  m_bufferSize = qBound(ctn_TUNE_MIN_BUFFER_SIZE, bufferSize, ctn_TUNE_MAX_BUFFER_SIZE);
+  m_bestBlockSize = m_blockSize;
+  m_bestBufferSize = m_bufferSize;
+  m_bestThroughput = 0;
+  m_windowBytes = 0;
+  m_misses = 0;
+  m_tuning = true;
+  m_window.invalidate();
+}
+
+/*
+ * Counts bytes handed to the socket. Returns true when the block or buffer size changed
+ */
+bool BlockTuner::addSent(qint64 bytes)
+{
+  if (!m_tuning) return false;
+
+  if (!m_window.isValid())
+  {
+    m_window.start();
+    m_windowBytes = 0;
+    return false;
+  }
+
+  m_windowBytes += bytes;
+  qint64 elapsed = m_window.elapsed();
+  if (elapsed < ctn_TUNE_WINDOW_MS) return false;
+
+  double throughput = double(m_windowBytes) * 1000 / elapsed;
+  m_window.start();
+  m_windowBytes = 0;
+
+  if (throughput > m_bestThroughput * (100 + ctn_TUNE_MIN_GAIN) / 100)
+  {
+    m_bestThroughput = throughput;
+    m_bestBlockSize = m_blockSize;
+    m_bestBufferSize = m_bufferSize;
+    m_misses = 0;
+  }
+  else
+  {
+    m_misses++;
+  }
+
+  //Nothing left to try, so let's keep what worked best
+  if (m_misses >= ctn_TUNE_MAX_MISSES ||
+      (m_blockSize == ctn_TUNE_MAX_BLOCK_SIZE && m_bufferSize == ctn_TUNE_MAX_BUFFER_SIZE))
+  {
+    m_blockSize = m_bestBlockSize;
+    m_bufferSize = m_bestBufferSize;
+    m_tuning = false;
+    return true;
+  }
+
+  qint64 bdp = qint64(throughput * m_rtt / 1000000);
+  m_blockSize = qMin(m_blockSize * 2, ctn_TUNE_MAX_BLOCK_SIZE);
+  m_bufferSize = int(qBound(qint64(m_bufferSize), qMax(2 * bdp, 4 * qint64(m_blockSize)), qint64(ctn_TUNE_MAX_BUFFER_SIZE)));
+
+  return true;
+}
@@ -0,0 +1,57 @@
+/*
+* This file is part of GorgZorg, a simple multiplatform CLI network file transfer tool.
+* Copyright (C) 2021 Alexandre Albuquerque Arnt
+*
+* This program is distributed in the hope that it will be useful,
+* but WITHOUT ANY WARRANTY; without even the implied warranty of
+* MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.
+*
+* Source code hosted on: https://github.com/aarnt/gorgzorg
+*/
+
+#ifndef BLOCKTUNER_H
+#define BLOCKTUNER_H
+
+#include <QElapsedTimer>
+
+const int ctn_TUNE_MIN_BLOCK_SIZE = 4 * 1024;
+const int ctn_TUNE_MAX_BLOCK_SIZE = 4 * 1024 * 1024;
+const int ctn_TUNE_MIN_BUFFER_SIZE = 64 * 1024;
+const int ctn_TUNE_MAX_BUFFER_SIZE = 32 * 1024 * 1024;
+const qint64 ctn_TUNE_WINDOW_MS = 250;    //Time throughput is measured over before each step
+const int ctn_TUNE_MIN_GAIN = 5;          //Percent of throughput a step must gain to be worth it
+const int ctn_TUNE_MAX_MISSES = 2;        //Steps without gain before settling on the best values
+
+/*
+ * Sizes the blocks gorg sends and the socket buffers from what the transfer achieves: both are doubled
+ * every measuring window while throughput improves, then set back to the best values measured.
+ * Socket buffers are kept at least twice the bandwidth-delay product
+ */
+class BlockTuner
+{
+public:
+  BlockTuner();
+
+  void start(qint64 rttUsecs, int bufferSize);
+  bool addSent(qint64 bytes);
+
+  inline bool isTuning() const { return m_tuning; }
+  inline int blockSize() const { return m_blockSize; }
+  inline int bufferSize() const { return m_bufferSize; }
+  inline qint64 rtt() const { return m_rtt; }
+  inline qint64 throughput() const { return qint64(m_bestThroughput); }
+
+private:
+  QElapsedTimer m_window;
+  qint64 m_windowBytes;
+  qint64 m_rtt;             //Round trip time (in microseconds) of the hello exchange
+  double m_bestThroughput;  //Bytes per second
+  int m_bestBlockSize;
+  int m_bestBufferSize;
+  int m_blockSize;
+  int m_bufferSize;
+  int m_misses;
+  bool m_tuning;
+};
+
+#endif // BLOCKTUNER_H
@@ -0,0 +1,217 @@
+/*
+* This file is part of GorgZorg, a simple multiplatform CLI network file transfer tool.
+* Copyright (C) 2021 Alexandre Albuquerque Arnt
+*
+* This program is distributed in the hope that it will be useful,
+* but WITHOUT ANY WARRANTY; without even the implied warranty of
+* MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.
+*
+* Source code hosted on: https://github.com/aarnt/gorgzorg
+*/
+
+#include "bodydigest.h"
+
+#include <QtEndian>
+
+#include <cstring>
+
+#ifdef GORGZORG_HAVE_XXHASH
+  #include <xxhash.h>
+#endif
+
+static const quint64 s_prime1 = 11400714785074694791ULL;
+static const quint64 s_prime2 = 14029467366897019727ULL;
+static const quint64 s_prime3 = 1609587929392839161ULL;
+static const quint64 s_prime4 = 9650029242287828579ULL;
+static const quint64 s_prime5 = 2870177450012600261ULL;
+
+static inline quint64 rotl(quint64 value, int bits)
+{
+  return (value << bits) | (value >> (64 - bits));
+}
+
+static inline quint64 round64(quint64 acc, quint64 input)
+{
+  acc += input * s_prime2;
+  return rotl(acc, 31) * s_prime1;
+}
+
+static inline quint64 mergeRound(quint64 acc, quint64 value)
+{
+  acc ^= round64(0, value);
+  return acc * s_prime1 + s_prime4;
+}
+
+BodyDigest::BodyDigest(DigestType type):
+  m_type(type), m_state(nullptr), m_length(0), m_bufferSize(0)
+{
+  m_acc[0] = s_prime1 + s_prime2;
+  m_acc[1] = s_prime2;
+  m_acc[2] = 0;
+  m_acc[3] = 0 - s_prime1;
+
+#ifdef GORGZORG_HAVE_XXHASH
+  if (m_type == DigestType::Xxh3)
+  {
+    XXH3_state_t *state = XXH3_createState();
+    XXH3_128bits_reset(state);
+    m_state = state;
+  }
+#endif
+}
+
+BodyDigest::~BodyDigest()
+{
+#ifdef GORGZORG_HAVE_XXHASH
+  if (m_state != nullptr) XXH3_freeState(static_cast<XXH3_state_t*>(m_state));
+#endif
+}
+
+void BodyDigest::addData(const char *data, qint64 size)
+{
+  if (size <= 0) return;
+
+#ifdef GORGZORG_HAVE_XXHASH
+  if (m_state != nullptr)
+  {
+    XXH3_128bits_update(static_cast<XXH3_state_t*>(m_state), data, size_t(size));
+    return;
+  }
+#endif
+
+  const uchar *bytes = reinterpret_cast<const uchar*>(data);
+  m_length += quint64(size);
+
+  //Complete the pending stripe first
+  if (m_bufferSize > 0)
+  {
+    int fill = int(qMin(qint64(32 - m_bufferSize), size));
+    memcpy(m_buffer + m_bufferSize, bytes, size_t(fill));
+    m_bufferSize += fill;
+    bytes += fill;
+    size -= fill;
+
+    if (m_bufferSize < 32) return;
+
+    consumeStripes(m_buffer, 32);
+    m_bufferSize = 0;
+  }
+
+  qint64 whole = size & ~qint64(31);
+  consumeStripes(bytes, whole);
+
+  m_bufferSize = int(size - whole);
+  memcpy(m_buffer, bytes + whole, size_t(m_bufferSize));
+}
+
+void BodyDigest::consumeStripes(const uchar *data, qint64 size)
+{
+  quint64 v1 = m_acc[0], v2 = m_acc[1], v3 = m_acc[2], v4 = m_acc[3];
+
+  for (const uchar *end = data + size; data < end; data += 32)
+  {
+    v1 = round64(v1, qFromLittleEndian<quint64>(data));
+    v2 = round64(v2, qFromLittleEndian<quint64>(data + 8));
+    v3 = round64(v3, qFromLittleEndian<quint64>(data + 16));
+    v4 = round64(v4, qFromLittleEndian<quint64>(data + 24));
+  }
+
+  m_acc[0] = v1; m_acc[1] = v2; m_acc[2] = v3; m_acc[3] = v4;
+}
+
+/*
+ * Returns the digest in its canonical (big endian) form
+ */
+QByteArray BodyDigest::result()
+{
+  QByteArray digest(size(m_type), '\0');
+
+#ifdef GORGZORG_HAVE_XXHASH
+  if (m_state != nullptr)
+  {
+    XXH128_canonical_t canonical;
+    XXH128_canonicalFromHash(&canonical, XXH3_128bits_digest(static_cast<XXH3_state_t*>(m_state)));
+    memcpy(digest.data(), canonical.digest, sizeof(canonical.digest));
+    return digest;
+  }
+#endif
+
+  quint64 h;
+
+  if (m_length >= 32)
+  {
+    h = rotl(m_acc[0], 1) + rotl(m_acc[1], 7) + rotl(m_acc[2], 12) + rotl(m_acc[3], 18);
+    for (int i=0; i<4; ++i)
+      h = mergeRound(h, m_acc[i]);
+  }
+  else
+  {
+    h = s_prime5;
+  }
+
+  h += m_length;
+
+  const uchar *p = m_buffer;
+  const uchar *end = m_buffer + m_bufferSize;
+
+  for (; p + 8 <= end; p += 8)
+  {
+    h ^= round64(0, qFromLittleEndian<quint64>(p));
+    h = rotl(h, 27) * s_prime1 + s_prime4;
+  }
+
+  if (p + 4 <= end)
+  {
+    h ^= quint64(qFromLittleEndian<quint32>(p)) * s_prime1;
+    h = rotl(h, 23) * s_prime2 + s_prime3;
+    p += 4;
+  }
+
+  for (; p < end; ++p)
+  {
+    h ^= *p * s_prime5;
+    h = rotl(h, 11) * s_prime1;
+  }
+
+  h ^= h >> 33;
+  h *= s_prime2;
+  h ^= h >> 29;
+  h *= s_prime3;
+  h ^= h >> 32;
+
+  qToBigEndian<quint64>(h, reinterpret_cast<uchar*>(digest.data()));
+  return digest;
+}
+
+int BodyDigest::size(DigestType type)
+{
+  return type == DigestType::Xxh3 ? 16 : 8;
+}
+
+QString BodyDigest::typeName(DigestType type)
+{
+  return type == DigestType::Xxh3 ? QStringLiteral("xxh3") : QStringLiteral("xxh64");
+}
+
+bool BodyDigest::isAvailable(DigestType type)
+{
+#ifdef GORGZORG_HAVE_XXHASH
+  Q_UNUSED(type)
+  return true;
+#else
+  return type == DigestType::Xxh64;
+#endif
+}
+
+/*
+ * Every GorgZorg can check xxh64, so it is used unless the peer told us it can check xxh3 too
+ */
+DigestType BodyDigest::defaultType(bool peerHasXxh3)
+{
+#ifdef GORGZORG_HAVE_XXHASH
+  if (peerHasXxh3) return DigestType::Xxh3;
+#else
+  Q_UNUSED(peerHasXxh3)
+#endif
+  return DigestType::Xxh64;
+}
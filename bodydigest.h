@@ -0,0 +1,56 @@
+/*
+* This file is part of GorgZorg, a simple multiplatform CLI network file transfer tool.
+* Copyright (C) 2021 Alexandre Albuquerque Arnt
+*
+* This program is distributed in the hope that it will be useful,
+* but WITHOUT ANY WARRANTY; without even the implied warranty of
+* MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.
+*
+* Source code hosted on: https://github.com/aarnt/gorgzorg
+*/
+
+#ifndef BODYDIGEST_H
+#define BODYDIGEST_H
+
+#include <QByteArray>
+#include <QString>
+
+enum class DigestType {Xxh64, Xxh3};
+
+/*
+ * Non cryptographic hash of a file body, computed by both sides while the body streams. The digest
+ * gorg computed travels in a trailer after the body, so zorg can tell a file arrived intact.
+ *
+ * xxh3 (128 bits, SIMD accelerated by libxxhash) is used when libxxhash is found at build time.
+ * xxh64 has no dependency, so every zorg can check it
+ */
+class BodyDigest
+{
+public:
+  explicit BodyDigest(DigestType type);
+  ~BodyDigest();
+
+  void addData(const char *data, qint64 size);
+  void addData(const QByteArray &data) { addData(data.constData(), data.size()); }
+  QByteArray result();
+  DigestType type() const { return m_type; }
+
+  static int size(DigestType type);
+  static QString typeName(DigestType type);
+  static bool isAvailable(DigestType type);
+  static DigestType defaultType(bool peerHasXxh3);
+
+private:
+  DigestType m_type;
+  void *m_state;            //libxxhash state of xxh3
+
+  //xxh64 state
+  quint64 m_acc[4];
+  quint64 m_length;
+  uchar m_buffer[32];       //Input not consumed yet, as xxh64 works on 32 byte stripes
+  int m_bufferSize;
+
+  void consumeStripes(const uchar *data, qint64 size);
+};
+
+#endif // BODYDIGEST_H
@@ -0,0 +1,72 @@
+/*
+* This file is part of GorgZorg, a simple multiplatform CLI network file transfer tool.
+* Copyright (C) 2021 Alexandre Albuquerque Arnt
+*
+* This program is distributed in the hope that it will be useful,
+* but WITHOUT ANY WARRANTY; without even the implied warranty of
+* MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.
+*
+* Source code hosted on: https://github.com/aarnt/gorgzorg
+*/
+
+#include "console.h"
+
+#include <QTextStream>
+
+#include <cstdio>
+
+#ifndef Q_OS_WIN
+  #include <sys/ioctl.h>
+  #include <termios.h>
+#else
+  #include <conio.h>
+#endif
+
+#ifndef Q_OS_WIN
+/*
+ * Retrieves a char from stdin, with no need for an ENTER
+ */
+static int readCharResponse()
+{
+  static bool initflag = false;
+  static const int STDIN = 0;
+
+  if (!initflag) {
+    // Use termios to turn off line buffering
+    struct termios term;
+    tcgetattr(STDIN, &term);
+    term.c_lflag &= ~ICANON;
+    tcsetattr(STDIN, TCSANOW, &term);
+    setbuf(stdin, NULL);
+    initflag = true;
+  }
+
+  int nbbytes;
+  ioctl(STDIN, FIONREAD, &nbbytes);  // 0 is STDIN
+  return nbbytes;
+}
+#endif
+
+/*
+ * Asks user about strQuestion. The reply will be just 1 char size
+ */
+char Console::question(const QString &strQuestion)
+{
+  QTextStream(stdout) << strQuestion;
+
+#ifndef Q_OS_WIN
+  while (!readCharResponse())
+  {
+    fflush(stdout);
+  }
+
+  return (getchar());
+#else
+  while (!_kbhit())
+  {
+    fflush(stdout);
+  }
+
+  return _getch();
+#endif
+}
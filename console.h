@@ -0,0 +1,26 @@
+/*
+* This file is part of GorgZorg, a simple multiplatform CLI network file transfer tool.
+* Copyright (C) 2021 Alexandre Albuquerque Arnt
+*
+* This program is distributed in the hope that it will be useful,
+* but WITHOUT ANY WARRANTY; without even the implied warranty of
+* MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.
+*
+* Source code hosted on: https://github.com/aarnt/gorgzorg
+*/
+
+#ifndef CONSOLE_H
+#define CONSOLE_H
+
+#include <QString>
+
+/*
+ * Talks to the user on the terminal GorgZorg runs in
+ */
+class Console
+{
+public:
+  static char question(const QString &strQuestion);
+};
+
+#endif // CONSOLE_H
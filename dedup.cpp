@@ -0,0 +1,171 @@
+/*
+* This file is part of GorgZorg, a simple multiplatform CLI network file transfer tool.
+* Copyright (C) 2021 Alexandre Albuquerque Arnt
+*
+* This program is distributed in the hope that it will be useful,
+* but WITHOUT ANY WARRANTY; without even the implied warranty of
+* MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.
+*
+* Source code hosted on: https://github.com/aarnt/gorgzorg
+*/
+
+#include "dedup.h"
+
+#include <QIODevice>
+#include <QFile>
+#include <QSaveFile>
+#include <QDir>
+#include <QFileInfo>
+#include <QCryptographicHash>
+#include <QStandardPaths>
+
+//Masks on the top bits of the gear hash: harder to match before the average size, easier after it
+static const quint64 s_maskSmall = ~quint64(0) << (64 - 18);
+static const quint64 s_maskLarge = ~quint64(0) << (64 - 14);
+
+/*
+ * The 256 random values FastCDC rolls in, one per byte value. Both sides must agree on them,
+ * so they come from a fixed seed (splitmix64)
+ */
+static const quint64 *gearTable()
+{
+  static const struct Gear
+  {
+    quint64 values[256];
+
+    Gear()
+    {
+      quint64 seed = 0x676f72677a6f7267ULL;
+
+      for (int i=0; i<256; ++i)
+      {
+        quint64 z = (seed += 0x9e3779b97f4a7c15ULL);
+        z = (z ^ (z >> 30)) * 0xbf58476d1ce4e5b9ULL;
+        z = (z ^ (z >> 27)) * 0x94d049bb133111ebULL;
+        values[i] = z ^ (z >> 31);
+      }
+    }
+  } gear;
+
+  return gear.values;
+}
+
+/*
+ * Returns the size of the chunk starting at data, size being what is left of the file (or ctn_CHUNK_MAX_SIZE)
+ */
+int Chunker::cutPoint(const uchar *data, int size)
+{
+  if (size <= ctn_CHUNK_MIN_SIZE) return size;
+  if (size > ctn_CHUNK_MAX_SIZE) size = ctn_CHUNK_MAX_SIZE;
+
+  const quint64 *gear = gearTable();
+  int normal = qMin(size, ctn_CHUNK_AVG_SIZE);
+  quint64 fingerprint = 0;
+  int i = ctn_CHUNK_MIN_SIZE;
+
+  for (; i < normal; ++i)
+  {
+    fingerprint = (fingerprint << 1) + gear[data[i]];
+    if ((fingerprint & s_maskSmall) == 0) return i;
+  }
+
+  for (; i < size; ++i)
+  {
+    fingerprint = (fingerprint << 1) + gear[data[i]];
+    if ((fingerprint & s_maskLarge) == 0) return i;
+  }
+
+  return size;
+}
+
+/*
+ * Reads the whole file, returning its chunks in order
+ */
+QVector<Chunk> Chunker::split(QIODevice *file)
+{
+  QVector<Chunk> chunks;
+  QByteArray buffer;
+  qint64 offset = 0;
+  int pos = 0;
+  bool atEnd = false;
+
+  while (true)
+  {
+    //Always have a max sized chunk ahead of us, unless the file ends before
+    if (!atEnd && buffer.size() - pos < ctn_CHUNK_MAX_SIZE)
+    {
+      buffer.remove(0, pos);
+      pos = 0;
+
+      QByteArray more = file->read(4 * ctn_CHUNK_MAX_SIZE);
+      if (more.isEmpty()) atEnd = true;
+      else buffer.append(more);
+      continue;
+    }
+
+    if (pos >= buffer.size()) break;
+
+    Chunk chunk;
+    chunk.offset = offset;
+    chunk.size = cutPoint(reinterpret_cast<const uchar*>(buffer.constData()) + pos, buffer.size() - pos);
+    chunk.hash = QCryptographicHash::hash(QByteArray::fromRawData(buffer.constData() + pos, chunk.size),
+                                          QCryptographicHash::Sha256);
+    chunks.append(chunk);
+
+    pos += chunk.size;
+    offset += chunk.size;
+  }
+
+  return chunks;
+}
+
+/*
+ * ChunkStore class methods
+ */
+
+ChunkStore::ChunkStore(const QString &path): m_path(path)
+{
+}
+
+QString ChunkStore::defaultPath()
+{
+  return QStandardPaths::writableLocation(QStandardPaths::GenericCacheLocation) + QLatin1String("/gorgzorg/chunks");
+}
+
+/*
+ * Chunks are spread in 256 subdirectories, by the first byte of their hash
+ */
+QString ChunkStore::pathOf(const QByteArray &hash) const
+{
+  QString hex = QString::fromLatin1(hash.toHex());
+  return m_path + QLatin1Char('/') + hex.left(2) + QLatin1Char('/') + hex;
+}
+
+bool ChunkStore::contains(const QByteArray &hash) const
+{
+  return QFile::exists(pathOf(hash));
+}
+
+QByteArray ChunkStore::read(const QByteArray &hash) const
+{
+  QFile file(pathOf(hash));
+  if (!file.open(QIODevice::ReadOnly)) return QByteArray();
+
+  return file.readAll();
+}
+
+/*
+ * Chunks are committed atomically, as many sessions may be storing the same chunk at the same time
+ */
+bool ChunkStore::write(const QByteArray &hash, const QByteArray &data) const
+{
+  QString path = pathOf(hash);
+  if (QFile::exists(path)) return true;
+
+  QDir().mkpath(QFileInfo(path).path());
+  QSaveFile file(path);
+  if (!file.open(QIODevice::WriteOnly)) return false;
+
+  file.write(data);
+  return file.commit();
+}
@@ -0,0 +1,69 @@
+/*
+* This file is part of GorgZorg, a simple multiplatform CLI network file transfer tool.
+* Copyright (C) 2021 Alexandre Albuquerque Arnt
+*
+* This program is distributed in the hope that it will be useful,
+* but WITHOUT ANY WARRANTY; without even the implied warranty of
+* MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.
+*
+* Source code hosted on: https://github.com/aarnt/gorgzorg
+*/
+
+#ifndef DEDUP_H
+#define DEDUP_H
+
+#include <QByteArray>
+#include <QString>
+#include <QVector>
+
+class QIODevice;
+
+const int ctn_CHUNK_MIN_SIZE = 16 * 1024;
+const int ctn_CHUNK_AVG_SIZE = 64 * 1024;
+const int ctn_CHUNK_MAX_SIZE = 256 * 1024;
+const int ctn_CHUNK_HASH_SIZE = 32;                             //SHA-256 of a chunk
+const int ctn_CHUNK_ENTRY_SIZE = 4 + ctn_CHUNK_HASH_SIZE;       //Chunk size plus its hash, as sent in a chunk list
+
+struct Chunk
+{
+  qint64 offset;            //Offset of the chunk inside the file it was cut from
+  int size;
+  QByteArray hash;
+};
+
+/*
+ * Cuts a file in content-defined chunks (FastCDC with normalized chunking), so an insertion only changes
+ * the chunks around it and equal content gets equal chunks, whatever the file name
+ */
+class Chunker
+{
+public:
+  static QVector<Chunk> split(QIODevice *file);
+  static int cutPoint(const uchar *data, int size);
+};
+
+/*
+ * Chunks zorg has already received, one file per chunk named after its hash, so any file of any later
+ * transfer can be built from them.
+ *
+ * By default the store lives in the cache dir of the user ("~/.cache/gorgzorg/chunks" on Linux), out of
+ * the dir received files are saved in, so chunks never mix with received trees nor "-sync" manifests
+ */
+class ChunkStore
+{
+public:
+  explicit ChunkStore(const QString &path = defaultPath());
+
+  static QString defaultPath();
+
+  bool contains(const QByteArray &hash) const;
+  QByteArray read(const QByteArray &hash) const;
+  bool write(const QByteArray &hash, const QByteArray &data) const;
+
+private:
+  QString m_path;
+
+  QString pathOf(const QByteArray &hash) const;
+};
+
+#endif // DEDUP_H
@@ -0,0 +1,259 @@
+/*
+* This file is part of GorgZorg, a simple multiplatform CLI network file transfer tool.
+* Copyright (C) 2021 Alexandre Albuquerque Arnt
+*
+* This program is distributed in the hope that it will be useful,
+* but WITHOUT ANY WARRANTY; without even the implied warranty of
+* MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.
+*
+* Source code hosted on: https://github.com/aarnt/gorgzorg
+*/
+
+#include "deltasync.h"
+
+#include <QIODevice>
+#include <QCryptographicHash>
+#include <QtEndian>
+
+#include <cmath>
+
+/*
+ * Square root of the file size, as rsync does, so neither the signature nor the blocks get too big
+ */
+int DeltaSync::blockSizeFor(qint64 size)
+{
+  qint64 blockSize = qint64(std::sqrt(double(size)));
+  blockSize = (blockSize + 63) & ~qint64(63);
+
+  return int(qBound(qint64(ctn_DELTA_MIN_BLOCK_SIZE), blockSize, qint64(ctn_DELTA_MAX_BLOCK_SIZE)));
+}
+
+/*
+ * Returns the rolling checksum and the MD5 of every whole block of file. A short last block is left out
+ */
+QByteArray DeltaSync::signature(QIODevice *file, int blockSize)
+{
+  QByteArray result;
+  if (blockSize <= 0 || !file->seek(0)) return result;
+
+  result.reserve(int(qMin(file->size() / blockSize * ctn_DELTA_ENTRY_SIZE, qint64(64 * 1024 * 1024))));
+
+  while (true)
+  {
+    QByteArray block = file->read(blockSize);
+    if (block.size() < blockSize) break;
+
+    char weak[4];
+    qToBigEndian<quint32>(rollingChecksum(block.constData(), blockSize), reinterpret_cast<uchar*>(weak));
+    result.append(weak, 4);
+    result.append(QCryptographicHash::hash(block, QCryptographicHash::Md5));
+  }
+
+  return result;
+}
+
+/*
+ * The rsync weak checksum: a is the sum of the bytes and b the sum of the running a values, both mod 2^16
+ */
+quint32 DeltaSync::rollingChecksum(const char *data, int size)
+{
+  quint32 a = 0;
+  quint32 b = 0;
+  const uchar *bytes = reinterpret_cast<const uchar*>(data);
+
+  for (int i=0; i<size; ++i)
+  {
+    a += bytes[i];
+    b += quint32(size - i) * bytes[i];
+  }
+
+  return (a & 0xffff) | ((b & 0xffff) << 16);
+}
+
+/*
+ * DeltaEncoder class methods
+ */
+
+DeltaEncoder::DeltaEncoder(int blockSize, const QByteArray &signature):
+  m_blockSize(blockSize), m_signature(signature), m_copyFirst(0), m_copyCount(0),
+  m_literalBytes(0), m_matchedBytes(0)
+{
+  int count = m_blockSize > 0 ? m_signature.size() / ctn_DELTA_ENTRY_SIZE : 0;
+  m_blocks.reserve(count);
+
+  for (int i=0; i<count; ++i)
+  {
+    m_blocks.insert(qFromBigEndian<quint32>(m_signature.constData() + i * ctn_DELTA_ENTRY_SIZE), i);
+  }
+}
+
+/*
+ * Scans source with a rolling checksum, writing literal and copy ops through write, then the end op
+ */
+void DeltaEncoder::encode(QIODevice *source, const Writer &write)
+{
+  QCryptographicHash digest(QCryptographicHash::Sha1);
+  QByteArray buffer;
+  int pos = 0;              //Start of the window inside buffer
+  int literal = 0;          //Start of the literal data not sent yet inside buffer
+  bool atEnd = false;
+  bool rolling = false;     //a and b hold the checksum of the window at pos
+  quint32 a = 0;
+  quint32 b = 0;
+  const quint32 bs = quint32(m_blockSize);
+
+  while (true)
+  {
+    //Keep a whole window plus the byte which rolls into it in the buffer
+    if (!atEnd && buffer.size() - pos <= m_blockSize)
+    {
+      buffer.remove(0, literal);
+      pos -= literal;
+      literal = 0;
+
+      QByteArray more = source->read(ctn_DELTA_READ_SIZE);
+
+      if (more.isEmpty())
+      {
+        atEnd = true;
+      }
+      else
+      {
+        digest.addData(more);
+        buffer.append(more);
+      }
+
+      continue;
+    }
+
+    if (m_blocks.isEmpty() || buffer.size() - pos < m_blockSize) break;
+
+    if (!rolling)
+    {
+      quint32 weak = DeltaSync::rollingChecksum(buffer.constData() + pos, m_blockSize);
+      a = weak & 0xffff;
+      b = weak >> 16;
+      rolling = true;
+    }
+
+    int block = findBlock(a | (b << 16), buffer.constData() + pos);
+
+    if (block >= 0)
+    {
+      flushLiteral(buffer.constData() + literal, pos - literal, write);
+      addCopy(block, write);
+      pos += m_blockSize;
+      literal = pos;
+      rolling = false;
+      continue;
+    }
+
+    //Slide the window one byte
+    if (buffer.size() - pos > m_blockSize)
+    {
+      quint32 out = uchar(buffer.at(pos));
+      quint32 in = uchar(buffer.at(pos + m_blockSize));
+      a = (a - out + in) & 0xffff;
+      b = (b - bs * out + a) & 0xffff;
+    }
+    else
+    {
+      rolling = false;
+    }
+
+    pos++;
+
+    if (pos - literal >= ctn_DELTA_LITERAL_SIZE)
+    {
+      flushLiteral(buffer.constData() + literal, pos - literal, write);
+      literal = pos;
+    }
+  }
+
+  //Whatever follows the last match (or the whole file, if zorg has no blocks) goes as it is
+  while (true)
+  {
+    while (literal < buffer.size())
+    {
+      int size = qMin(buffer.size() - literal, ctn_DELTA_LITERAL_SIZE);
+      flushLiteral(buffer.constData() + literal, size, write);
+      literal += size;
+    }
+
+    if (atEnd) break;
+
+    buffer = source->read(ctn_DELTA_READ_SIZE);
+    literal = 0;
+
+    if (buffer.isEmpty())
+      atEnd = true;
+    else
+      digest.addData(buffer);
+  }
+
+  flushCopy(write);
+  write(QByteArray(1, ctn_DELTA_OP_END) + digest.result());
+}
+
+/*
+ * Returns the index of the block whose checksums match window, or -1
+ */
+int DeltaEncoder::findBlock(quint32 weak, const char *window) const
+{
+  auto it = m_blocks.constFind(weak);
+  if (it == m_blocks.constEnd()) return -1;
+
+  QByteArray strong = QCryptographicHash::hash(QByteArray::fromRawData(window, m_blockSize), QCryptographicHash::Md5);
+
+  for (; it != m_blocks.constEnd() && it.key() == weak; ++it)
+  {
+    if (memcmp(m_signature.constData() + it.value() * ctn_DELTA_ENTRY_SIZE + 4, strong.constData(), 16) == 0)
+      return it.value();
+  }
+
+  return -1;
+}
+
+/*
+ * Consecutive blocks become a single copy op
+ */
+void DeltaEncoder::addCopy(int block, const Writer &write)
+{
+  m_matchedBytes += m_blockSize;
+
+  if (m_copyCount > 0 && quint32(block) == m_copyFirst + m_copyCount)
+  {
+    m_copyCount++;
+    return;
+  }
+
+  flushCopy(write);
+  m_copyFirst = quint32(block);
+  m_copyCount = 1;
+}
+
+void DeltaEncoder::flushCopy(const Writer &write)
+{
+  if (m_copyCount == 0) return;
+
+  QByteArray op(9, ctn_DELTA_OP_COPY);
+  qToBigEndian<quint32>(m_copyFirst, reinterpret_cast<uchar*>(op.data() + 1));
+  qToBigEndian<quint32>(m_copyCount, reinterpret_cast<uchar*>(op.data() + 5));
+  write(op);
+
+  m_copyCount = 0;
+}
+
+void DeltaEncoder::flushLiteral(const char *data, int size, const Writer &write)
+{
+  if (size <= 0) return;
+
+  flushCopy(write);
+
+  QByteArray op(5, ctn_DELTA_OP_LITERAL);
+  qToBigEndian<quint32>(quint32(size), reinterpret_cast<uchar*>(op.data() + 1));
+  op.append(data, size);
+  write(op);
+
+  m_literalBytes += size;
+}
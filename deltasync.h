@@ -0,0 +1,78 @@
+/*
+* This file is part of GorgZorg, a simple multiplatform CLI network file transfer tool.
+* Copyright (C) 2021 Alexandre Albuquerque Arnt
+*
+* This program is distributed in the hope that it will be useful,
+* but WITHOUT ANY WARRANTY; without even the implied warranty of
+* MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.
+*
+* Source code hosted on: https://github.com/aarnt/gorgzorg
+*/
+
+#ifndef DELTASYNC_H
+#define DELTASYNC_H
+
+#include <QByteArray>
+#include <QMultiHash>
+
+#include <functional>
+
+class QIODevice;
+
+const int ctn_DELTA_MIN_BLOCK_SIZE = 2048;
+const int ctn_DELTA_MAX_BLOCK_SIZE = 1024 * 1024;
+const int ctn_DELTA_ENTRY_SIZE = 20;                //Rolling checksum (4 bytes) plus MD5 (16 bytes) of a block
+const int ctn_DELTA_LITERAL_SIZE = 1024 * 1024;     //Max size of a literal op
+const int ctn_DELTA_READ_SIZE = 4 * 1024 * 1024;    //Bytes read from the source file at a time
+const int ctn_DELTA_DIGEST_SIZE = 20;               //SHA-1 of the whole file, carried by the end op
+
+//Ops of a delta stream: 'L' + size (4 bytes) + data, 'C' + first block + block count (4 bytes each),
+//'E' + digest of the rebuilt file
+const char ctn_DELTA_OP_LITERAL = 'L';
+const char ctn_DELTA_OP_COPY = 'C';
+const char ctn_DELTA_OP_END = 'E';
+
+/*
+ * rsync-like delta transfer. Zorg sends the signature (rolling and strong checksums of every block) of its copy
+ * of a file, then gorg scans its own file with a rolling checksum and sends only literal data plus references
+ * to the blocks zorg already has
+ */
+class DeltaSync
+{
+public:
+  static int blockSizeFor(qint64 size);
+  static QByteArray signature(QIODevice *file, int blockSize);
+  static quint32 rollingChecksum(const char *data, int size);
+};
+
+/*
+ * Produces the delta ops which turn the file a signature describes into source
+ */
+class DeltaEncoder
+{
+public:
+  typedef std::function<void(const QByteArray &)> Writer;
+
+  explicit DeltaEncoder(int blockSize, const QByteArray &signature);
+
+  void encode(QIODevice *source, const Writer &write);
+  qint64 literalBytes() const { return m_literalBytes; }
+  qint64 matchedBytes() const { return m_matchedBytes; }
+
+private:
+  int m_blockSize;
+  QByteArray m_signature;
+  QMultiHash<quint32, int> m_blocks; //Block indexes by rolling checksum
+
+  quint32 m_copyFirst;      //Pending run of consecutive matched blocks
+  quint32 m_copyCount;
+  qint64 m_literalBytes;
+  qint64 m_matchedBytes;
+
+  int findBlock(quint32 weak, const char *window) const;
+  void addCopy(int block, const Writer &write);
+  void flushCopy(const Writer &write);
+  void flushLiteral(const char *data, int size, const Writer &write);
+};
+
+#endif // DELTASYNC_H
@@ -14,26 +14,39 @@
 #include "gorgzorg.h"
 #include <iostream>
 
-#ifndef Q_OS_WIN
-  #include <sys/ioctl.h>
-  #include <termios.h>
-#else
-  #include <conio.h>
+#include "zorgserver.h"
+#include "tararchive.h"
+#include "deltasync.h"
+#include "dedup.h"
+#include "treewalker.h"
+#include "readahead.h"
+#include "pagecache.h"
+#include "progressreporter.h"
+
+#ifdef Q_OS_LINUX
+  #include <sys/sendfile.h>
+  #include <sys/uio.h>
+  #include <poll.h>
+  #include <errno.h>
+  #include <limits.h>
 #endif
 
-#include <QDataStream>
 #include <QTcpSocket>
-#include <QTcpServer>
 #include <QHostAddress>
 #include <QFile>
 #include <QTextStream>
 #include <QProcess>
-#include <QDirIterator>
 #include <QEventLoop>
 #include <QNetworkInterface>
 #include <QTime>
 #include <QRegularExpression>
 #include <QElapsedTimer>
+#include <QDateTime>
+#include <QCryptographicHash>
+#include <QtEndian>
+
+#include <thread>
+#include <vector>
 
 /*
  * Sleeps given ms miliseconds
@@ -48,53 +61,65 @@
 #endif
 }*/
 
-#ifndef Q_OS_WIN
 /*
- * Retrieves a char from stdin, with no need for an ENTER
+ * Blocks until the next message arrives on socket (waitForReadyRead also flushes what is pending to be written).
+ * Returns false if the connection or the message is broken
  */
-int readCharResponse()
+static bool readReply(QTcpSocket &socket, Message &message)
 {
-  static bool initflag = false;
-  static const int STDIN = 0;
-
-  if (!initflag) {
-    // Use termios to turn off line buffering
-    struct termios term;
-    tcgetattr(STDIN, &term);
-    term.c_lflag &= ~ICANON;
-    tcsetattr(STDIN, TCSANOW, &term);
-    setbuf(stdin, NULL);
-    initflag = true;
-  }
-
-  int nbbytes;
-  ioctl(STDIN, FIONREAD, &nbbytes);  // 0 is STDIN
-  return nbbytes;
+  bool invalid = false;
+
+  while (!Protocol::readMessage(&socket, message, invalid, false))
+  {
+    if (invalid || !socket.waitForReadyRead(-1)) return false;
+  }
+
+  return true;
 }
-#endif
 
 /*
- * Asks user about strQuestion. The reply will be just 1 char size
+ * Sends the byte range [offset, offset+length) of filePath through its own connection to zorg.
+ * It runs on its own thread, so only blocking socket calls are used
  */
-char question(const QString &strQuestion)
+static bool gorgStripe(const QString &targetAddress, int port, const QString &filePath, quint64 transferId,
+                       qint64 offset, qint64 length, qint64 loadSize, ProgressReporter *progress)
 {
-  QTextStream(stdout) << strQuestion;
+  QTcpSocket socket;
+  Message reply;
+  quint16 version;
+  quint32 capabilities;
 
-#ifndef Q_OS_WIN
-  while (!readCharResponse())
-  {
-    fflush(stdout);
-  }
+  socket.connectToHost(QHostAddress(targetAddress), quint16(port));
+  if (!socket.waitForConnected(-1)) return false;
 
-  return (getchar());
-#else
-  while (!_kbhit())
+  socket.write(Protocol::hello());
+  if (!readReply(socket, reply) || reply.type != MessageType::Hello ||
+      !Protocol::parseHello(reply.payload, version, capabilities) || version != ctn_PROTOCOL_VERSION) return false;
+
+  QFile file(filePath);
+  if (!file.open(QFile::ReadOnly) || !file.seek(offset)) return false;
+
+  FileHeader fileHeader(filePath, length, ctn_HEADER_SINGLE_TRANSFER, BodyMode::Stripe);
+  fileHeader.offset = offset;
+  fileHeader.transferId = transferId;
+  socket.write(Protocol::header(1, fileHeader));
+  if (!readReply(socket, reply) || reply.type != MessageType::Accept) return false;
+
+  qint64 remaining = length;
+  while (remaining > 0)
   {
-    fflush(stdout);
+    QByteArray block = file.read(qMin(remaining, loadSize));
+    if (block.isEmpty()) return false;
+
+    socket.write(block);
+    remaining -= block.size();
+    if (progress != nullptr) progress->addBytes(block.size());
+
+    if (socket.bytesToWrite() > ctn_PIPELINE_BUFFER_SIZE)
+      socket.waitForBytesWritten(-1);
   }
 
-  return _getch();
-#endif
+  return readReply(socket, reply) && reply.type == MessageType::Done;
 }
 
 /*
@@ -131,50 +156,329 @@ GorgZorg::GorgZorg()
   m_port = 10000;
   m_elapsedTime = new QElapsedTimer();
   m_alwaysAccept = false;
-  m_askForAccept = true;
-  m_singleTransfer = false;
   m_tarContents = false;
   m_zipContents = false;
+  m_codec = StreamCompressor::defaultCodec();
+  m_level = -1;
   m_verbose = false;
   m_quitServer = false;
+  m_zeroCopy = false;
+  m_resume = false;
+  m_resumeOffered = false;
+  m_resumeOffset = 0;
+  m_delta = false;
+  m_dedup = false;
+  m_sync = false;
+  m_verify = false;
+  m_digest = nullptr;
+  m_readAhead = nullptr;
+  m_readAheadFiles = 0;
+  m_readAheadEmpty = 0;
+  m_readAheadFull = 0;
+  m_cacheDropper = nullptr;
+  m_cacheDropped = 0;
+  m_cacheResident = 0;
+  m_progress = nullptr;
+  m_deltaBlockSize = 0;
+  m_spliceReceive = false;
+  m_uringReceive = false;
+  m_noCache = false;
+  m_window = 0;
+  m_packFileSize = 0;
+  m_packSize = ctn_PACK_SIZE * 1024;
+  m_packBytes = 0;
+  m_streams = 1;
+  m_threads = 0;
+  m_ordered = false;
+  m_helloReceived = false;
+  m_autoTune = false;
+  m_tunePending = false;
+  m_zorgCapabilities = 0;
+  m_transferId = 0;
+  m_sequence = 0;
+  m_acceptedFiles = 0;
+  m_zorgedFiles = 0;
 
   QObject::connect(m_tcpClient, &QTcpSocket::readyRead, this, &GorgZorg::readResponse);
 }
 
 /*
  * Whenever a reply from the server comes
+ *
+ * Replies may arrive split or glued together (specially when pipelining files), so they are only consumed when
+ * a whole message is there. Zorg answers every header with an accept reply (which may carry data) and then with
+ * a done reply, both with the sequence of the header, so a reply out of order means the stream is broken
  */
 void GorgZorg::readResponse()
 {
-  //What did we receive from the server?
-  QString ret = m_tcpClient->readAll();
-  //std::cout << "Received response: " << ret.toLatin1().data() << std::endl;
+  Message message;
+  bool invalid = false;
+
+  while (Protocol::readMessage(m_tcpClient, message, invalid, m_helloReceived))
+  {
+    const QByteArray &payload = message.payload;
+
+    if (message.type == MessageType::Hello)
+    {
+      quint16 version;
+
+      if (!Protocol::parseHello(payload, version, m_zorgCapabilities))
+      {
+        std::cout << std::endl << "ERROR: Invalid hello received from zorg!" << std::endl;
+        exit(1);
+      }
+
+      if (version != ctn_PROTOCOL_VERSION)
+      {
+        std::cout << std::endl << "ERROR: Zorg speaks protocol version " << QString::number(version).toLatin1().data() <<
+                     ", but this gorg speaks version " << QString::number(ctn_PROTOCOL_VERSION).toLatin1().data() << std::endl;
+        exit(1);
+      }
+
+      m_helloReceived = true;
+      continue;
+    }
+
+    bool doneReply = message.type == MessageType::Done || message.type == MessageType::Error;
+    qint64 expected = (doneReply ? m_zorgedFiles : m_acceptedFiles) + 1;
+
+    if (message.sequence != quint32(expected))
+    {
+      std::cout << std::endl << "ERROR: Reply out of sequence received from zorg!" << std::endl;
+      exit(1);
+    }
+
+    switch (message.type)
+    {
+    //Zorg has a partial copy of the file: its size and checksum come with the reply
+    case MessageType::Resume:
+      if (payload.size() != 8 + ctn_RESUME_CHECKSUM_SIZE)
+      {
+        invalid = true;
+        break;
+      }
+
+      m_resumeOffset = qFromBigEndian<qint64>(payload.constData());
+      m_resumeChecksum = payload.mid(8);
+      m_resumeOffered = true;
+      if (m_verbose) std::cout << "Zorged RESUME SEND received" << std::endl;
+      break;
+
+    //Zorg is ready for a delta: the signature of its copy comes with the reply
+    case MessageType::Delta:
+    {
+      qint64 blocks = payload.size() >= 8 ? qFromBigEndian<quint32>(payload.constData() + 4) : -1;
+
+      if (blocks < 0 || payload.size() != 8 + blocks * ctn_DELTA_ENTRY_SIZE)
+      {
+        invalid = true;
+        break;
+      }
+
+      m_deltaBlockSize = int(qFromBigEndian<quint32>(payload.constData()));
+      m_deltaSignature = payload.mid(8);
+      if (m_verbose) std::cout << "Zorged DELTA SEND received" << std::endl;
+      break;
+    }
+
+    //Zorg has read our chunk list: a bitmap of the chunks it is missing comes with the reply
+    case MessageType::Dedup:
+    {
+      qint64 chunks = payload.size() >= 4 ? qFromBigEndian<quint32>(payload.constData()) : -1;
+
+      if (chunks < 0 || payload.size() != 4 + (chunks + 7) / 8)
+      {
+        invalid = true;
+        break;
+      }
+
+      m_chunksNeeded = payload.mid(4);
+      if (m_verbose) std::cout << "Zorged DEDUP SEND received" << std::endl;
+      break;
+    }
+
+    //Zorg accepted the synced path: the manifest of what it already has comes with the reply
+    case MessageType::Sync:
+      m_manifest.clear();
+
+      if (!SyncManifest::parse(payload, m_manifest))
+      {
+        std::cout << std::endl << "ERROR: Invalid manifest received from zorg!" << std::endl;
+        exit(1);
+      }
+
+      std::cout << "Zorged SYNC SEND received" << std::endl;
+      if (m_verbose)
+        std::cout << "Zorg manifest has " << QString::number(m_manifest.size()).toLatin1().data() << " entries" << std::endl;
+      break;
+
+    //Zorg accepted the file: a striped one comes with the transfer id of its stripes
+    case MessageType::Accept:
+      m_transferId = payload.size() == 8 ? qFromBigEndian<quint64>(payload.constData()) : 0;
+      if (m_verbose) std::cout << "Zorged OK SEND received" << std::endl;
+      break;
+
+    case MessageType::Cancel:
+      std::cout << "Zorged CANCEL received. Aborting send!" << std::endl;
+      exit(0);
+
+    case MessageType::Done:
+      if (m_verbose) std::cout << "Zorged OK received" << std::endl;
+      break;
+
+    case MessageType::Error:
+    {
+      QString fileName = m_inFlight.isEmpty() ? m_currentFileName : m_inFlight.head();
+      std::cout << "ERROR: " << fileName.remove(ctn_DIR_ESCAPE).toLatin1().data() << " could not be zorged!" << std::endl;
+      break;
+    }
+
+    default:
+      invalid = true;
+    }
+
+    if (invalid) break;
+
+    if (doneReply)
+    {
+      m_stats.done(message.sequence, message.type == MessageType::Done);
+      if (!m_inFlight.isEmpty()) m_inFlight.dequeue();
+      m_zorgedFiles++;
+      emit endTransfer();
+    }
+    else
+    {
+      m_stats.accepted(message.sequence);
+      m_acceptedFiles++;
+      emit okSend();
+    }
+  }
+
+  if (invalid)
+  {
+    std::cout << std::endl << "ERROR: Unknown reply received from zorg!" << std::endl;
+    exit(1);
+  }
+}
+
+/*
+ * Connects the main socket to zorg and says hello, so both sides know they speak the same protocol
+ * and which optional features the other one has
+ */
+void GorgZorg::connectToZorg()
+{
+  Phase phase = m_stats.enter(Phase::Connect);
+  m_tcpClient->connectToHost(QHostAddress(m_targetAddress), m_port);
+  m_tcpClient->waitForConnected(-1);
+
+  if (m_tcpClient->state() == QAbstractSocket::UnconnectedState)
+  {
+    std::cout << std::endl << "ERROR: It seems there is no one zorging on " <<
+                 m_targetAddress.toLatin1().data() << ":" << QString::number(m_port).toLatin1().data() << std::endl;
+    exit(1);
+  }
+
+  QElapsedTimer rtt;
+  rtt.start();
+  m_helloReceived = false;
+  m_tcpClient->write(Protocol::hello());
+
+  //readResponse is called by waitForReadyRead
+  while (!m_helloReceived)
+  {
+    if (!m_tcpClient->waitForReadyRead(-1))
+    {
+      std::cout << std::endl << "ERROR: Zorg did not answer our hello (is it an older GorgZorg?)" << std::endl;
+      exit(1);
+    }
+  }
+
+  if (m_autoTune)
+  {
+    m_tuner.start(rtt.nsecsElapsed() / 1000, m_tcpClient->socketOption(QAbstractSocket::SendBufferSizeSocketOption).toInt());
+    m_block = m_tuner.blockSize() / 1024;
+
+    if (m_verbose)
+    {
+      std::cout << "Auto tuning from a " << QString::number(m_block).toLatin1().data() << " KB block size (RTT of " <<
+                   QString::number(m_tuner.rtt()).toLatin1().data() << " us)" << std::endl;
+    }
+  }
+
+  m_stats.enter(phase);
+}
+
+/*
+ * Returns the header message of a file. If the tuner changed the socket buffer size,
+ * the message telling zorg about it goes first, as zorg only reads it between files
+ */
+QByteArray GorgZorg::header(FileHeader fileHeader)
+{
+  QByteArray out;
 
-  if (ret == ctn_ZORGED_OK)
+  if (m_tunePending)
   {
-    std::cout << "Zorged OK received" << std::endl;
-    emit endTransfer();
+    out = Protocol::tune(m_tuner.bufferSize());
+    m_tunePending = false;
   }
-  else if (ret == ctn_ZORGED_OK_SEND)
+
+  //Zorg is told about a dir by a flag, the name is only ever the name
+  if (fileHeader.fileName.startsWith(ctn_DIR_ESCAPE))
   {
-    std::cout << "Zorged OK SEND received" << std::endl;
-    emit okSend();
+    fileHeader.fileName.remove(0, ctn_DIR_ESCAPE.size());
+    fileHeader.flags |= ctn_HEADER_DIR;
   }
-  else if (ret == ctn_ZORGED_OK_SEND_AND_ZORGED_OK) //The two previous msgs may arrive truncated!
+
+  out += Protocol::header(++m_sequence, fileHeader);
+  m_stats.headerSent(m_sequence, m_sendingADir);
+  if (m_progress != nullptr) m_progress->expect(out.size() + fileHeader.bodySize);
+
+  return out;
+}
+
+/*
+ * Feeds the tuner with the bytes just handed to the socket, applying the block and buffer sizes it picks.
+ * Setting a socket buffer turns off the autotuning of the OS, so buffers are only set once the tuner settled
+ * on one larger than what the OS already gave the socket
+ */
+void GorgZorg::tune(qint64 bytesSent)
+{
+  if (!m_autoTune || !m_tuner.addSent(bytesSent)) return;
+
+  m_block = m_tuner.blockSize() / 1024;
+  m_loadSize = m_tuner.blockSize();
+
+  if (!m_tuner.isTuning() &&
+      m_tuner.bufferSize() > m_tcpClient->socketOption(QAbstractSocket::SendBufferSizeSocketOption).toInt())
   {
-    emit okSend();
-    emit endTransfer();
-    std::cout << "Zorged OK SEND received" << std::endl;
-    std::cout << "Zorged OK received" << std::endl;
+    m_tcpClient->setSocketOption(QAbstractSocket::SendBufferSizeSocketOption, m_tuner.bufferSize());
+    m_tunePending = true;
   }
-  else if (ret == ctn_ZORGED_CANCEL_SEND)
+
+  if (m_verbose)
   {
-    removeArchive();
-    std::cout << "Zorged CANCEL received. Aborting send!" << std::endl;
-    exit(0);
+    std::cout << (m_tuner.isTuning() ? "Auto tuning: " : "Auto tuned: ") << "block size of " <<
+                 QString::number(m_block).toLatin1().data() << " KB, socket buffers of " <<
+                 QString::number(m_tuner.bufferSize() / 1024).toLatin1().data() << " KB (best throughput of " <<
+                 QString::number(m_tuner.throughput() / (1024 * 1024)).toLatin1().data() << " MB/s)" << std::endl;
   }
 }
 
+/*
+ * Returns the checksum of the last bytes (up to ctn_RESUME_CHECK_SIZE) of the first size bytes of file,
+ * or an empty array if file is shorter than that. Both sides use it to agree on where to resume
+ */
+QByteArray GorgZorg::prefixChecksum(QIODevice *file, qint64 size)
+{
+  qint64 window = qMin(size, ctn_RESUME_CHECK_SIZE);
+  if (size <= 0 || file->size() < size || !file->seek(size - window)) return QByteArray();
+
+  QByteArray data = file->read(window);
+  if (data.size() != window) return QByteArray();
+
+  return QCryptographicHash::hash(data, QCryptographicHash::Sha1);
+}
+
 /*
  * Returns true if IPv4 octects are well formed
  */
@@ -217,20 +521,12 @@ bool GorgZorg::isLocalIP(const QString &ip)
 }
 
 /*
- * Returns the SHELL environment variable, if not set defaults to sh.
- */
-QString GorgZorg::getShell()
-{
-  QProcessEnvironment env = QProcessEnvironment::systemEnvironment();
-  QString shell = env.value(QStringLiteral("SHELL"), QStringLiteral("/bin/sh"));
-  return shell;
-}
-
-/*
- * Creates a ".tar" or ".tar.gz" archive to send based on "-tar"/"-zip" command line params
+ * Prepares the ".tar" archive to send based on "-tar"/"-zip" command line params.
+ * Archives are not written to disk: TarArchive produces them while they are being sent (and compressed)
  */
 QString GorgZorg::createArchive(const QString &pathToArchive)
 {
+  Phase phase = m_stats.enter(Phase::Archive);
   bool asterisk = false;
   QString realPath;
   QString filter;
@@ -244,7 +540,8 @@ QString GorgZorg::createArchive(const QString &pathToArchive)
   }
 
   if (m_zipContents)
-    std::cout << std::endl << "Compressing " << pathToArchive.toLatin1().data();
+    std::cout << std::endl << "Compressing " << pathToArchive.toLatin1().data() <<
+                 " with " << StreamCompressor::codecName(m_codec).toLatin1().data();
   else
     std::cout << std::endl << "Archiving " << pathToArchive.toLatin1().data();
 
@@ -256,123 +553,18 @@ QString GorgZorg::createArchive(const QString &pathToArchive)
 
   QString archiveFileName = QString("gorged_%1").arg(random);
 
-  QProcess p;
-  QStringList tarParams;
-
-  if (m_zipContents)
-    tarParams << QLatin1String("-czf");
-  else
-    tarParams << QLatin1String("-cf");
-
-  if (asterisk)
-  {
-#ifndef Q_OS_WIN
-    if (m_zipContents)
-    {
-      archiveFileName += QLatin1String(".tar.gz");
-    }
-    else
-    {
-      archiveFileName += QLatin1String(".tar");
-    }
-
-    QStringList findParams;
-    QString findCommand = QLatin1String("find ") + realPath +
-        QLatin1String(" -name ") + QLatin1String("\"") + filter + QLatin1String("\"") +
-        QLatin1String(" -exec tar ") + tarParams.at(0) + QLatin1String(" ") + archiveFileName + QLatin1String(" {} +");
-
-    findParams << QLatin1String("-c");
-    findParams << findCommand;
-    p.execute(getShell(), findParams);
-    p.waitForFinished(-1);
-    p.close();
-#else
-    realPath.remove(QChar('\''));
-    filter.remove(QChar('\''));
-
-    QString compressionLevel;
-    if (m_zipContents)
-    {
-      compressionLevel = "-mx1";
-    }
-    else
-    {
-      compressionLevel = "-mx0";
-    }
-
-    archiveFileName += QLatin1String(".7z");
-
-    //Get-ChildItem c:\temp\*.dll -Recurse | Compress-Archive -Update -CompressionLevel NoCompression -DestinationPath c:\temp\power.zip
-    /*QString params = "powershell.exe -Command \"Get-ChildItem " + realPath + filter +
-        " -Recurse | Compress-Archive -Update -CompressionLevel " + compressionLevel +
-        " -DestinationPath .\\" + archiveFileName + "\"";*/
-
-    //qout << Qt::endl << QLatin1String("powershell command: %1").arg(params) << Qt::endl;
-    //qout << Qt::endl << QLatin1String("powershell output: %1").arg(p.readAllStandardOutput()) << Qt::endl;
-
-    //First, let's find where 7zip is located
-    QStringList wp;
-    wp << "/R" << "\\Program Files" << "7z.exe";
-    p.start("where", wp);
-    p.waitForFinished(-1);
-
-    QString pathTo7zip = p.readAllStandardOutput();
-    pathTo7zip.remove("\r\n");
-    //qout << Qt::endl << QLatin1String("where output: %1").arg(pathTo7zip);
-
-    if (!pathTo7zip.contains("7z.exe"))
-    {
-      wp << "/R" << "\\Program Files (x86)" << "7z.exe";
-      p.start("where", wp);
-      p.waitForFinished(-1);
-      pathTo7zip = p.readAllStandardOutput();
-      pathTo7zip.remove("\r\n");
-      //qout << Qt::endl << QLatin1String("where output: %1").arg(pathTo7zip);
-    }
-
-    if (pathTo7zip.contains("7z.exe"))
-    {
-      //"c:\Program Files\7-Zip\7z.exe" a c:\temp\test10.7zip c:\Qt\6.0.1\*.dll -r -mx1
-      QString params = "\"" + pathTo7zip + "\" a " + archiveFileName + " " + realPath + filter + " -r " + compressionLevel;
-      p.start(params);
-      p.waitForFinished(-1);
-      p.close();
-    }
+  m_tarPath = asterisk ? realPath : pathToArchive;
+  m_tarFilter = filter;
 
+#ifdef Q_OS_WIN
+  m_tarPath.remove(QChar('\''));
+  m_tarFilter.remove(QChar('\''));
 #endif
-  }
-  else
-  {
-    if (m_zipContents)
-    {
-      archiveFileName += QLatin1String(".tar.gz");
-    }
-    else
-    {
-      archiveFileName += QLatin1String(".tar");
-    }
-
-    tarParams << archiveFileName;
-    tarParams << pathToArchive;
-    p.execute(QLatin1String("tar"), tarParams);
-    p.waitForFinished(-1);
-    p.close();
-  }
 
-  return archiveFileName;
-}
+  if (m_tarPath.isEmpty()) m_tarPath = QLatin1String(".");
 
-/*
- * Removes any not sent archive
- */
-void GorgZorg::removeArchive()
-{
-  if (!m_archiveFileName.isEmpty() && QFile::exists(m_archiveFileName) &&
-      (m_archiveFileName.endsWith(".tar") || m_archiveFileName.endsWith(".tar.gz") ||
-      m_archiveFileName.endsWith(".7z")))
-  {
-    QFile::remove(m_archiveFileName);
-  }
+  m_stats.enter(phase);
+  return archiveFileName + QLatin1String(".tar");
 }
 
 /*
@@ -387,69 +579,354 @@ bool GorgZorg::prepareToSendFile(const QString &fName)
   m_outBlock.clear();
   m_sendingADir = false;
 
+  //Only the methods which send a digest trailer start one
+  delete m_digest;
+  m_digest = nullptr;
+  stopReadAhead();
+  stopDroppingCache();
+
   if (fName.startsWith(ctn_DIR_ESCAPE))
   {
     m_sendingADir = true;
   }
   else
   {
-    m_localFile = new QFile(m_fileName);
-    if (!m_localFile->open(QFile::ReadOnly))
+    //The archive of "-tar" is streamed from the tree, as there is no such file on disk
+    if (!m_tarPath.isEmpty() && m_fileName == m_archiveFileName)
+      m_localFile = new TarArchive(m_tarPath, m_tarFilter, this);
+    else
+      m_localFile = new QFile(m_fileName);
+
+    if (!m_localFile->open(QIODevice::ReadOnly))
     {
       std::cout << std::endl << "ERROR: " << m_fileName.toLatin1().data() << " could not be opened" << std::endl;
       return false;
     }
+
+    QFile *file = qobject_cast<QFile *>(m_localFile);
+    if (m_noCache && file != nullptr) m_cacheDropper = new PageCacheDropper(file->handle(), 0, false);
   }
 
   return true;
 }
 
+/*
+ * When syncing, the header of the current file carries its mtime, so zorg saves it with the same one
+ * and can tell it is unchanged the next time
+ */
+FileHeader GorgZorg::withFileTime(FileHeader fileHeader) const
+{
+  if (m_sync && !m_sendingADir) fileHeader.mtime = QFileInfo(m_fileName).lastModified().toMSecsSinceEpoch();
+
+  return fileHeader;
+}
+
+/*
+ * When verifying, the header of the current file tells zorg which digest follows its body,
+ * and the body starts being hashed
+ */
+FileHeader GorgZorg::startDigest(FileHeader fileHeader)
+{
+  if (!m_verify || m_sendingADir) return fileHeader;
+
+  //xxh3 only if zorg said hello telling it can check it too
+  m_digest = new BodyDigest(BodyDigest::defaultType(m_zorgCapabilities & ctn_CAP_XXH3));
+  fileHeader.flags |= ctn_HEADER_DIGEST;
+  fileHeader.digest = m_digest->type();
+  return fileHeader;
+}
+
+/*
+ * Reads the next block of the current file body, hashing it when verifying
+ */
+QByteArray GorgZorg::readBody(qint64 maxSize)
+{
+  //Big files are read on their own thread, ahead of the socket
+  if (m_readAhead == nullptr && qobject_cast<QFile *>(m_localFile) != nullptr &&
+      m_localFile->size() - m_localFile->pos() >= ctn_READ_AHEAD_MIN_SIZE)
+  {
+    m_readAhead = new ReadAhead(m_localFile);
+    m_readAheadFiles++;
+  }
+
+  QByteArray block = m_readAhead != nullptr ? m_readAhead->read(maxSize) : m_localFile->read(maxSize);
+  if (m_digest != nullptr) m_digest->addData(block);
+  if (m_cacheDropper != nullptr) m_cacheDropper->advance(block.size());
+
+  return block;
+}
+
+/*
+ * Gives m_localFile back to us, counting how the read-ahead ring of the file did
+ */
+void GorgZorg::stopReadAhead()
+{
+  if (m_readAhead == nullptr) return;
+
+  m_readAhead->stop();
+  m_readAheadEmpty += m_readAhead->emptyWaits();
+  m_readAheadFull += m_readAhead->fullWaits();
+  delete m_readAhead;
+  m_readAhead = nullptr;
+}
+
+/*
+ * Drops what is left of the file being sent from the page cache, counting how much of it was kept out of there
+ */
+void GorgZorg::stopDroppingCache()
+{
+  if (m_cacheDropper == nullptr) return;
+
+  m_cacheDropper->finish();
+  m_cacheDropped += m_cacheDropper->dropped();
+  delete m_cacheDropper;
+  m_cacheDropper = nullptr;
+
+  if (m_verbose)
+  {
+    qint64 resident = PageCacheDropper::residentBytes(qobject_cast<QFile *>(m_localFile)->fileName());
+    if (resident > 0) m_cacheResident += resident;
+  }
+}
+
 /*
  * Transfers a single file when traversing a directory passed by command line
  */
 void GorgZorg::sendFile(const QString &filePath)
 {
+  qint64 zorged = m_zorgedFiles + 1;
+
   if (prepareToSendFile(filePath))
   {
     if (m_sendTimes == 0) // Only the first time it is sent, it happens when the connection generates the signal connect
     {
-      m_tcpClient->connectToHost(QHostAddress(m_targetAddress), m_port);
+      connectToZorg();
       m_sendTimes = 1;
     }
-    else
-    {
-      send(); // When sending for the first time, connectToHost initiates the connect signal to call send, and you need to call send after the second time
-    }
+
+    send();
   }
   else return;
 
   QEventLoop eventLoop;
   QObject::connect(this, &GorgZorg::endTransfer, &eventLoop, &QEventLoop::quit);
-  eventLoop.exec();
+  while (m_zorgedFiles < zorged) eventLoop.exec();
 }
 
 /*
- * Threaded methods to connect and send data to client
- *
- * It can send just one file or entire paths (with subpaths)
- * When sending paths, it can archive them with tar/gzip before sending
- *
- * connectAndSend is the main method called directly by the "-g" command line param
+ * Transfers a single file of a directory traverse without waiting for zorg to acknowledge it.
+ * Up to m_window files may be waiting for their Done/Error replies, which are consumed by readResponse
  */
-void GorgZorg::connectAndSend(const QString &targetAddress, const QString &pathToGorg)
+void GorgZorg::sendFilePipelined(const QString &filePath)
 {
-  m_targetAddress = targetAddress;
-  QFileInfo fi(pathToGorg);
-  bool asterisk = false;
-  QString realPath;
-  QString filter;
+  //Packed files go before us
+  flushPack();
+  waitForWindow();
 
-  if (pathToGorg.contains(QRegularExpression("\\*\\.*")))
+  if (!prepareToSendFile(filePath)) return;
+
+  send();
+  m_inFlight.enqueue(m_fileName);
+
+  if (m_sendingADir || sendFileZeroCopy()) return;
+
+  while (true)
   {
-    asterisk = true;
-    int cutName=pathToGorg.size()-pathToGorg.lastIndexOf(QDir::separator())-1;
-    filter = pathToGorg.right(cutName);
-    realPath = pathToGorg.left(pathToGorg.size()-cutName);
+    m_outBlock = readBody(m_loadSize);
+    if (m_outBlock.isEmpty()) break;
+
+    m_tcpClient->write(m_outBlock);
+    tune(m_outBlock.size());
+
+    //Do not let the socket buffer grow without limits
+    if (m_tcpClient->bytesToWrite() > ctn_PIPELINE_BUFFER_SIZE)
+      m_tcpClient->waitForBytesWritten(-1);
+  }
+
+  finishSendingFile();
+}
+
+/*
+ * Adds the header and body of a small file (or the header of a dir) of a directory traverse to m_pack, so many
+ * of them reach the socket in a single writev instead of a few writes each. Like pipelined files, up to m_window
+ * of them may be waiting for their Done/Error replies
+ */
+void GorgZorg::sendFilePacked(const QString &filePath)
+{
+  waitForWindow();
+
+  if (!prepareToSendFile(filePath)) return;
+
+  m_stats.enter(Phase::Body);
+  m_currentFileName = m_fileName;
+  m_totalSize = m_sendingADir ? 0 : m_localFile->size();
+
+  showGorging();
+
+  m_pack.append(header(startDigest(withFileTime(FileHeader(m_currentFileName, m_totalSize, ctn_HEADER_SINGLE_TRANSFER)))));
+  m_packBytes += m_pack.last().size();
+
+  for (qint64 left = m_totalSize; left > 0;)
+  {
+    QByteArray block = readBody(left);
+    if (block.isEmpty()) break;
+
+    left -= block.size();
+    m_packBytes += block.size();
+    m_pack.append(block);
+  }
+
+  //The digest trailer follows the body inside the pack
+  if (m_digest != nullptr)
+  {
+    m_pack.append(m_digest->result());
+    m_packBytes += m_pack.last().size();
+    delete m_digest;
+    m_digest = nullptr;
+  }
+
+  m_inFlight.enqueue(m_fileName);
+  m_byteToWrite = 0;
+  finishSendingFile();
+
+  if (m_packBytes >= m_packSize) flushPack();
+}
+
+/*
+ * Waits until less than m_window pipelined files are waiting for zorg replies (waitForReadyRead also flushes
+ * what we wrote)
+ */
+void GorgZorg::waitForWindow()
+{
+  if (m_inFlight.size() < m_window) return;
+
+  //Zorg can not reply to what is still packed
+  flushPack();
+  m_stats.enter(Phase::AckWait);
+
+  while (m_inFlight.size() >= m_window)
+  {
+    if (!m_tcpClient->waitForReadyRead(-1))
+    {
+      std::cout << std::endl << "ERROR: Connection to zorg was lost!" << std::endl;
+      exit(1);
+    }
+  }
+}
+
+/*
+ * Sends the headers and bodies packed in m_pack. On Linux they go straight from m_pack to the socket with
+ * writev(2), after Qt has flushed its own buffer, so they are neither copied into it nor written one by one
+ */
+void GorgZorg::flushPack()
+{
+  if (m_pack.isEmpty()) return;
+
+  m_totalSent += m_packBytes;
+  tune(m_packBytes);
+
+#ifdef Q_OS_LINUX
+  while (m_tcpClient->bytesToWrite() > 0)
+  {
+    if (!m_tcpClient->waitForBytesWritten(-1)) break;
+  }
+
+  int sock = int(m_tcpClient->socketDescriptor());
+  QVector<struct iovec> iov(m_pack.size());
+  for (int i=0; i<m_pack.size(); ++i)
+  {
+    iov[i].iov_base = const_cast<char *>(m_pack.at(i).constData());
+    iov[i].iov_len = size_t(m_pack.at(i).size());
+  }
+
+  int first = 0;
+  while (first < iov.size())
+  {
+    ssize_t sent = ::writev(sock, iov.data() + first, qMin(iov.size() - first, IOV_MAX));
+
+    if (sent > 0)
+    {
+      if (m_progress != nullptr) m_progress->addBytes(sent);
+
+      //Skip what went out, which may end in the middle of a buffer
+      while (first < iov.size() && sent >= ssize_t(iov[first].iov_len))
+        sent -= ssize_t(iov[first++].iov_len);
+
+      if (sent > 0)
+      {
+        iov[first].iov_base = static_cast<char *>(iov[first].iov_base) + sent;
+        iov[first].iov_len -= size_t(sent);
+      }
+    }
+    else if (sent < 0 && errno == EINTR)
+    {
+      continue;
+    }
+    else if (sent < 0 && errno == EAGAIN) //The socket is non-blocking, so let's wait until it drains
+    {
+      struct pollfd pfd;
+      pfd.fd = sock;
+      pfd.events = POLLOUT;
+      pfd.revents = 0;
+      ::poll(&pfd, 1, -1);
+    }
+    else
+    {
+      std::cout << std::endl << "ERROR: Connection to zorg was lost!" << std::endl;
+      exit(1);
+    }
+  }
+#else
+  QByteArray out;
+  out.reserve(int(m_packBytes));
+  for (const QByteArray &piece: m_pack) out += piece;
+  m_tcpClient->write(out);
+#endif
+
+  m_pack.clear();
+  m_packBytes = 0;
+}
+
+/*
+ * Threaded methods to connect and send data to client
+ *
+ * It can send just one file or entire paths (with subpaths)
+ * When sending paths, it can archive them with tar/gzip before sending
+ *
+ * connectAndSend is the main method called directly by the "-g" command line param
+ */
+void GorgZorg::connectAndSend(const QString &targetAddress, const QString &pathToGorg)
+{
+  m_targetAddress = targetAddress;
+
+  //Compressed, striped, delta and chunked bodies are not gorged as they are, so they carry no digest
+  if (m_verify && (m_zipContents || m_streams > 1 || m_delta || m_dedup))
+  {
+    std::cout << std::endl << "ERROR: \"-verify\" can not be used with \"-zip\", \"-streams\", \"-delta\" or \"-dedup\"" << std::endl;
+    exit(1);
+  }
+
+  m_stats.start();
+
+  //Everything written to the main connection is counted on the status line (sendfile and stripes count their own)
+  if (m_verbose)
+  {
+    m_progress = new ProgressReporter(QLatin1String("Gorged"));
+    QObject::connect(m_tcpClient, &QTcpSocket::bytesWritten, this, [this](qint64 bytes) { if (m_progress != nullptr) m_progress->addBytes(bytes); });
+    m_progress->start();
+  }
+
+  QFileInfo fi(pathToGorg);
+  bool asterisk = false;
+  QString realPath;
+  QString filter;
+
+  if (pathToGorg.contains(QRegularExpression("\\*\\.*")))
+  {
+    asterisk = true;
+    int cutName=pathToGorg.size()-pathToGorg.lastIndexOf(QDir::separator())-1;
+    filter = pathToGorg.right(cutName);
+    realPath = pathToGorg.left(pathToGorg.size()-cutName);
 
 #ifdef Q_OS_WIN
     filter.remove(QChar('\''));
@@ -476,12 +953,25 @@ void GorgZorg::connectAndSend(const QString &targetAddress, const QString &pathT
       m_archiveFileName = createArchive(pathToGorg);            
       if (m_verbose) m_elapsedTime->start();
 
-      sendFileHeader(m_archiveFileName);
+      if (m_zipContents)
+        sendFileCompressed(m_archiveFileName);
+      else if (m_streams > 1)
+        sendFileStriped(m_archiveFileName);
+      else
+        sendFileHeader(m_archiveFileName);
     }
     else
     {
       if (m_verbose) m_elapsedTime->start();
-      sendFileHeader(pathToGorg);
+
+      if (m_delta)
+        sendFileDelta(pathToGorg);
+      else if (m_dedup)
+        sendFileDedup(pathToGorg);
+      else if (m_streams > 1)
+        sendFileStriped(pathToGorg);
+      else
+        sendFileHeader(pathToGorg);
     }
   }
   else
@@ -491,7 +981,13 @@ void GorgZorg::connectAndSend(const QString &targetAddress, const QString &pathT
       {
         m_archiveFileName = createArchive(pathToGorg);
         if (m_verbose) m_elapsedTime->start();
-        sendFileHeader(m_archiveFileName);
+
+        if (m_zipContents)
+          sendFileCompressed(m_archiveFileName);
+        else if (m_streams > 1)
+          sendFileStriped(m_archiveFileName);
+        else
+          sendFileHeader(m_archiveFileName);
       }
     }
     else
@@ -503,32 +999,89 @@ void GorgZorg::connectAndSend(const QString &targetAddress, const QString &pathT
       else
         sendDirHeader(pathToGorg);
 
-      QDirIterator *it;
+      QDir rootDir(asterisk ? realPath : pathToGorg);
+      QStringList nameFilters;
+      qint64 unchanged = 0;
 
-      //Loop thru the dirs/files on pathToGorg
       if (asterisk) //If user passed some name filter path (ex: *.mp3)
-      {
-        QStringList nameFilters;
         nameFilters << filter;
-        it = new QDirIterator(realPath, nameFilters, QDir::AllEntries | QDir::Hidden | QDir::System, QDirIterator::Subdirectories);
-      }
-      else
-        it = new QDirIterator(pathToGorg, QDir::AllEntries | QDir::Hidden | QDir::System, QDirIterator::Subdirectories);
 
-      while (it->hasNext())
+      //Loop thru the dirs/files on pathToGorg, which other threads scan while we send them
+      TreeWalker walker(rootDir.path(), nameFilters, m_threads, m_ordered);
+      WalkEntry entry;
+
+      //Packed files are pipelined
+      if (m_packFileSize > 0 && m_window == 0) m_window = ctn_PACK_WINDOW;
+
+      //When pipelining (or deduplicating), files are streamed by their own methods instead of goOnSend
+      if (m_window > 0 || m_dedup)
+        QObject::disconnect(m_tcpClient, &QTcpSocket::bytesWritten, this, &GorgZorg::goOnSend);
+
+      m_stats.enter(Phase::Scan);
+
+      while (walker.next(entry))
       {
-        QString traverse = it->next();
-        if (traverse.endsWith(QLatin1String(".")) || traverse.endsWith(QLatin1String(".."))) continue;
+        QString traverse = entry.path;
+
+        //Zorg told us it already has this one
+        if (m_sync && SyncManifest::isUnchanged(m_manifest, rootDir.relativeFilePath(traverse), entry.isDir,
+                                                entry.size, entry.mtime))
+        {
+          unchanged++;
+          continue;
+        }
+
+        m_stats.enter(Phase::Body);
 
-        if (it->fileInfo().isDir())
+        if (entry.isDir)
           traverse = ctn_DIR_ESCAPE + traverse;
 
-        sendFile(traverse);
+        if (m_dedup && !entry.isDir)
+          sendFileDedup(traverse);
+        else if (m_packFileSize > 0 && (entry.isDir || entry.size < m_packFileSize))
+          sendFilePacked(traverse);
+        else if (m_window > 0)
+          sendFilePipelined(traverse);
+        else
+          sendFile(traverse);
+
+        m_stats.enter(Phase::Scan);
+      }
+
+      //Let's wait for the acknowledgement of every pipelined file
+      flushPack();
+      m_stats.enter(Phase::AckWait);
+
+      while (!m_inFlight.isEmpty())
+      {
+        if (!m_tcpClient->waitForReadyRead(-1))
+        {
+          std::cout << std::endl << "ERROR: Connection to zorg was lost!" << std::endl;
+          exit(1);
+        }
+      }
+
+      if (m_sync)
+      {
+        std::cout << std::endl << "Entries already zorged: " << QString::number(unchanged).toLatin1().data() << std::endl;
       }
     }
   }
 
   sendEndOfTransfer();
+  m_stats.addBytes(m_totalSent);
+  delete m_progress;
+  m_progress = nullptr;
+
+  if (!m_statsFile.isEmpty())
+  {
+    QJsonObject report = m_stats.toJson();
+    report.insert(QLatin1String("side"), QLatin1String("gorg"));
+    report.insert(QLatin1String("version"), ctn_VERSION);
+
+    if (!TransferStats::write(m_statsFile, report))
+      std::cout << std::endl << "WARNING: Statistics could not be written to " << m_statsFile.toLatin1().data() << std::endl;
+  }
 
   //Let's print some statistics if verbose is on
   if (m_verbose)
@@ -544,9 +1097,22 @@ void GorgZorg::connectAndSend(const QString &targetAddress, const QString &pathT
     std::cout << std::endl << "Time elapsed: " << strDuration.toLatin1().data() << "s" << std::endl;
     std::cout << "Bytes sent: " << strBytesSent.toLatin1().data() << " MB" << std::endl;
     std::cout << "Speed: " << strSpeed.toLatin1().data() << " MB/s" << std::endl;
+
+    if (m_readAheadFiles > 0)
+    {
+      std::cout << "Files read ahead: " << QString::number(m_readAheadFiles).toLatin1().data() << " (ring ran empty " <<
+                   QString::number(m_readAheadEmpty).toLatin1().data() << " times, full " <<
+                   QString::number(m_readAheadFull).toLatin1().data() << " times)" << std::endl;
+    }
+
+    if (m_noCache)
+    {
+      std::cout << "Page cache: " << QString::number((m_cacheDropped / 1024.0) / 1024.0, 'f', 2).toLatin1().data() <<
+                   " MB dropped behind reads, " << QString::number((m_cacheResident / 1024.0) / 1024.0, 'f', 2).toLatin1().data() <<
+                   " MB left resident" << std::endl;
+    }
   }
 
-  removeArchive();
   std::cout << std::endl;
   exit(0);
 }
@@ -556,6 +1122,7 @@ void GorgZorg::connectAndSend(const QString &targetAddress, const QString &pathT
  */
 void GorgZorg::sendEndOfTransfer()
 {
+  m_stats.enter(Phase::EndOfTransfer);
   QObject::disconnect(m_tcpClient, &QTcpSocket::bytesWritten, this, &GorgZorg::goOnSend);
 
   //Tests if client is connected before going on
@@ -567,21 +1134,11 @@ void GorgZorg::sendEndOfTransfer()
   m_loadSize = m_block * 1024; // The size of data sent each time
   m_byteToWrite = 0;
   m_totalSize = 0;
-  m_totalSent += m_totalSize;
 
-  QDataStream out(&m_outBlock, QIODevice::WriteOnly);
-  m_currentFileName = ctn_END_OF_TRANSFER;
   std::cout << std::endl << "Gorging goodbye..." << std::endl;
-
-  out << qint64(0) << qint64(0) << m_currentFileName << true;
-
-  m_totalSize += m_outBlock.size(); // The total size is the file size plus the size of the file name and other information
-  m_byteToWrite += m_outBlock.size();
+  m_outBlock = Protocol::message(MessageType::Goodbye, m_sequence);
   m_totalSent += m_outBlock.size();
 
-  out.device()->seek(0); // Go back to the beginning of the byte stream to write a qint64 in front, which is the total size and file name and other information size
-  out << m_totalSize << qint64(m_outBlock.size());
-
   m_tcpClient->write(m_outBlock); // Send the read file to the socket
   m_tcpClient->waitForBytesWritten(-1);
 }
@@ -591,18 +1148,12 @@ void GorgZorg::sendEndOfTransfer()
  */
 void GorgZorg::sendFileHeader(const QString &filePath)
 {
+  qint64 accepted = m_acceptedFiles + 1;
+  qint64 zorged = m_zorgedFiles + 1;
+
   if (prepareToSendFile(filePath))
   {
-    m_tcpClient->connectToHost(QHostAddress(m_targetAddress), m_port);
-    m_tcpClient->waitForConnected(-1);
-
-    if (m_tcpClient->state() == QAbstractSocket::UnconnectedState)
-    {
-      std::cout << std::endl << "ERROR: It seems there is no one zorging on " <<
-                   m_targetAddress.toLatin1().data() << ":" << QString::number(m_port).toLatin1().data() << std::endl;
-      removeArchive();
-      exit(1);
-    }
+    connectToZorg();
 
     m_loadSize = m_block * 1024; // The size of data sent each time
 
@@ -615,10 +1166,8 @@ void GorgZorg::sendFileHeader(const QString &filePath)
     {
       m_byteToWrite = m_localFile->size(); //The size of the remaining data
       m_totalSize = m_localFile->size();
-      m_totalSent += m_totalSize;
     }
 
-    QDataStream out(&m_outBlock, QIODevice::WriteOnly);
     m_currentFileName = m_fileName;
 
     if (m_sendingADir)
@@ -631,632 +1180,755 @@ void GorgZorg::sendFileHeader(const QString &filePath)
       std::cout << std::endl << "Gorging header of " << m_currentFileName.toLatin1().data() << std::endl;
     }
 
-    out << qint64(0) << qint64(0) << m_currentFileName << false;
+    //Zorg may answer a resumable file with the size of a partial copy it already has
+    if (m_resume && !m_sendingADir)
+      m_outBlock = header(startDigest(FileHeader(m_currentFileName, m_totalSize, ctn_HEADER_RESUME)));
+    else
+      m_outBlock = header(startDigest(FileHeader(m_currentFileName, m_totalSize)));
 
-    m_totalSize += m_outBlock.size(); // The total size is the file size plus the size of the file name and other information
+    m_totalSize += m_outBlock.size(); // The total size is the file size plus the size of the header
     m_byteToWrite += m_outBlock.size();
     m_totalSent += m_outBlock.size();
 
-    out.device()->seek(0); // Go back to the beginning of the byte stream to write a qint64 in front, which is the total size and file name and other information size
-    out << m_totalSize << qint64(m_outBlock.size());
-
     m_tcpClient->write(m_outBlock); // Send the read file to the socket
     m_tcpClient->waitForBytesWritten(-1);
 
     QObject::connect(m_tcpClient, &QTcpSocket::bytesWritten, this, &GorgZorg::goOnSend);
 
     //Wait until server accepts the sending...
+    m_resumeOffered = false;
     QEventLoop eventLoop;
     QObject::connect(this, &GorgZorg::okSend, &eventLoop, &QEventLoop::quit);
-    eventLoop.exec();
+    m_stats.enter(Phase::AckWait);
+    while (m_acceptedFiles < accepted) eventLoop.exec();
 
     m_outBlock.clear();
-    m_totalSent = 0;
+    if (m_resumeOffered) resumeSending();
     sendFileBody();
 
     QObject::disconnect(this, &GorgZorg::okSend, &eventLoop, &QEventLoop::quit);
     QObject::connect(this, &GorgZorg::endTransfer, &eventLoop, &QEventLoop::quit);
-    eventLoop.exec();
+    while (m_zorgedFiles < zorged) eventLoop.exec();
   }
 }
 
 /*
- * Sends directory header information, so the server can opt to accept or deny transfer
+ * Zorg offered a partial copy of the current file. If the end of its prefix matches ours, let's seek there,
+ * otherwise the whole file is sent again. Either way, zorg is told the offset the body starts at
  */
-void GorgZorg::sendDirHeader(const QString &filePath)
+void GorgZorg::resumeSending()
 {
-  m_fileName = filePath;
-  m_outBlock.clear();
-  m_sendingADir = true;
-  m_localFile = new QFile(m_fileName);
-  m_tcpClient->connectToHost(QHostAddress(m_targetAddress), m_port);
-  m_tcpClient->waitForConnected(-1);
+  qint64 offset = 0;
+  m_resumeOffered = false;
 
-  if (m_tcpClient->state() == QAbstractSocket::UnconnectedState)
+  if (prefixChecksum(m_localFile, m_resumeOffset) == m_resumeChecksum)
   {
-    std::cout << std::endl << "ERROR: It seems there is no one zorging on " <<
-                 m_targetAddress.toLatin1().data() << ":" << QString::number(m_port).toLatin1().data() << std::endl;
-    removeArchive();
-    exit(1);
+    offset = m_resumeOffset;
+    std::cout << std::endl << "Resuming " << m_currentFileName.toLatin1().data() << " at byte " <<
+                 QString::number(offset).toLatin1().data() << std::endl;
+  }
+  else
+  {
+    std::cout << std::endl << "Partial copy of " << m_currentFileName.toLatin1().data() <<
+                 " does not match, gorging it from the start" << std::endl;
   }
 
-  m_loadSize = m_block * 1024; // The size of data sent each time
-  m_byteToWrite = 0;
-  m_totalSize = 0;
-
-  QDataStream out(&m_outBlock, QIODevice::WriteOnly);
-  m_currentFileName = m_fileName;
-
-  QString aux = QString("Gorging header of dir %1").arg(m_currentFileName);
-  std::cout << std::endl << aux.remove(ctn_DIR_ESCAPE).toLatin1().data() << std::endl;
-
-  /* This is the beggining of a directory traverse send, so let's put 'false' in the last value (m_singleTransfer)
-     of the header so GorgZorg can read it as "This is not a single transfer!" */
-  out << qint64 (0) << qint64 (0) << m_currentFileName + QDir::separator() + QLatin1String(".") << false;
-
-  m_totalSize += m_outBlock.size(); // The total size is the file size plus the size of the file name and other information
-  m_byteToWrite += m_outBlock.size();
-  m_totalSent += m_outBlock.size();
+  m_localFile->seek(offset);
 
-  out.device()->seek(0); // Go back to the beginning of the byte stream to write a qint64 in front, which is the total size and file name and other information size
-  out << m_totalSize << qint64(m_outBlock.size());
+  QByteArray reply(8, '\0');
+  qToBigEndian<qint64>(offset, reinterpret_cast<uchar*>(reply.data()));
 
-  m_tcpClient->write(m_outBlock); // Send the read file to the socket
+  //These bytes are not part of the body goOnSend counts
+  QObject::disconnect(m_tcpClient, &QTcpSocket::bytesWritten, this, &GorgZorg::goOnSend);
+  m_tcpClient->write(reply);
   m_tcpClient->waitForBytesWritten(-1);
-
-  QEventLoop eventLoop;
-  QObject::connect(this, &GorgZorg::cancelSend, &eventLoop, &QEventLoop::quit);
-  QObject::connect(this, &GorgZorg::okSend, &eventLoop, &QEventLoop::quit);
-  eventLoop.exec();
-
-  m_outBlock.clear();
-  m_totalSent = 0;
-  m_sendTimes = 1;
-  delete m_localFile;
-
-  QObject::connect(this, &GorgZorg::endTransfer, &eventLoop, &QEventLoop::quit);
-  eventLoop.exec();
   QObject::connect(m_tcpClient, &QTcpSocket::bytesWritten, this, &GorgZorg::goOnSend);
 }
 
 /*
- * Sends file contents (called by sendFileHeader). It starts the real file sending...
+ * Splits a single large file in m_streams byte ranges and sends each one through its own connection.
+ * The main connection carries a header with the file size, so zorg can preallocate it, and gets the
+ * final Done reply only after every range has been written
  */
-void GorgZorg::sendFileBody()
+void GorgZorg::sendFileStriped(const QString &filePath)
 {
+  qint64 accepted = m_acceptedFiles + 1;
+  qint64 zorged = m_zorgedFiles + 1;
+
+  if (!prepareToSendFile(filePath)) return;
+
   m_loadSize = m_block * 1024; // The size of data sent each time
+  qint64 size = m_localFile->size();
 
-  if (m_sendingADir)
+  //Not worth opening more connections for a file this small (or for a tar archive, which is not on disk).
+  //Resumable files also go through a single connection
+  if (m_resume || size < m_streams * m_loadSize || qobject_cast<QFile *>(m_localFile) == nullptr)
   {
-    m_byteToWrite = 0;
-    m_totalSize = 0;
+    m_localFile->close();
+    sendFileHeader(filePath);
+    return;
   }
-  else
+
+  connectToZorg();
+
+  m_currentFileName = m_fileName;
+  std::cout << std::endl << "Gorging header of " << m_currentFileName.toLatin1().data() << std::endl;
+  if (m_progress != nullptr) m_progress->expect(size);
+
+  FileHeader fileHeader(m_fileName, 0, 0, BodyMode::Striped);
+  fileHeader.fileSize = size;
+  m_outBlock = header(fileHeader);
+  m_totalSent += m_outBlock.size();
+  m_tcpClient->write(m_outBlock);
+  m_tcpClient->waitForBytesWritten(-1);
+  m_outBlock.clear();
+
+  //Wait until server accepts the sending...
+  QEventLoop eventLoop;
+  QObject::connect(this, &GorgZorg::okSend, &eventLoop, &QEventLoop::quit);
+  QObject::connect(this, &GorgZorg::endTransfer, &eventLoop, &QEventLoop::quit);
+  m_stats.enter(Phase::AckWait);
+  while (m_acceptedFiles < accepted) eventLoop.exec();
+
+  //Zorg gives no id to a file it could not make room for, and follows its accept with an error
+  if (m_transferId == 0)
   {
-    m_byteToWrite = m_localFile->size(); //The size of the remaining data
-    m_totalSize = m_localFile->size();
-    m_totalSent += m_totalSize;
+    m_localFile->close();
+    while (m_zorgedFiles < zorged) eventLoop.exec();
+    return;
   }
 
-  QDataStream out(&m_outBlock, QIODevice::WriteOnly);
-  m_currentFileName = m_fileName;
+  std::cout << std::endl << "Gorging " << m_currentFileName.toLatin1().data() << " using " <<
+               QString::number(m_streams).toLatin1().data() << " streams" << std::endl;
 
-  if (m_sendingADir)
+  qint64 stripeSize = (size + m_streams - 1) / m_streams;
+  std::vector<std::thread> threads;
+  std::vector<char> results(size_t(m_streams), 0);
+
+  for (int i=0; i<m_streams; ++i)
   {
-    QString aux = QString("Gorging dir %1").arg(m_currentFileName);
-    std::cout << std::endl << aux.remove(ctn_DIR_ESCAPE).toLatin1().data() << std::endl;
+    qint64 offset = i * stripeSize;
+    qint64 length = qMin(stripeSize, size - offset);
+    if (length <= 0) break;
+
+    results[size_t(i)] = 1;
+    threads.emplace_back([this, &results, i, offset, length]() {
+      results[size_t(i)] = gorgStripe(m_targetAddress, m_port, m_fileName, m_transferId, offset, length, m_loadSize,
+                                      m_progress);
+    });
   }
-  else
+
+  for (auto &t: threads)
+    t.join();
+
+  for (int i=0; i<m_streams; ++i)
   {
-    std::cout << std::endl << "Gorging " << m_currentFileName.toLatin1().data() << std::endl;
+    if (!results[size_t(i)])
+    {
+      std::cout << std::endl << "ERROR: Stream " << QString::number(i+1).toLatin1().data() << " of " <<
+                   m_currentFileName.toLatin1().data() << " could not be gorged!" << std::endl;
+      exit(1);
+    }
   }
 
-  m_byteToWrite += m_outBlock.size();
-  m_totalSent += m_outBlock.size();
-  m_outBlock = m_localFile->read(qMin(m_byteToWrite, m_loadSize));
-  m_tcpClient->write(m_outBlock); // Send the read file to the socket
+  m_totalSent += size;
+  finishSendingFile();
+
+  //Zorg replies when the whole file is on its disk
+  while (m_zorgedFiles < zorged) eventLoop.exec();
 }
 
 /*
- * Sends header information of the file that belongs to the path we are traversing
+ * Compresses a file (usually a tar archive) while it is being sent. Blocks are compressed by m_threads threads
+ * and gorged in order as frames, since the compressed size is only known at the end. The header carries the codec
+ * name and the raw size, so zorg knows how to decompress what arrives
  */
-void GorgZorg::send()
+void GorgZorg::sendFileCompressed(const QString &filePath)
 {
-  m_loadSize = m_block * 1024; // The size of data sent each time
+  qint64 accepted = m_acceptedFiles + 1;
+  qint64 zorged = m_zorgedFiles + 1;
 
-  if (m_sendingADir)
-  {
-    m_byteToWrite = 0;
-    m_totalSize = 0;
-  }
-  else
+  if (!prepareToSendFile(filePath)) return;
+
+  connectToZorg();
+
+  //Fall back to a codec zorg can decompress
+  if ((m_codec == Codec::Zstd && !(m_zorgCapabilities & ctn_CAP_ZSTD)) ||
+      (m_codec == Codec::Lz4 && !(m_zorgCapabilities & ctn_CAP_LZ4)))
   {
-    m_byteToWrite = m_localFile->size(); //The size of the remaining data
-    m_totalSize = m_localFile->size();
-    m_totalSent += m_totalSize;
+    Codec codec = Codec::Zlib;
+    if (m_codec != Codec::Lz4 && StreamCompressor::isAvailable(Codec::Lz4) && (m_zorgCapabilities & ctn_CAP_LZ4))
+      codec = Codec::Lz4;
+
+    std::cout << "WARNING: Zorg can not decompress " << StreamCompressor::codecName(m_codec).toLatin1().data() <<
+                 " streams, using " << StreamCompressor::codecName(codec).toLatin1().data() << std::endl;
+    m_codec = codec;
   }
 
-  QDataStream out(&m_outBlock, QIODevice::WriteOnly);
+  qint64 size = m_localFile->size();
   m_currentFileName = m_fileName;
+  std::cout << std::endl << "Gorging header of " << m_currentFileName.toLatin1().data() << std::endl;
 
-  if (m_sendingADir)
-  {
-    QString aux = QString("Gorging dir %1").arg(m_currentFileName);
-    std::cout << std::endl << aux.remove(ctn_DIR_ESCAPE).toLatin1().data() << std::endl;
-  }
-  else
+  FileHeader fileHeader(m_fileName, 0, 0, BodyMode::Compressed);
+  fileHeader.codec = m_codec;
+  fileHeader.fileSize = size;
+  m_outBlock = header(fileHeader);
+  m_totalSent += m_outBlock.size();
+  m_tcpClient->write(m_outBlock);
+  m_tcpClient->waitForBytesWritten(-1);
+  m_outBlock.clear();
+
+  //Wait until server accepts the sending...
+  QEventLoop eventLoop;
+  QObject::connect(this, &GorgZorg::okSend, &eventLoop, &QEventLoop::quit);
+  QObject::connect(this, &GorgZorg::endTransfer, &eventLoop, &QEventLoop::quit);
+  m_stats.enter(Phase::AckWait);
+  while (m_acceptedFiles < accepted) eventLoop.exec();
+
+  StreamCompressor compressor(m_codec, m_level, m_threads);
+  TarArchive *archive = qobject_cast<TarArchive *>(m_localFile);
+  qint64 compressedSize = 0;
+  bool atEnd = false;
+
+  while (true)
   {
-    std::cout << std::endl << "Gorging " << m_currentFileName.toLatin1().data() << std::endl;
+    //Keep every compression thread busy while the oldest block is being sent
+    while (!atEnd && compressor.pending() < compressor.threads() * 2)
+    {
+      //Each archived file is sampled on its own, so incompressible ones are sent raw
+      int group = archive ? archive->entryAt(m_localFile->pos()) : 0;
+      QByteArray raw = m_localFile->read(ctn_COMPRESSION_BLOCK_SIZE);
+      if (m_cacheDropper != nullptr) m_cacheDropper->advance(raw.size());
+
+      if (raw.isEmpty())
+        atEnd = true;
+      else
+        compressor.submit(raw, group);
+    }
+
+    if (compressor.pending() == 0) break;
+
+    QByteArray frame = compressor.takeFrame();
+    compressedSize += frame.size();
+    m_tcpClient->write(frame);
+
+    if (m_tcpClient->bytesToWrite() > ctn_PIPELINE_BUFFER_SIZE)
+    {
+      if (!m_tcpClient->waitForBytesWritten(-1))
+      {
+        std::cout << std::endl << "ERROR: Connection to zorg was lost!" << std::endl;
+        exit(1);
+      }
+    }
   }
 
-  out << qint64(0) << qint64(0) << m_currentFileName << true;
-  m_totalSize += m_outBlock.size(); // The total size is the file size plus the size of the file name and other information
-  m_byteToWrite += m_outBlock.size();
-  m_totalSent += m_outBlock.size();
+  m_tcpClient->write(StreamCompressor::endFrame());
+  compressedSize += ctn_FRAME_HEADER_SIZE;
+  m_totalSent += compressedSize;
 
-  out.device()->seek(0); // Go back to the beginning of the byte stream to write a qint64 in front, which is the total size and file name and other information size
-  out << m_totalSize << qint64(m_outBlock.size());
+  if (m_verbose && compressor.rawBytes() > 0)
+  {
+    std::cout << std::endl << "Compressed " << QString::number(compressor.rawBytes()).toLatin1().data() << " bytes to " <<
+                 QString::number(compressedSize).toLatin1().data() << " (ratio " <<
+                 QString::number(double(compressor.rawBytes()) / compressedSize, 'f', 2).toLatin1().data() << ")" << std::endl;
+    std::cout << "Skipped compression: " << QString::number(compressor.skippedBytes()).toLatin1().data() <<
+                 " bytes of incompressible files" << std::endl;
+  }
 
-  m_tcpClient->write(m_outBlock); // Send the read file to the socket
+  finishSendingFile();
+
+  //Zorg replies when the whole file is decompressed on its disk
+  while (m_zorgedFiles < zorged) eventLoop.exec();
 }
 
 /*
- * This is the slot that is called multiple times by all sending methods until the file is completly sent to the server
+ * Sends a file as a delta of the copy zorg already has. Zorg answers the header with the signature of its copy
+ * and we send only literal data plus references to its blocks. Zorg rebuilds the file aside and swaps it in
+ * when the digest of the whole file matches
  */
-void GorgZorg::goOnSend(qint64 numBytes) // Start sending file content
+void GorgZorg::sendFileDelta(const QString &filePath)
 {
-  m_byteToWrite -= numBytes; // Remaining data size
+  qint64 accepted = m_acceptedFiles + 1;
+  qint64 zorged = m_zorgedFiles + 1;
 
-  if (m_sendingADir)
-  {
-    m_outBlock.resize(0);
-    m_tcpClient->write(m_outBlock);
-  }
-  else
-  {
-    m_outBlock = m_localFile->read(qMin(m_byteToWrite, m_loadSize));
-    m_tcpClient->write(m_outBlock);
-  }
+  if (!prepareToSendFile(filePath)) return;
 
-  //ui-> sendProgressBar->setMaximum(totalSize);
-  //ui-> sendProgressBar->setValue(totalSize-byteToWrite);
+  connectToZorg();
 
-  if (m_byteToWrite == 0) // Send completed
-  {
-    //QTextStream qout(stdout);
-    std::cout << "Gorging completed" << std::endl;
+  qint64 size = m_localFile->size();
+  m_currentFileName = m_fileName;
+  std::cout << std::endl << "Gorging header of " << m_currentFileName.toLatin1().data() << std::endl;
+
+  FileHeader fileHeader(m_fileName, 0, 0, BodyMode::Delta);
+  fileHeader.fileSize = size;
+  m_outBlock = header(fileHeader);
+  m_totalSent += m_outBlock.size();
+  m_tcpClient->write(m_outBlock);
+  m_tcpClient->waitForBytesWritten(-1);
+  m_outBlock.clear();
+
+  //Wait until server accepts the sending (and sends the signature of its copy)...
+  QEventLoop eventLoop;
+  QObject::connect(this, &GorgZorg::okSend, &eventLoop, &QEventLoop::quit);
+  QObject::connect(this, &GorgZorg::endTransfer, &eventLoop, &QEventLoop::quit);
+  m_stats.enter(Phase::AckWait);
+  while (m_acceptedFiles < accepted) eventLoop.exec();
 
-    //If we gorged a tared file, let's remove it!
-    if (m_tarContents)
-    {    
-      QString path = getWorkingDirectory();
+  std::cout << std::endl << "Gorging delta of " << m_currentFileName.toLatin1().data() << std::endl;
 
-      path.remove(QLatin1Char('\n'));
-      path += QDir::separator() + m_currentFileName;
+  DeltaEncoder encoder(m_deltaBlockSize, m_deltaSignature);
+  m_deltaSignature.clear();
 
-      if (path.endsWith(".tar")) QFile::remove(path);
-    }
+  encoder.encode(m_localFile, [this](const QByteArray &op) {
+    m_totalSent += op.size();
+    m_tcpClient->write(op);
 
-    if (!m_sendingADir)
+    if (m_tcpClient->bytesToWrite() > ctn_PIPELINE_BUFFER_SIZE && !m_tcpClient->waitForBytesWritten(-1))
     {
-      m_localFile->close();
+      std::cout << std::endl << "ERROR: Connection to zorg was lost!" << std::endl;
+      exit(1);
     }
+  });
+
+  if (m_verbose)
+  {
+    std::cout << std::endl << "Delta of " << QString::number(size).toLatin1().data() << " bytes: " <<
+                 QString::number(encoder.literalBytes()).toLatin1().data() << " literal, " <<
+                 QString::number(encoder.matchedBytes()).toLatin1().data() << " matched on zorg" << std::endl;
   }
-}
 
-/*
- *  SERVER SIDE PART *****************************************************************
- */
+  finishSendingFile();
+
+  //Zorg replies when the new file took the place of the old one
+  while (m_zorgedFiles < zorged) eventLoop.exec();
+}
 
 /*
- * Starts listening for file transfers on port m_port of the given ipAddress
+ * Sends a file as content-defined chunks. The header body is the list of chunk sizes and hashes, zorg answers
+ * with a bitmap of the chunks missing from its store and only those are sent, in order. Zorg builds the file
+ * from its store and what arrives
  */
-void GorgZorg::startServer(const QString &ipAddress)
+void GorgZorg::sendFileDedup(const QString &filePath)
 {
-  m_totalSize = 0;
-  m_byteReceived = 0;
-  m_server = new QTcpServer(this);
-  QString ip = ipAddress;
+  qint64 accepted = m_acceptedFiles + 1;
+  qint64 zorged = m_zorgedFiles + 1;
 
-  if (ip.isEmpty())
-  {
-    const QHostAddress &localhost = QHostAddress(QHostAddress::LocalHost);
-    for (auto &address: QNetworkInterface::allAddresses())
-    {
-      if (address.protocol() == QAbstractSocket::IPv4Protocol && address != localhost)
-      {
-        if (!isLocalIP(address.toString())) continue;
-        ip = address.toString();
-      }
-    }
-  }
+  //Packed files go before us
+  flushPack();
 
-  if (ip.isEmpty())
+  if (!prepareToSendFile(filePath)) return;
+
+  //Files of a directory traverse use the connection sendDirHeader opened
+  bool traversing = m_tcpClient->state() == QAbstractSocket::ConnectedState;
+
+  if (!traversing)
   {
-    std::cout << std::endl << "ERROR: No valid IP address could be found!" << std::endl;
-    exit(1);
+    connectToZorg();
   }
 
-  if (!m_server->listen(QHostAddress(ip), m_port))
+  m_currentFileName = m_fileName;
+  if (m_verbose) std::cout << std::endl << "Chunking " << m_currentFileName.toLatin1().data() << std::endl;
+
+  QVector<Chunk> chunks = Chunker::split(m_localFile);
+  QByteArray list(4, '\0');
+  qToBigEndian<quint32>(quint32(chunks.size()), reinterpret_cast<uchar*>(list.data()));
+  list.reserve(4 + chunks.size() * ctn_CHUNK_ENTRY_SIZE);
+
+  for (const Chunk &chunk: chunks)
   {
-    //If we could not bind to this port...
-    std::cout << "ERROR: " << ip.toLatin1().data() << " is unavailable or port " <<
-                 QString::number(m_port).toLatin1().data() << " is already being used in this host!" << std::endl;
-    exit(1);
+    char size[4];
+    qToBigEndian<quint32>(quint32(chunk.size), reinterpret_cast<uchar*>(size));
+    list.append(size, 4);
+    list.append(chunk.hash);
   }
 
-  //Let's change the received files directory if the user especified one...
-  if (!m_zorgPath.isEmpty())
+  if (m_verbose) std::cout << "Gorging header of " << m_currentFileName.toLatin1().data() << std::endl;
+
+  FileHeader fileHeader(m_fileName, list.size(), traversing ? ctn_HEADER_SINGLE_TRANSFER : 0, BodyMode::Dedup);
+  fileHeader.fileSize = m_localFile->size();
+  m_outBlock = header(withFileTime(fileHeader)) + list;
+  m_totalSent += m_outBlock.size();
+  m_tcpClient->write(m_outBlock);
+  m_tcpClient->waitForBytesWritten(-1);
+  m_outBlock.clear();
+
+  //Wait until server accepts the sending (and tells which chunks it needs)...
+  QEventLoop eventLoop;
+  QObject::connect(this, &GorgZorg::okSend, &eventLoop, &QEventLoop::quit);
+  QObject::connect(this, &GorgZorg::endTransfer, &eventLoop, &QEventLoop::quit);
+  m_stats.enter(Phase::AckWait);
+  while (m_acceptedFiles < accepted) eventLoop.exec();
+
+  qint64 neededBytes = 0;
+  int neededChunks = 0;
+
+  for (int i=0; i<chunks.size(); ++i)
   {
-    QDir::setCurrent(m_zorgPath);
+    if (i / 8 >= m_chunksNeeded.size() || (uchar(m_chunksNeeded.at(i / 8)) & (1 << (i % 8))) == 0) continue;
+
+    const Chunk &chunk = chunks.at(i);
+    m_localFile->seek(chunk.offset);
+    m_outBlock = m_localFile->read(chunk.size);
+
+    if (m_outBlock.size() != chunk.size)
+    {
+      std::cout << std::endl << "ERROR: " << m_currentFileName.toLatin1().data() << " changed while it was gorged!" << std::endl;
+      exit(1);
+    }
+
+    m_tcpClient->write(m_outBlock);
+    neededBytes += chunk.size;
+    neededChunks++;
+
+    if (m_tcpClient->bytesToWrite() > ctn_PIPELINE_BUFFER_SIZE && !m_tcpClient->waitForBytesWritten(-1))
+    {
+      std::cout << std::endl << "ERROR: Connection to zorg was lost!" << std::endl;
+      exit(1);
+    }
   }
 
-  QObject::connect(m_server, &QTcpServer::newConnection, this, &GorgZorg::acceptConnection);
+  m_outBlock.clear();
+  m_totalSent += neededBytes;
 
-  std::cout << "Start zorging on " << ip.toLatin1().data() << ":" << QString::number(m_port).toLatin1().data() << "..." << std::endl;
-}
+  if (m_verbose)
+  {
+    std::cout << std::endl << "Chunks gorged: " << QString::number(neededChunks).toLatin1().data() << " of " <<
+                 QString::number(chunks.size()).toLatin1().data() << " (" <<
+                 QString::number(neededBytes).toLatin1().data() << " of " <<
+                 QString::number(m_localFile->size()).toLatin1().data() << " bytes)" << std::endl;
+  }
 
-void GorgZorg::acceptConnection()
-{
-  std::cout << std::endl << "Connected, preparing to zorg files!" << std::endl;
+  finishSendingFile();
 
-  m_receivedSocket = m_server->nextPendingConnection();
-  QObject::connect(m_receivedSocket, &QTcpSocket::readyRead, this, &GorgZorg::readClient);
+  //Zorg replies when the file is built
+  while (m_zorgedFiles < zorged) eventLoop.exec();
 }
 
 /*
- * Whenever clients send bytes, readClient is called!
+ * Sends directory header information, so the server can opt to accept or deny transfer
  */
-void GorgZorg::readClient()
+void GorgZorg::sendDirHeader(const QString &filePath)
 {
-  if (m_byteReceived == 0) // just started to receive data, this data is file information
-  {
-    m_receivingADir = false;
-    m_createMasterDir = false;
+  qint64 accepted = m_acceptedFiles + 1;
+  qint64 zorged = m_zorgedFiles + 1;
 
-    //ui->receivedProgressBar->setValue(0);
-    QDataStream in(m_receivedSocket);
+  m_fileName = filePath;
+  m_outBlock.clear();
+  m_sendingADir = true;
+  m_localFile = new QFile(m_fileName);
+  connectToZorg();
 
-    in >> m_totalSize >> m_byteReceived >> m_fileName >> m_singleTransfer;
+  m_loadSize = m_block * 1024; // The size of data sent each time
+  m_byteToWrite = 0;
+  m_totalSize = 0;
 
-    if (m_fileName == ctn_END_OF_TRANSFER)
-    {
-      m_masterDir.clear();
-      m_byteReceived = 0;
-      m_totalSize = 0;
+  m_currentFileName = m_fileName;
 
-      //Client is saying goodbye...
-      std::cout << std::endl << "See you next time!" << std::endl << std::endl;
+  QString aux = QString("Gorging header of dir %1").arg(m_currentFileName);
+  std::cout << std::endl << aux.remove(ctn_DIR_ESCAPE).toLatin1().data() << std::endl;
 
-      if (m_quitServer)
-        exit(0);
-      else
-        return;
-    }
+  /* This is the beggining of a directory traverse send, so let's put 'false' in the last value (m_singleTransfer)
+     of the header so GorgZorg can read it as "This is not a single transfer!" */
+  m_outBlock = header(FileHeader(m_currentFileName + QDir::separator() + QLatin1String("."), 0,
+                                 m_sync ? ctn_HEADER_SYNC : 0));
 
-    double totalSize;
-    QString strTotalSize;
+  m_totalSize += m_outBlock.size(); // The total size is the size of the header
+  m_byteToWrite += m_outBlock.size();
+  m_totalSent += m_outBlock.size();
 
-    if (!m_alwaysAccept)
-    {
-      if (m_singleTransfer == false && m_askForAccept == false)
-      {
-        m_askForAccept = true;
-      }
-    }
+  m_tcpClient->write(m_outBlock); // Send the read file to the socket
+  m_tcpClient->waitForBytesWritten(-1);
 
-    //Check if we have to replace directory separators
-    QChar here = QDir::separator();
-    int i=m_fileName.indexOf(here);
+  QEventLoop eventLoop;
+  QObject::connect(this, &GorgZorg::cancelSend, &eventLoop, &QEventLoop::quit);
+  QObject::connect(this, &GorgZorg::okSend, &eventLoop, &QEventLoop::quit);
+  m_stats.enter(Phase::AckWait);
+  while (m_acceptedFiles < accepted) eventLoop.exec();
 
-    if (i == -1)
-    {
-      if (here == '/')
-      {
-        m_fileName.replace(QChar('\\'), QChar('/'));
-      }
-      else
-      {
-        m_fileName.replace(QChar('/'), QChar('\\'));
-      }
-    }
+  m_outBlock.clear();
+  m_sendTimes = 1;
+  delete m_localFile;
 
-#ifdef Q_OS_WIN
-    if (m_fileName.startsWith(QDir::separator()))
-    {
-      m_fileName.remove(0, 1);
-    }
-#endif
+  QObject::connect(this, &GorgZorg::endTransfer, &eventLoop, &QEventLoop::quit);
+  while (m_zorgedFiles < zorged) eventLoop.exec();
+  QObject::connect(m_tcpClient, &QTcpSocket::bytesWritten, this, &GorgZorg::goOnSend);
+}
 
-    //qout << Qt::endl << QLatin1String("Received: %1").arg(m_fileName) << Qt::endl;
-    int cutName=m_fileName.size()-m_fileName.lastIndexOf(QDir::separator())-1;
-    m_currentFileName = m_fileName.right(cutName);
+/*
+ * Sends file contents (called by sendFileHeader). It starts the real file sending...
+ */
+void GorgZorg::sendFileBody()
+{
+  m_stats.enter(Phase::Body);
+  m_loadSize = m_block * 1024; // The size of data sent each time
 
-    if (m_currentFileName == ".")
-    {
-      m_currentPath = m_fileName.remove(QString(QDir::separator())+QLatin1String("."));
-      m_currentFileName = m_currentPath;
-      m_createMasterDir = true;
-    }
-    else
-    {
-      m_currentPath = m_fileName.left(m_fileName.size()-cutName);
-      //qout << QLatin1String("First Path: %1").arg(m_currentPath) << Qt::endl;
-    }
+  if (m_sendingADir)
+  {
+    m_byteToWrite = 0;
+    m_totalSize = 0;
+  }
+  else
+  {
+    //A resumed file starts where zorg's partial copy ends
+    m_byteToWrite = m_localFile->size() - m_localFile->pos(); //The size of the remaining data
+    m_totalSize = m_byteToWrite;
+    m_totalSent += m_totalSize;
+  }
 
-    if (!m_createMasterDir)
-    {
-      if (m_totalSize >= 1073741824)
-      {
-        totalSize = (m_totalSize / 1024.0) / 1024.0;
-        strTotalSize = QString::number(totalSize, 'f', 2) + " MB";
-      }
-      else
-      {
-        totalSize = m_totalSize / 1024.0;
-        strTotalSize = QString::number(totalSize, 'f', 2) + " KB";
-      }
-    }
+  m_currentFileName = m_fileName;
 
-    QTextStream s(stdin);
+  showGorging();
 
-    if (m_askForAccept && !m_alwaysAccept)
-    {
-      while(true)
-      {
-        QString query;
+  m_byteToWrite += m_outBlock.size();
+  m_totalSent += m_outBlock.size();
 
-        if (m_createMasterDir)
-          query = QString("\nDo you want to zorg dir %1 (y/N)? ").arg(m_currentFileName);
-        else
-          query = QString("\nDo you want to zorg %1 with %2 (y/N)? ").arg(m_currentFileName).arg(strTotalSize);
+  if (sendFileZeroCopy()) return;
 
-        char value = question(query);
+  m_outBlock = readBody(qMin(m_byteToWrite, m_loadSize));
+  m_tcpClient->write(m_outBlock); // Send the read file to the socket
+}
 
-        if (value == 'Y' || value == 'y')
-        {
-          m_askForAccept = true;
-          m_receivedSocket->write(ctn_ZORGED_OK_SEND.toLatin1());
-          m_receivedSocket->waitForBytesWritten(-1);
-          break;
-        }
-        else if (value == 'N' || value == 'n' || value == '\n')
-        {
-          std::cout << std::endl << "Sending CANCEL_SEND..." << std::endl;
-          m_receivedSocket->write(ctn_ZORGED_CANCEL_SEND.toLatin1());
-          m_receivedSocket->waitForBytesWritten(-1);
-          m_byteReceived = 0;
-          m_totalSize = 0;
+/*
+ * Sends header information of the file that belongs to the path we are traversing
+ */
+void GorgZorg::send()
+{
+  m_stats.enter(Phase::Body);
+  m_loadSize = m_block * 1024; // The size of data sent each time
 
-          return;
-        }
-      }
-    }
-    else if (!m_askForAccept || m_alwaysAccept)
-    {
-      m_askForAccept = true;
-      m_receivedSocket->write(ctn_ZORGED_OK_SEND.toLatin1());
-      m_receivedSocket->waitForBytesWritten(-1);
-    }
+  if (m_sendingADir)
+  {
+    m_byteToWrite = 0;
+    m_totalSize = 0;
+  }
+  else
+  {
+    m_byteToWrite = m_localFile->size(); //The size of the remaining data
+    m_totalSize = m_localFile->size();
+    m_totalSent += m_totalSize;
+  }
 
-    //ctn_DIR_ESCAPEdirectory/subdirectory
-    if (m_currentPath.startsWith(ctn_DIR_ESCAPE))
-    {
-      m_receivingADir = true;
-      m_currentPath.remove(ctn_DIR_ESCAPE);
+  m_currentFileName = m_fileName;
 
-#ifdef Q_OS_WIN
-      if (m_currentPath.startsWith(QDir::separator()))
-      {
-        m_currentPath.remove(0, 1);
-      }
-#endif
-    }
+  showGorging();
 
-    std::cout << std::endl << "Zorging " << m_currentFileName.toLatin1().data() << std::endl;
+  m_outBlock = header(startDigest(withFileTime(FileHeader(m_currentFileName, m_totalSize, ctn_HEADER_SINGLE_TRANSFER))));
+  m_totalSize += m_outBlock.size(); // The total size is the file size plus the size of the header
+  m_byteToWrite += m_outBlock.size();
+  m_totalSent += m_outBlock.size();
 
-    if (m_createMasterDir)
-    {
+  m_tcpClient->write(m_outBlock); // Send the read file to the socket
+}
 
-#ifndef Q_OS_WIN
-      QProcess p;
-      QStringList params;
-      params << QLatin1String("-p");
-      params << m_currentPath;
-      p.execute(QLatin1String("mkdir"), params);
-#else
-      QDir daux;
-      daux.mkpath(m_currentPath);
-      //qout << QLatin1String("Master DIR: %1").arg(m_currentPath) << Qt::endl;
-      m_masterDir = m_currentPath;
-#endif
+/*
+ * Pushes the remaining contents of m_localFile straight from the page cache to the socket using sendfile(2),
+ * avoiding the QFile::read/QTcpSocket::write copies. The header framing is left untouched.
+ *
+ * Returns false without sending any body byte when zero-copy cannot be used, so the caller falls back to the read/write loop
+ */
+bool GorgZorg::sendFileZeroCopy()
+{
+#ifdef Q_OS_LINUX
+  QFile *file = qobject_cast<QFile *>(m_localFile);
+  //sendfile would skip the digest of a verified body
+  if (!m_zeroCopy || m_sendingADir || m_digest != nullptr || file == nullptr || !file->isOpen() || file->size() == 0) return false;
 
-      m_byteReceived = 0;
-      m_totalSize = 0;
+  //goOnSend must not race with us while Qt flushes what it still holds in its write buffer (the file header)
+  bool wasConnected = QObject::disconnect(m_tcpClient, &QTcpSocket::bytesWritten, this, &GorgZorg::goOnSend);
+
+  while (m_tcpClient->bytesToWrite() > 0)
+  {
+    if (!m_tcpClient->waitForBytesWritten(-1)) break;
+  }
 
-      //Send an OK to the other side
-      std::cout << "Zorging of master directory completed" << std::endl;
-      m_receivedSocket->write(ctn_ZORGED_OK.toLatin1());
-      m_receivedSocket->waitForBytesWritten(-1);
+  int sock = int(m_tcpClient->socketDescriptor());
+  int fd = file->handle();
+  off_t offset = off_t(file->pos());
+  qint64 remaining = file->size() - file->pos();
+  bool started = false;
 
-      if (m_singleTransfer == false && m_askForAccept == false)
-        m_askForAccept = true;
-      else
-        m_askForAccept = false;
+  while (remaining > 0)
+  {
+    ssize_t sent = ::sendfile(sock, fd, &offset, size_t(qMin(remaining, ctn_SENDFILE_CHUNK)));
 
-      return;
+    if (sent > 0)
+    {
+      remaining -= sent;
+      if (m_progress != nullptr) m_progress->addBytes(sent);
+      started = true;
+      if (m_cacheDropper != nullptr) m_cacheDropper->advance(sent);
     }
-
-    if (!m_currentPath.isEmpty())
+    else if (sent < 0 && errno == EINTR)
     {
-#ifndef Q_OS_WIN
-      if (m_currentPath.startsWith(QDir::separator()))
-        m_currentPath.remove(0,1);
-#else
-      bool hasDrive=m_currentPath.contains(QLatin1Char(':'));
-
-      if (hasDrive)
-      {
-        int s = m_currentPath.indexOf(QDir::separator());
-        if (s > -1)
-        {
-          m_winDrive = m_currentPath.left(s+1);
-          m_currentPath.remove(m_winDrive);
-        }
-      }
-#endif
-      m_currentPath.remove(QLatin1String("..") + QString(QDir::separator()));
-      m_currentPath.remove(QLatin1String(".") + QString(QDir::separator()));
-
-#ifndef Q_OS_WIN
-      if (!m_currentPath.isEmpty())
-      {
-        QProcess p;
-        QStringList params;
-        params << QLatin1String("-p");
-        params << m_currentPath;
-        p.execute(QLatin1String("mkdir"), params);
-      }
-#else
-      if (!m_currentPath.isEmpty())
-      {
-        QDir daux;
-        if (!m_masterDir.isEmpty())
-        {
-          if (!QString(m_winDrive+m_currentPath).startsWith(m_masterDir))
-            m_currentPath = m_masterDir + m_currentPath;
-        }
-        daux.mkpath(m_currentPath);
-      }
-#endif
+      continue;
     }
-
-    if (m_receivingADir)
+    else if (sent < 0 && errno == EAGAIN) //The socket is non-blocking, so let's wait until it drains
     {
-
-#ifndef Q_OS_WIN
-      QProcess p;
-      QStringList params;
-      params << QLatin1String("-p");
-      params << m_currentPath + QDir::separator() + m_currentFileName;
-      p.execute(QLatin1String("mkdir"), params);
-#else
-      QDir daux;
-      if (!m_masterDir.isEmpty())
-      {
-        if (!QString(m_winDrive+m_currentPath).startsWith(m_masterDir))
-          m_currentPath = m_masterDir + m_currentPath;
-      }
-
-      //qout << QLatin1String("Creating DIR: %1").arg(m_currentPath) << Qt::endl;
-      daux.mkpath(m_currentPath + QDir::separator() + m_currentFileName);
-#endif
-
-      m_inBlock = m_receivedSocket->readAll();
-      m_byteReceived += m_inBlock.size();
+      struct pollfd pfd;
+      pfd.fd = sock;
+      pfd.events = POLLOUT;
+      pfd.revents = 0;
+      ::poll(&pfd, 1, -1);
+    }
+    else if (!started && sent < 0 && (errno == EINVAL || errno == ENOSYS))
+    {
+      //This file/socket pair does not support sendfile, so let's use the good old read/write loop
+      if (wasConnected) QObject::connect(m_tcpClient, &QTcpSocket::bytesWritten, this, &GorgZorg::goOnSend);
+      return false;
     }
     else
     {
-      if (m_currentPath.isEmpty())
-      {
-#ifndef Q_OS_WIN
-        m_newFile = new QFile(m_currentFileName);
-#else
-        if (!m_masterDir.isEmpty())
-        {
-          if (!QString(m_winDrive+m_currentFileName).startsWith(m_masterDir))
-            m_currentFileName = m_masterDir + m_currentFileName;
-        }
+      std::cout << std::endl << "ERROR: sendfile failed while gorging " << m_currentFileName.toLatin1().data() << std::endl;
+      exit(1);
+    }
+  }
 
-        //qout << QLatin1String("Creating file: %1").arg(m_currentFileName) << Qt::endl;
-        m_newFile = new QFile(m_currentFileName);
-#endif
-      }
-      else
-      {
-#ifndef Q_OS_WIN
-        m_newFile = new QFile(m_currentPath + QDir::separator() + m_currentFileName);
-#else
-        if (!m_masterDir.isEmpty())
-        {
-          if (!QString(m_winDrive+m_currentPath).startsWith(m_masterDir))
-            m_currentPath = m_masterDir + m_currentPath;
-        }
+  if (wasConnected) QObject::connect(m_tcpClient, &QTcpSocket::bytesWritten, this, &GorgZorg::goOnSend);
+  m_byteToWrite = 0;
+  finishSendingFile();
 
-        //qout << QLatin1String("Creating file: %1").arg(m_currentPath + m_currentFileName) << Qt::endl;
-        m_newFile = new QFile(m_currentPath + QDir::separator() + m_currentFileName);
+  return true;
+#else
+  return false;
 #endif
-      }
+}
 
-      //qout << Qt::endl << QLatin1String("Path: %1").arg(m_currentPath) << Qt::endl;
-      //qout << QLatin1String("FileName: %1").arg(m_currentFileName) << Qt::endl;
+/*
+ * Prints the name of the file (or dir) of a path about to be gorged. Only in verbose mode, as writing and
+ * flushing a few lines for every file costs more than sending a tiny one
+ */
+void GorgZorg::showGorging()
+{
+  if (!m_verbose) return;
 
-      m_newFile->open(QFile::WriteOnly);
-      m_inBlock = m_receivedSocket->readAll();
-      m_byteReceived += m_inBlock.size();
+  if (m_sendingADir)
+  {
+    QString aux = QString("Gorging dir %1").arg(m_currentFileName);
+    std::cout << std::endl << aux.remove(ctn_DIR_ESCAPE).toLatin1().data() << std::endl;
+  }
+  else
+  {
+    std::cout << std::endl << "Gorging " << m_currentFileName.toLatin1().data() << std::endl;
+  }
+}
 
-      m_newFile->write(m_inBlock);
-      m_newFile->flush();
-    }
+/*
+ * Called when all the bytes of the current file were handed to the socket
+ */
+void GorgZorg::finishSendingFile()
+{
+  //QTextStream qout(stdout);
+  if (m_verbose) std::cout << "Gorging completed" << std::endl;
+  m_stats.enter(Phase::AckWait);
 
-    if (m_verbose)
-    {
-      std::cout << "Received " << QString::number(m_byteReceived).toLatin1().data() << " bytes of " <<
-                   QString::number(m_totalSize).toLatin1().data() << std::endl;
-    }
+  if (!m_sendingADir)
+  {
+    stopReadAhead();
+    stopDroppingCache();
+    m_localFile->close();
+    if (m_progress != nullptr) m_progress->addFile();
   }
-  else // Officially read the file content
+
+  //The digest trailer follows the body. Its bytes are not part of the body goOnSend counts
+  if (m_digest != nullptr)
   {
-    m_inBlock = m_receivedSocket->readAll();
-    m_byteReceived += m_inBlock.size();
-    if (m_verbose)
-    {
-      std::cout << "Received again " << QString::number(m_byteReceived).toLatin1().data() << " bytes of " <<
-                   QString::number(m_totalSize).toLatin1().data() << std::endl;
-    }
-    if (!m_receivingADir)
-    {
-      m_newFile->write(m_inBlock);
-      m_newFile->flush();
-    }
+    bool wasConnected = QObject::disconnect(m_tcpClient, &QTcpSocket::bytesWritten, this, &GorgZorg::goOnSend);
+    m_tcpClient->write(m_digest->result());
+    m_tcpClient->waitForBytesWritten(-1);
+    if (wasConnected) QObject::connect(m_tcpClient, &QTcpSocket::bytesWritten, this, &GorgZorg::goOnSend);
+
+    delete m_digest;
+    m_digest = nullptr;
   }
+}
 
-  //ui-> receivedProgressBar->setMaximum(totalSize);
-  //ui-> receivedProgressBar->setValue(byteReceived);
+/*
+ * This is the slot that is called multiple times by all sending methods until the file is completly sent to the server
+ */
+void GorgZorg::goOnSend(qint64 numBytes) // Start sending file content
+{
+  m_byteToWrite -= numBytes; // Remaining data size
+  tune(numBytes);
 
-  if (m_byteReceived == m_totalSize)
+  if (m_sendingADir)
   {
-    QString savedOn;
-    if (m_zorgPath.isEmpty())
-      savedOn = QDir::currentPath();
-    else
-      savedOn = m_zorgPath;
+    m_outBlock.resize(0);
+    m_tcpClient->write(m_outBlock);
+  }
+  else
+  {
+    //First body block of a file inside a directory traverse: try the zero-copy path
+    if (m_byteToWrite > 0 && m_readAhead == nullptr && m_localFile->pos() == 0 && sendFileZeroCopy()) return;
 
-    std::cout << "Zorging completed" << std::endl;
-    std::cout << "File saved on \"" << savedOn.toLatin1().data() << "\"" << std::endl;
+    m_outBlock = readBody(qMin(m_byteToWrite, m_loadSize));
+    m_tcpClient->write(m_outBlock);
+  }
 
-    m_inBlock.clear();
+  //ui-> sendProgressBar->setMaximum(totalSize);
+  //ui-> sendProgressBar->setValue(totalSize-byteToWrite);
 
-    if (!m_receivingADir)
-    {
-      m_newFile->close();
-    }
+  if (m_byteToWrite == 0) // Send completed
+  {
+    finishSendingFile();
+  }
+}
 
-    m_byteReceived = 0;
-    m_totalSize = 0;
+/*
+ *  SERVER SIDE PART *****************************************************************
+ */
 
-    if (!m_alwaysAccept)
+/*
+ * Starts listening for file transfers on port m_port of the given ipAddress
+ */
+void GorgZorg::startServer(const QString &ipAddress)
+{
+  ZorgSettings settings;
+  settings.zorgPath = m_zorgPath;
+  settings.verbose = m_verbose;
+  settings.alwaysAccept = m_alwaysAccept;
+  settings.quitServer = m_quitServer;
+  settings.spliceReceive = m_spliceReceive;
+  settings.uringReceive = m_uringReceive;
+  settings.noCache = m_noCache;
+  settings.statsFile = m_statsFile;
+
+  m_server = new ZorgServer(settings, m_threads, this);
+  QString ip = ipAddress;
+
+  if (ip.isEmpty())
+  {
+    const QHostAddress &localhost = QHostAddress(QHostAddress::LocalHost);
+    for (auto &address: QNetworkInterface::allAddresses())
     {
-      if (m_singleTransfer == false && m_askForAccept == false)
-        m_askForAccept = true;
-      else
-        m_askForAccept = false;
+      if (address.protocol() == QAbstractSocket::IPv4Protocol && address != localhost)
+      {
+        if (!isLocalIP(address.toString())) continue;
+        ip = address.toString();
+      }
     }
+  }
 
-    //Send an OK to the other side
-    m_receivedSocket->write(ctn_ZORGED_OK.toLatin1());
-    m_receivedSocket->waitForBytesWritten(-1);
+  if (ip.isEmpty())
+  {
+    std::cout << std::endl << "ERROR: No valid IP address could be found!" << std::endl;
+    exit(1);
   }
+
+  if (!m_server->listen(QHostAddress(ip), m_port))
+  {
+    //If we could not bind to this port...
+    std::cout << "ERROR: " << ip.toLatin1().data() << " is unavailable or port " <<
+                 QString::number(m_port).toLatin1().data() << " is already being used in this host!" << std::endl;
+    exit(1);
+  }
+
+  //Let's change the received files directory if the user especified one...
+  if (!m_zorgPath.isEmpty())
+  {
+    QDir::setCurrent(m_zorgPath);
+  }
+
+  std::cout << "Start zorging on " << ip.toLatin1().data() << ":" << QString::number(m_port).toLatin1().data() << "..." << std::endl;
 }
 
 /*
@@ -1265,19 +1937,37 @@ void GorgZorg::readClient()
 void GorgZorg::showHelp()
 {
   std::cout << std::endl << "  GorgZorg, a simple multiplatform CLI network file transfer tool" << std::endl;
-  std::cout << std::endl << "    -bs <number>: Set the block size value (in kilobytes) when sending data (default is 4)" << std::endl;
+  std::cout << std::endl << "    -bs <number|auto>: Set the block size value (in kilobytes) when sending data (default is 4). \"auto\" sizes blocks and socket buffers from the measured throughput" << std::endl;
   std::cout << "    -c <IP>: Set GorgZorg server IP to connect to" << std::endl;
+  std::cout << "    -codec <zstd|lz4|zlib>: Set the codec \"-zip\" compresses with (default is zstd when available)" << std::endl;
   std::cout << "    -d <path>: Set directory in which received files are saved" << std::endl;
+  std::cout << "    -dedup: Gorg files as content-defined chunks, skipping chunks zorg already stored in earlier transfers (zorg keeps them in ~/.cache/gorgzorg/chunks)" << std::endl;
+  std::cout << "    -delta: Gorg a single file as a delta of the copy zorg already has (rsync-like)" << std::endl;
   std::cout << "    -g <pathToGorg>: Set a filename or path to gorg (send)" << std::endl;
   std::cout << "    -h: Show this help" << std::endl;
+  std::cout << "    -level <number>: Set the compression level of \"-zip\" (default is the codec's own)" << std::endl;
+  std::cout << "    -nocache: Keep the contents of gorged and zorged files out of the page cache, dropping them behind reads and writes (Linux only)" << std::endl;
+  std::cout << "    -ordered: When gorging a path, send its entries in a deterministic order (sorted, depth first)" << std::endl;
   std::cout << "    -p <portnumber>: Set port to connect or listen to connections (default is 10000)" << std::endl;
+  std::cout << "    -pack <KB>: When gorging a path, pack files smaller than this together and send each pack with a single writev (implies \"-window 1024\" if no window is set)" << std::endl;
+  std::cout << "    -packsize <KB>: Set the size of the packs of \"-pack\" (default is 1024)" << std::endl;
   std::cout << "    -q: Quit zorging after transfer is complete" << std::endl;
+  std::cout << "    -resume: Let zorg keep a partial copy of the file left by an interrupted transfer and gorg only the rest" << std::endl;
+  std::cout << "    -sendfile: Use zero-copy sendfile(2) to gorg file contents (Linux only)" << std::endl;
+  std::cout << "    -streams <number>: Split a single file in ranges and gorg them using this number of connections" << std::endl;
+  std::cout << "    -splice: When zorging, use zero-copy splice(2) to save file contents (Linux only)" << std::endl;
+  std::cout << "    --stats-json <file>: Write the time spent on each phase of the transfer, file and byte counts and acknowledgement latencies to file, as JSON" << std::endl;
+  std::cout << "    -sync: When gorging a path, gorg only the files which are new or changed (by size and mtime) on zorg" << std::endl;
   std::cout << "    -tar: Use tar to archive contents of path" << std::endl;
-  std::cout << "    -v: Verbose mode. When gorging, show speed. When zorging, show bytes received" << std::endl;
+  std::cout << "    -uring: When zorging, create and write small files in batches through io_uring (Linux with liburing)" << std::endl;
+  std::cout << "    -threads <number>: Number of worker threads serving clients when zorging, or compressing \"-zip\" and scanning paths when gorging (default is one per CPU core)" << std::endl;
+  std::cout << "    -v: Verbose mode. Keep a status line with throughput, files per second and ETA at the bottom of the terminal (or print it every 5 seconds when the output is not a terminal) and show each file gorged. When gorging, show speed at the end" << std::endl;
+  std::cout << "    -verify: Hash file bodies while they are gorged, so zorg checks they arrived intact (xxh3 or xxh64). Not with \"-zip\", \"-streams\", \"-delta\" or \"-dedup\"" << std::endl;
   std::cout << "    --version: Show version information" << std::endl;
+  std::cout << "    -window <files>: When gorging a path, keep up to this number of files in flight without waiting for each acknowledgement" << std::endl;
   std::cout << "    -y: When zorging, automatically accept any incoming file/path" << std::endl;
   std::cout << "    -z [IP]: Enter Zorg mode (listen to connections). If IP is ommited, GorgZorg will guess it" << std::endl;
-  std::cout << "    -zip: Use gzip to compress contents of path" << std::endl;
+  std::cout << "    -zip: Compress the tar archive of path while it is gorged, using all CPU cores" << std::endl;
 
   std::cout << std::endl << "  Examples:" << std::endl;
   std::cout << std::endl << "    #Send file /home/user/Projects/gorgzorg/LICENSE to IP 10.0.1.60 on port 45400" << std::endl;
@@ -1286,7 +1976,7 @@ void GorgZorg::showHelp()
   std::cout << "    gorgzorg -c 192.168.1.1 -g Test" << std::endl;
   std::cout << std::endl << "    #Send archived contents of Crucial directory to IP 172.16.20.21" << std::endl;
   std::cout << "    gorgzorg -c 172.16.20.21 -g Crucial -tar" << std::endl;
-  std::cout << std::endl << "    #Send contents of filter expression in a gziped tarball to IP 192.168.0.100 [1]" << std::endl;
+  std::cout << std::endl << "    #Send contents of filter expression in a compressed tarball to IP 192.168.0.100" << std::endl;
   std::cout << "    gorgzorg -c 192.168.0.100 -g '/home/user/Documents/*.txt' -zip" << std::endl;
   std::cout << std::endl << "    #Start a GorgZorg server on address 192.168.10.16:20000 using directory" << std::endl;
   std::cout << "    #\"/home/user/gorgzorg_files\" to save received files" << std::endl;
@@ -1294,8 +1984,6 @@ void GorgZorg::showHelp()
   std::cout << std::endl << "    #Start a GorgZorg server on address 172.16.11.43 on (default) port 10000" << std::endl;
   std::cout << "    #Always accept transfers and quit just after receiving one" << std::endl;
   std::cout << "    gorgzorg -z 172.16.11.43 -y -q" << std::endl << std::endl;
-  std::cout << std::endl;
-  std::cout << "[1] On Windows systems, you'll need 7zip installed." << std::endl << std::endl;
 }
 
 /*
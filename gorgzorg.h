@@ -14,22 +14,36 @@
 #ifndef GORGZORG_H
 #define GORGZORG_H
 
+#include "streamcompressor.h"
+#include "syncmanifest.h"
+#include "bodydigest.h"
+#include "protocol.h"
+#include "blocktuner.h"
+#include "transferstats.h"
+
 #include <QObject>
+#include <QQueue>
+#include <QVector>
 
 class QTcpSocket;
-class QTcpServer;
-class QFile;
+class ZorgServer;
+class QIODevice;
 class QElapsedTimer;
+class ReadAhead;
+class PageCacheDropper;
+class ProgressReporter;
 
 const int ctn_BLOCK_SIZE = 4;
+const qint64 ctn_SENDFILE_CHUNK = 0x7ffff000; //Maximum number of bytes Linux transfers in a single sendfile call
+const int ctn_SPLICE_PIPE_SIZE = 1024 * 1024; //Requested capacity of the pipe used by splice
+const qint64 ctn_PIPELINE_BUFFER_SIZE = 4 * 1024 * 1024; //Bytes the socket may buffer when pipelining files
+const qint64 ctn_RESUME_CHECK_SIZE = 1024 * 1024; //Bytes before the resume offset which must match on both sides
+const int ctn_RESUME_CHECKSUM_SIZE = 20; //SHA-1 of the bytes checked before resuming
+const int ctn_PACK_SIZE = 1024;           //KB of small files "-pack" sends together, unless "-packsize" says otherwise
+const int ctn_PACK_WINDOW = 1024;         //Window of pipelined files "-pack" uses when "-window" is not set
 
 const QString ctn_VERSION = QLatin1String("0.3.1(dev)");
-const QString ctn_DIR_ESCAPE = QLatin1String("<^dir$>:");
-const QString ctn_ZORGED_OK = QLatin1String("Z_OK");
-const QString ctn_ZORGED_OK_SEND = QLatin1String("Z_OK_SEND");
-const QString ctn_ZORGED_OK_SEND_AND_ZORGED_OK = QLatin1String("Z_OK_SENDZ_OK");
-const QString ctn_ZORGED_CANCEL_SEND = QLatin1String("Z_KO_SEND");
-const QString ctn_END_OF_TRANSFER = QLatin1String("<[--Finis_tr@nslationi$--]>");
+const QString ctn_DIR_ESCAPE = QLatin1String("<^dir$>:"); //Marks the dirs of a traverse, which go to zorg flagged with ctn_HEADER_DIR
 
 class GorgZorg: public QObject
 {
@@ -39,55 +53,109 @@ public:
 
 private:
   QTcpSocket *m_tcpClient;
-  QTcpServer *m_server;
-  QTcpSocket *m_receivedSocket;
+  ZorgServer *m_server;
   QElapsedTimer *m_elapsedTime; //Counts ms since starting sending files
   QByteArray m_outBlock;
-  QByteArray m_inBlock;
-  QFile *m_localFile;
-  QFile *m_newFile;
+  QQueue<QString> m_inFlight; //Pipelined files still waiting for zorg replies
+  QVector<QByteArray> m_pack; //Headers and bodies of the small files waiting to be sent together
+  QIODevice *m_localFile;   //File being sent (or the TarArchive streamed by "-tar")
   QString m_fileName;
-  QString m_currentPath;
   QString m_currentFileName;
   QString m_targetAddress;
   QString m_archiveFileName;//Contains the random generated name of the archived path to send
   QString m_zorgPath;       //Directory where the server saves received files
-  QString m_masterDir;      //Directory which contains the path being received
-  QString m_winDrive;       //When running on Windows, this member holds the path drive (ex: "C:\")
+  QString m_tarPath;        //Path archived on the fly by "-tar"
+  QString m_tarFilter;      //Name filter (ex: *.txt) of the path archived by "-tar"
+  QString m_statsFile;      //Where the JSON statistics of "--stats-json" are written
+  Codec m_codec;            //Codec used by "-zip"
 
-  bool m_createMasterDir;
-  bool m_singleTransfer;
   bool m_tarContents;
   bool m_zipContents;
   bool m_sendingADir;
-  bool m_receivingADir;
   bool m_verbose;
   bool m_alwaysAccept;
-  bool m_askForAccept;
   bool m_quitServer;
+  bool m_zeroCopy;          //Use sendfile(2) to transfer file contents
+  bool m_resume;            //Let zorg offer a partial copy of the file, so only the rest is sent
+  bool m_resumeOffered;     //Zorg answered the last header with Z_RS_SEND
+  bool m_delta;             //Send single files as deltas of the copy zorg already has
+  bool m_dedup;             //Send files as content-defined chunks, skipping the ones zorg has stored
+  bool m_sync;              //Send only the files of a path which are new or changed in zorg's manifest
+  bool m_verify;            //Hash file bodies and send the digest after them, so zorg can check them
+  bool m_spliceReceive;     //Use splice(2) to save received file contents
+  bool m_uringReceive;      //Write small received files in batches through io_uring
+  bool m_noCache;           //Keep the contents of sent and received files out of the page cache
+  bool m_helloReceived;     //Zorg answered our hello
+  bool m_ordered;           //Send the entries of a path in a deterministic order, instead of as soon as they are scanned
+  bool m_autoTune;          //Size blocks and socket buffers from the measured throughput ("-bs auto")
+  bool m_tunePending;       //Zorg must be told the socket buffer size the tuner settled on before the next header
 
   qint64 m_loadSize;        //The size of each send data
   qint64 m_byteToWrite;     //The remaining data size
-  qint64 m_byteReceived;    //The size that has been sent
   qint64 m_totalSize;       //Total file size
   qint64 m_totalSent;       //Total bytes sent
+  qint64 m_acceptedFiles;   //Number of accept replies received
+  qint64 m_zorgedFiles;     //Number of Done/Error replies received
+  quint32 m_sequence;       //Sequence number of the last header sent
+  quint32 m_zorgCapabilities; //Optional features zorg told us it has in its hello
+  qint64 m_resumeOffset;    //Size of the partial copy zorg offered
+  QByteArray m_resumeChecksum; //Checksum of the end of the partial copy zorg offered
+  QByteArray m_deltaSignature; //Block checksums of zorg's copy of the file being sent as a delta
+  int m_deltaBlockSize;
+  QByteArray m_chunksNeeded; //Bitmap of the chunks zorg is missing
+  quint64 m_transferId;     //Id zorg accepted the current striped file with, which its stripes echo
+  QHash<QString, ManifestEntry> m_manifest; //What zorg has under the synced path
+  BodyDigest *m_digest;     //Digest of the body being sent (only when verifying)
+  BlockTuner m_tuner;
+  TransferStats m_stats;
+  ProgressReporter *m_progress; //Status line of the transfer (only when verbose)
+  ReadAhead *m_readAhead;   //Reads the file being sent ahead of the socket (only big files)
+  qint64 m_readAheadFiles;  //Files sent through a read-ahead ring
+  qint64 m_readAheadEmpty;  //Times a ring ran empty (the disk was behind the network)
+  qint64 m_readAheadFull;   //Times a ring ran full (the network was behind the disk)
+  PageCacheDropper *m_cacheDropper; //Drops the file being sent from the page cache behind our reads (only with "-nocache")
+  qint64 m_cacheDropped;    //Bytes of sent files dropped from the page cache
+  qint64 m_cacheResident;   //Bytes of sent files still in the page cache after they were sent (only measured when verbose)
 
   int m_block;
+  int m_streams;            //Number of connections used to send a single file
+  int m_window;             //Max number of pipelined files waiting for zorg replies (0 means wait for each one)
+  qint64 m_packFileSize;    //Files of a path smaller than this are packed together ("-pack", 0 means they are not)
+  qint64 m_packSize;        //Bytes packed before they are sent
+  qint64 m_packBytes;       //Bytes in m_pack
   int m_port;
+  int m_threads;            //Number of zorg worker, compression or scanning threads (0 means one per CPU core)
+  int m_level;              //Compression level of "-zip" (-1 means the codec default)
   int m_sendTimes;          //Used to mark whether to send for the first time, after the first connection signal is triggered, followed by manually calling
 
-  QString getShell();
   QString createArchive(const QString &pathToArchive);
+  void connectToZorg();
   bool prepareToSendFile(const QString &fName);
+  FileHeader withFileTime(FileHeader fileHeader) const;
+  FileHeader startDigest(FileHeader fileHeader);
+  QByteArray header(FileHeader fileHeader);
+  void tune(qint64 bytesSent);
+  QByteArray readBody(qint64 maxSize);
+  void stopReadAhead();
+  void stopDroppingCache();
   void sendFile(const QString &filePath);
+  void sendFilePipelined(const QString &filePath);
+  void sendFilePacked(const QString &filePath);
+  void waitForWindow();
+  void flushPack();
   void sendFileHeader(const QString &filePath);
+  void sendFileStriped(const QString &filePath);
+  void sendFileCompressed(const QString &filePath);
+  void sendFileDelta(const QString &filePath);
+  void sendFileDedup(const QString &filePath);
   void sendDirHeader(const QString &filePath);
   void sendEndOfTransfer();
-  void removeArchive();
+  bool sendFileZeroCopy();
+  void resumeSending();
+  void showGorging();
+  void finishSendingFile();
 
 private slots:
-  void acceptConnection();
-  void readClient();
   void readResponse();
   void send();              //Transfer file header information (original version)
   void sendFileBody();      //Transfer file header information
@@ -101,16 +169,36 @@ public:
   static bool isValidIP(const QString &ip);
   static bool isLocalIP(const QString &ip);  
   static QString getWorkingDirectory();
+  static QByteArray prefixChecksum(QIODevice *file, qint64 size);
 
   //Command line passing params
   inline void setBlockSize(int block) { m_block = block; }
+  inline void setAutoBlockSize() { m_autoTune = true; }
   inline void setPort(int port) { m_port = port; }
+  inline void setWindow(int window) { m_window = window; }
+  inline void setPackFileSize(int kb) { m_packFileSize = qint64(kb) * 1024; }
+  inline void setPackSize(int kb) { m_packSize = qint64(kb) * 1024; }
+  inline void setStreams(int streams) { m_streams = streams; }
+  inline void setThreads(int threads) { m_threads = threads; }
   inline void setTarContents() { m_tarContents = true; }
   inline void setZipContents() { m_zipContents = true; }
+  inline void setCodec(Codec codec) { m_codec = codec; }
+  inline void setLevel(int level) { m_level = level; }
   inline void setVerbose() { m_verbose = true; }
   inline void setAlwaysAccept() { m_alwaysAccept = true; }
   inline void setQuitServer() { m_quitServer = true; }
+  inline void setZeroCopy() { m_zeroCopy = true; }
+  inline void setResume() { m_resume = true; }
+  inline void setDelta() { m_delta = true; }
+  inline void setDedup() { m_dedup = true; }
+  inline void setSync() { m_sync = true; }
+  inline void setOrdered() { m_ordered = true; }
+  inline void setVerify() { m_verify = true; }
+  inline void setSpliceReceive() { m_spliceReceive = true; }
+  inline void setUringReceive() { m_uringReceive = true; }
+  inline void setNoCache() { m_noCache = true; }
   inline void setZorgPath(const QString &value) { m_zorgPath = value; }
+  inline void setStatsFile(const QString &value) { m_statsFile = value; }
 
 signals:
   void endTransfer();
@@ -17,8 +17,52 @@ QMAKE_CXXFLAGS += -std=c++17
 # You can also select to disable deprecated APIs only up to a certain version of Qt.
 #DEFINES += QT_DISABLE_DEPRECATED_BEFORE=0x060000    # disables all the APIs deprecated before Qt 6.0.0
 
+# Optional "-zip" codecs (zlib comes with Qt)
+packagesExist(libzstd) {
+  CONFIG += link_pkgconfig
+  PKGCONFIG += libzstd
+  DEFINES += GORGZORG_HAVE_ZSTD
+}
+
+packagesExist(liblz4) {
+  CONFIG += link_pkgconfig
+  PKGCONFIG += liblz4
+  DEFINES += GORGZORG_HAVE_LZ4
+}
+
+# Optional xxh3 digests of "-verify" (xxh64 is built in)
+packagesExist(libxxhash) {
+  CONFIG += link_pkgconfig
+  PKGCONFIG += libxxhash
+  DEFINES += GORGZORG_HAVE_XXHASH
+}
+
+# Optional io_uring writes of "-uring" (Linux only)
+packagesExist(liburing) {
+  CONFIG += link_pkgconfig
+  PKGCONFIG += liburing
+  DEFINES += GORGZORG_HAVE_URING
+}
+
 # Input
-HEADERS += argumentlist.h gorgzorg.h
+HEADERS += argumentlist.h blocktuner.h bodydigest.h console.h dedup.h deltasync.h gorgzorg.h pagecache.h progressreporter.h protocol.h readahead.h streamcompressor.h syncmanifest.h tararchive.h transferstats.h treewalker.h uringwriter.h zorgserver.h zorgsession.h
 SOURCES += argumentlist.cpp \
+           blocktuner.cpp \
+           bodydigest.cpp \
+           console.cpp \
+           dedup.cpp \
+           deltasync.cpp \
            gorgzorg.cpp \
-           main.cpp
+           main.cpp \
+           pagecache.cpp \
+           progressreporter.cpp \
+           protocol.cpp \
+           readahead.cpp \
+           streamcompressor.cpp \
+           syncmanifest.cpp \
+           tararchive.cpp \
+           transferstats.cpp \
+           treewalker.cpp \
+           uringwriter.cpp \
+           zorgserver.cpp \
+           zorgsession.cpp
@@ -44,7 +44,11 @@ int main(int argc, char *argv[])
   }
 
   aux = argList->getSwitchArg(QLatin1String("-bs"));
-  if (!aux.isEmpty())
+  if (aux == QLatin1String("auto"))
+  {
+    gz.setAutoBlockSize();
+  }
+  else if (!aux.isEmpty())
   {
     bool ok;
     int block = aux.toInt(&ok);
@@ -77,6 +81,30 @@ int main(int argc, char *argv[])
 
   if (argList->getSwitch("-q")) gz.setQuitServer();
 
+  if (argList->getSwitch("-splice")) gz.setSpliceReceive();
+
+  if (argList->getSwitch("-uring")) gz.setUringReceive();
+
+  if (argList->getSwitch("-nocache")) gz.setNoCache();
+
+  aux = argList->getSwitchArg(QLatin1String("--stats-json"));
+  if (!aux.isEmpty()) gz.setStatsFile(aux);
+
+  aux = argList->getSwitchArg(QLatin1String("-threads"));
+  if (!aux.isEmpty())
+  {
+    bool ok;
+    int threads = aux.toInt(&ok);
+
+    if (!ok || threads <= 0)
+    {
+      std::cout << "ERROR: The number of threads must be a positive number!" << std::endl;
+      exit(1);
+    }
+
+    gz.setThreads(threads);
+  }
+
   //Has the user set a directory to copy received files?
   if (argList->contains("-d"))
   {
@@ -146,12 +174,153 @@ int main(int argc, char *argv[])
       gz.setTarContents();
     }
 
+    //Checks if user wants file contents to be sent with sendfile(2)
+    if (argList->getSwitch(QLatin1String("-sendfile")))
+    {
+      gz.setZeroCopy();
+    }
+
+    //Checks if user wants to resume an interrupted transfer
+    if (argList->getSwitch(QLatin1String("-resume")))
+    {
+      gz.setResume();
+    }
+
+    //Checks if user wants to send only what changed in a file zorg already has
+    if (argList->getSwitch(QLatin1String("-delta")))
+    {
+      gz.setDelta();
+    }
+
+    //Checks if user wants to skip content zorg already received in earlier transfers
+    if (argList->getSwitch(QLatin1String("-dedup")))
+    {
+      gz.setDedup();
+    }
+
+    //Checks if user wants to send only the files of a path zorg does not have yet
+    if (argList->getSwitch(QLatin1String("-sync")))
+    {
+      gz.setSync();
+    }
+
+    //Checks if user wants the entries of a path sent in the same order every time
+    if (argList->getSwitch(QLatin1String("-ordered")))
+    {
+      gz.setOrdered();
+    }
+
+    //Checks if user wants zorg to check file bodies against their digests
+    if (argList->getSwitch(QLatin1String("-verify")))
+    {
+      gz.setVerify();
+    }
+
+    //Checks if user wants to pipeline the files of a path
+    aux = argList->getSwitchArg(QLatin1String("-window"));
+    if (!aux.isEmpty())
+    {
+      bool ok;
+      int window = aux.toInt(&ok);
+
+      if (!ok || window <= 0)
+      {
+        std::cout << "ERROR: The window must be a positive number of files!" << std::endl;
+        exit(1);
+      }
+
+      gz.setWindow(window);
+    }
+
+    //Checks if user wants the small files of a path to be sent in packs
+    aux = argList->getSwitchArg(QLatin1String("-pack"));
+    if (!aux.isEmpty())
+    {
+      bool ok;
+      int packFileSize = aux.toInt(&ok);
+
+      if (!ok || packFileSize <= 0)
+      {
+        std::cout << "ERROR: The packed file size must be a positive number of kilobytes!" << std::endl;
+        exit(1);
+      }
+
+      gz.setPackFileSize(packFileSize);
+    }
+
+    aux = argList->getSwitchArg(QLatin1String("-packsize"));
+    if (!aux.isEmpty())
+    {
+      bool ok;
+      int packSize = aux.toInt(&ok);
+
+      if (!ok || packSize <= 0)
+      {
+        std::cout << "ERROR: The pack size must be a positive number of kilobytes!" << std::endl;
+        exit(1);
+      }
+
+      gz.setPackSize(packSize);
+    }
+
+    //Checks if user wants to split a single file among many connections
+    aux = argList->getSwitchArg(QLatin1String("-streams"));
+    if (!aux.isEmpty())
+    {
+      bool ok;
+      int streams = aux.toInt(&ok);
+
+      if (!ok || streams <= 0 || streams > 64)
+      {
+        std::cout << "ERROR: Valid number of streams are between 1 and 64!" << std::endl;
+        exit(1);
+      }
+
+      gz.setStreams(streams);
+    }
+
     //Checks if user wants path to be "ziped"
     if (argList->getSwitch(QLatin1String("-zip")))
     {
       gz.setZipContents();
     }
 
+    //Checks which codec and level "-zip" should use
+    aux = argList->getSwitchArg(QLatin1String("-codec"));
+    if (!aux.isEmpty())
+    {
+      Codec codec;
+
+      if (!StreamCompressor::codecFromName(aux, codec))
+      {
+        std::cout << "ERROR: Valid codecs are zstd, lz4 and zlib!" << std::endl;
+        exit(1);
+      }
+
+      if (!StreamCompressor::isAvailable(codec))
+      {
+        std::cout << "ERROR: This GorgZorg was built without " << aux.toLatin1().data() << " support!" << std::endl;
+        exit(1);
+      }
+
+      gz.setCodec(codec);
+    }
+
+    aux = argList->getSwitchArg(QLatin1String("-level"));
+    if (!aux.isEmpty())
+    {
+      bool ok;
+      int level = aux.toInt(&ok);
+
+      if (!ok || level < 0 || level > 22)
+      {
+        std::cout << "ERROR: Valid compression levels are between 0 and 22!" << std::endl;
+        exit(1);
+      }
+
+      gz.setLevel(level);
+    }
+
     aux = argList->getSwitchArg(QLatin1String("-g"));
     if (!aux.isEmpty())
     {
@@ -0,0 +1,127 @@
+/*
+* This file is part of GorgZorg, a simple multiplatform CLI network file transfer tool.
+* Copyright (C) 2021 Alexandre Albuquerque Arnt
+*
+* This program is distributed in the hope that it will be useful,
+* but WITHOUT ANY WARRANTY; without even the implied warranty of
+* MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.
+*
+* Source code hosted on: https://github.com/aarnt/gorgzorg
+*/
+
+#include "pagecache.h"
+
+#include <QFile>
+
+#include <vector>
+
+#ifdef Q_OS_LINUX
+  #include <fcntl.h>
+  #include <sys/mman.h>
+  #include <unistd.h>
+#endif
+
+PageCacheDropper::PageCacheDropper(int fd, qint64 pos, bool writing):
+  m_fd(fd), m_writing(writing), m_start(pos), m_pos(pos), m_flushed(pos), m_dropped(pos)
+{
+}
+
+/*
+ * The cursor moved bytes ahead
+ */
+void PageCacheDropper::advance(qint64 bytes)
+{
+  m_pos += bytes;
+  if (m_pos - m_flushed < ctn_DROP_BEHIND_SIZE) return;
+
+#ifdef Q_OS_LINUX
+  if (m_writing)
+  {
+    //Start writing back this window, then wait for the one before it (which has had a window to get written) and drop it
+    ::sync_file_range(m_fd, off_t(m_flushed), off_t(m_pos - m_flushed), SYNC_FILE_RANGE_WRITE);
+    drop(m_flushed);
+  }
+  else
+  {
+    drop(m_pos);
+  }
+#endif
+
+  m_flushed = m_pos;
+}
+
+/*
+ * Drops whatever is left of the file, tail included. Called before the file is closed
+ */
+void PageCacheDropper::finish()
+{
+#ifdef Q_OS_LINUX
+  if (m_writing)
+    ::sync_file_range(m_fd, off_t(m_dropped), 0, SYNC_FILE_RANGE_WAIT_BEFORE | SYNC_FILE_RANGE_WRITE | SYNC_FILE_RANGE_WAIT_AFTER);
+
+  ::posix_fadvise(m_fd, off_t(m_dropped), 0, POSIX_FADV_DONTNEED);
+#endif
+
+  m_flushed = m_dropped = m_pos;
+}
+
+void PageCacheDropper::drop(qint64 end)
+{
+  if (end <= m_dropped) return;
+
+#ifdef Q_OS_LINUX
+  if (m_writing)
+  {
+    ::sync_file_range(m_fd, off_t(m_dropped), off_t(end - m_dropped),
+                      SYNC_FILE_RANGE_WAIT_BEFORE | SYNC_FILE_RANGE_WRITE | SYNC_FILE_RANGE_WAIT_AFTER);
+  }
+
+  ::posix_fadvise(m_fd, off_t(m_dropped), off_t(end - m_dropped), POSIX_FADV_DONTNEED);
+#endif
+
+  m_dropped = end;
+}
+
+/*
+ * Returns how many bytes of fileName are in the page cache (mincore on a read only mapping), or -1 if
+ * that can't be told
+ */
+qint64 PageCacheDropper::residentBytes(const QString &fileName)
+{
+#ifdef Q_OS_LINUX
+  int fd = ::open(QFile::encodeName(fileName).constData(), O_RDONLY | O_CLOEXEC);
+  if (fd < 0) return -1;
+
+  qint64 size = ::lseek(fd, 0, SEEK_END);
+  qint64 page = ::sysconf(_SC_PAGESIZE);
+  qint64 resident = 0;
+
+  for (qint64 offset = 0; offset < size; offset += ctn_RESIDENCY_MAP_SIZE)
+  {
+    qint64 length = qMin(size - offset, ctn_RESIDENCY_MAP_SIZE);
+    void *map = ::mmap(nullptr, size_t(length), PROT_READ, MAP_SHARED, fd, off_t(offset));
+
+    if (map == MAP_FAILED)
+    {
+      resident = -1;
+      break;
+    }
+
+    std::vector<unsigned char> pages(size_t((length + page - 1) / page));
+
+    if (::mincore(map, size_t(length), pages.data()) == 0)
+    {
+      for (unsigned char residency: pages)
+        if (residency & 1) resident += page;
+    }
+
+    ::munmap(map, size_t(length));
+  }
+
+  ::close(fd);
+  return qMin(resident, size);
+#else
+  Q_UNUSED(fileName)
+  return -1;
+#endif
+}
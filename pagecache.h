@@ -0,0 +1,50 @@
+/*
+* This file is part of GorgZorg, a simple multiplatform CLI network file transfer tool.
+* Copyright (C) 2021 Alexandre Albuquerque Arnt
+*
+* This program is distributed in the hope that it will be useful,
+* but WITHOUT ANY WARRANTY; without even the implied warranty of
+* MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.
+*
+* Source code hosted on: https://github.com/aarnt/gorgzorg
+*/
+
+#ifndef PAGECACHE_H
+#define PAGECACHE_H
+
+#include <QString>
+
+const qint64 ctn_DROP_BEHIND_SIZE = 8 * 1024 * 1024;      //Bytes read or written between drops of the page cache
+const qint64 ctn_RESIDENCY_MAP_SIZE = 1024 * 1024 * 1024; //Bytes of a file mapped at a time to count its cached pages
+
+/*
+ * Keeps a file we stream from (or to) out of the page cache ("-nocache", Linux only), so a bulk transfer does not
+ * evict what everything else on the host has cached. Every ctn_DROP_BEHIND_SIZE bytes, the pages behind the cursor
+ * are dropped with posix_fadvise(DONTNEED). Written pages must be clean to be dropped, so their writeback is
+ * started one window earlier with sync_file_range.
+ *
+ * It only advises the kernel, so files of any size (and any offset) are handled, unlike O_DIRECT
+ */
+class PageCacheDropper
+{
+public:
+  explicit PageCacheDropper(int fd, qint64 pos, bool writing);
+
+  void advance(qint64 bytes);
+  void finish();
+  qint64 dropped() const { return m_pos - m_start; }
+
+  static qint64 residentBytes(const QString &fileName);
+
+private:
+  int m_fd;
+  bool m_writing;
+  qint64 m_start;           //Position of the cursor when we started
+  qint64 m_pos;             //Position of the cursor
+  qint64 m_flushed;         //Bytes before it have been handed to writeback (when writing)
+  qint64 m_dropped;         //Bytes before it have been dropped
+
+  void drop(qint64 end);
+};
+
+#endif // PAGECACHE_H
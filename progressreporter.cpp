@@ -0,0 +1,239 @@
+/*
+* This file is part of GorgZorg, a simple multiplatform CLI network file transfer tool.
+* Copyright (C) 2021 Alexandre Albuquerque Arnt
+*
+* This program is distributed in the hope that it will be useful,
+* but WITHOUT ANY WARRANTY; without even the implied warranty of
+* MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.
+*
+* Source code hosted on: https://github.com/aarnt/gorgzorg
+*/
+
+#include "progressreporter.h"
+
+#include <QByteArray>
+
+#include <chrono>
+#include <cstdio>
+#include <cstdlib>
+
+#ifndef Q_OS_WIN
+#include <csignal>
+#include <sys/ioctl.h>
+#include <unistd.h>
+#endif
+
+#ifndef Q_OS_WIN
+//Escape sequence which gives the whole terminal back and erases the status line. It is also written when
+//GorgZorg exits or is interrupted in the middle of a transfer
+static char s_restore[64];
+static std::atomic<int> s_restoreSize(0);
+
+static void restoreTerminal()
+{
+  int size = s_restoreSize.exchange(0);
+  if (size <= 0) return;
+
+  ssize_t written = ::write(STDOUT_FILENO, s_restore, size_t(size));
+  Q_UNUSED(written)
+}
+
+static void restoreTerminalAndDie(int sig)
+{
+  restoreTerminal();
+  ::signal(sig, SIG_DFL);
+  ::raise(sig);
+}
+
+/*
+ * Returns the size of the terminal stdout is, or false if it is not one
+ */
+static bool terminalSize(int &rows, int &columns)
+{
+  struct winsize size;
+  if (!::isatty(STDOUT_FILENO) || ::ioctl(STDOUT_FILENO, TIOCGWINSZ, &size) != 0 || size.ws_row < 2) return false;
+
+  rows = size.ws_row;
+  columns = size.ws_col;
+  return true;
+}
+#endif
+
+/*
+ * Formats seconds as "m:ss" (or "h:mm:ss")
+ */
+static QString duration(qint64 seconds)
+{
+  QString secs = QString::number(seconds % 60).rightJustified(2, QLatin1Char('0'));
+  if (seconds < 3600) return QString::number(seconds / 60) + QLatin1Char(':') + secs;
+
+  QString mins = QString::number((seconds / 60) % 60).rightJustified(2, QLatin1Char('0'));
+  return QString::number(seconds / 3600) + QLatin1Char(':') + mins + QLatin1Char(':') + secs;
+}
+
+ProgressReporter::ProgressReporter(const QString &verb):
+  m_verb(verb), m_bytes(0), m_files(0), m_expected(0), m_stopping(false), m_terminal(false), m_rows(0), m_byteRate(0), m_fileRate(0)
+{
+}
+
+ProgressReporter::~ProgressReporter()
+{
+  stop();
+}
+
+void ProgressReporter::start()
+{
+  if (m_thread.joinable()) return;
+
+#ifndef Q_OS_WIN
+  int rows, columns;
+  m_terminal = terminalSize(rows, columns);
+
+  static bool handlersSet = false;
+  if (m_terminal && !handlersSet)
+  {
+    std::atexit(restoreTerminal);
+    ::signal(SIGINT, restoreTerminalAndDie);
+    ::signal(SIGTERM, restoreTerminalAndDie);
+    handlersSet = true;
+  }
+#endif
+
+  m_stopping = false;
+  m_thread = std::thread(&ProgressReporter::run, this);
+}
+
+/*
+ * Stops updating the line and gives the whole terminal back
+ */
+void ProgressReporter::stop()
+{
+  if (!m_thread.joinable()) return;
+
+  {
+    std::lock_guard<std::mutex> lock(m_mutex);
+    m_stopping = true;
+  }
+
+  m_wake.notify_one();
+  m_thread.join();
+
+#ifndef Q_OS_WIN
+  restoreTerminal();
+#endif
+  m_rows = 0;
+}
+
+/*
+ * Runs on the reporter thread: redraws the status line every ctn_PROGRESS_INTERVAL ms, until stopped
+ */
+void ProgressReporter::run()
+{
+  qint64 lastBytes = m_bytes.load(std::memory_order_relaxed);
+  qint64 lastFiles = m_files.load(std::memory_order_relaxed);
+  auto lastTime = std::chrono::steady_clock::now();
+  bool first = true;
+  int updates = 0;
+
+  std::unique_lock<std::mutex> lock(m_mutex);
+  while (!m_wake.wait_for(lock, std::chrono::milliseconds(ctn_PROGRESS_INTERVAL), [this] { return m_stopping; }))
+  {
+    qint64 bytes = m_bytes.load(std::memory_order_relaxed);
+    qint64 files = m_files.load(std::memory_order_relaxed);
+    qint64 expected = m_expected.load(std::memory_order_relaxed);
+    auto now = std::chrono::steady_clock::now();
+    double seconds = std::chrono::duration<double>(now - lastTime).count();
+    if (seconds <= 0) continue;
+
+    //Rates are smoothed, so a single slow interval (a big file being closed) does not make the line jump around
+    double byteRate = (bytes - lastBytes) / seconds;
+    double fileRate = (files - lastFiles) / seconds;
+    m_byteRate = first ? byteRate : 0.7 * m_byteRate + 0.3 * byteRate;
+    m_fileRate = first ? fileRate : 0.7 * m_fileRate + 0.3 * fileRate;
+    first = false;
+
+    lastBytes = bytes;
+    lastFiles = files;
+    lastTime = now;
+
+    if (m_terminal)
+    {
+#ifndef Q_OS_WIN
+      int rows, columns;
+      if (terminalSize(rows, columns)) draw(statusLine(bytes, files, expected), rows, columns);
+#endif
+    }
+    else if (++updates % ctn_PROGRESS_LOG_UPDATES == 0)
+    {
+      log(statusLine(bytes, files, expected));
+    }
+  }
+}
+
+QString ProgressReporter::statusLine(qint64 bytes, qint64 files, qint64 expected) const
+{
+  QString line = m_verb + QLatin1Char(' ') + QString::number((bytes / 1024.0) / 1024.0, 'f', 2) + QLatin1String(" MB (") +
+      QString::number(files) + QLatin1String(" files), ") +
+      QString::number((m_byteRate / 1024.0) / 1024.0, 'f', 2) + QLatin1String(" MB/s, ") +
+      QString::number(m_fileRate, 'f', 0) + QLatin1String(" files/s");
+
+  if (expected > bytes && m_byteRate >= 1)
+    line += QLatin1String(", ETA ") + duration(qint64((expected - bytes) / m_byteRate));
+
+  return line;
+}
+
+/*
+ * Writes line on the last row of the terminal. The rows above it are made the scrolling region, so whatever
+ * GorgZorg prints scrolls there and never mixes with the line. Everything goes out in a single write(2), so it
+ * can not be split by the output of the other threads, and the cursor is saved and restored around it
+ */
+void ProgressReporter::draw(const QString &line, int rows, int columns)
+{
+#ifndef Q_OS_WIN
+  QByteArray out;
+
+  //Make room for the line (or move it, after the terminal was resized)
+  if (rows != m_rows)
+  {
+    if (m_rows == 0)
+      out += "\n";
+    else
+      out += "\0337\033[" + QByteArray::number(m_rows) + ";1H\033[K\0338";
+
+    out += "\0337\033[1;" + QByteArray::number(rows - 1) + "r\0338";
+    if (m_rows == 0) out += "\033[1A";
+    m_rows = rows;
+
+    QByteArray restore = "\0337\033[r\033[" + QByteArray::number(rows) + ";1H\033[K\0338";
+    s_restoreSize.store(0);
+    qstrncpy(s_restore, restore.constData(), sizeof(s_restore));
+    s_restoreSize.store(int(qstrlen(s_restore)));
+  }
+
+  out += "\0337\033[" + QByteArray::number(rows) + ";1H\033[K" + line.left(columns - 1).toLatin1() + "\0338";
+  ssize_t written = ::write(STDOUT_FILENO, out.constData(), size_t(out.size()));
+  Q_UNUSED(written)
+#else
+  Q_UNUSED(line)
+  Q_UNUSED(rows)
+  Q_UNUSED(columns)
+#endif
+}
+
+/*
+ * Prints line as a line of its own, for when stdout is not a terminal. A whole line goes out in a single write,
+ * as the lines GorgZorg prints itself are only flushed when complete
+ */
+void ProgressReporter::log(const QString &line)
+{
+  QByteArray out = line.toLatin1() + "\n";
+
+#ifndef Q_OS_WIN
+  ssize_t written = ::write(STDOUT_FILENO, out.constData(), size_t(out.size()));
+  Q_UNUSED(written)
+#else
+  std::fwrite(out.constData(), 1, size_t(out.size()), stdout);
+  std::fflush(stdout);
+#endif
+}
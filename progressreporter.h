@@ -0,0 +1,68 @@
+/*
+* This file is part of GorgZorg, a simple multiplatform CLI network file transfer tool.
+* Copyright (C) 2021 Alexandre Albuquerque Arnt
+*
+* This program is distributed in the hope that it will be useful,
+* but WITHOUT ANY WARRANTY; without even the implied warranty of
+* MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.
+*
+* Source code hosted on: https://github.com/aarnt/gorgzorg
+*/
+
+#ifndef PROGRESSREPORTER_H
+#define PROGRESSREPORTER_H
+
+#include <QString>
+
+#include <atomic>
+#include <condition_variable>
+#include <mutex>
+#include <thread>
+
+const int ctn_PROGRESS_INTERVAL = 500; //ms between updates of the progress line
+const int ctn_PROGRESS_LOG_UPDATES = 10; //Updates between the lines printed when stdout is not a terminal
+
+/*
+ * Shows how a transfer is going (bytes, throughput, files per second and ETA) on a status line kept at the bottom
+ * of the terminal, below what GorgZorg prints. The line is drawn by its own thread every ctn_PROGRESS_INTERVAL ms;
+ * the data path only adds to atomic counters, so it never waits for the console.
+ *
+ * When stdout is not a terminal (a pipe, a log file) the line is printed as a plain line of its own every
+ * ctn_PROGRESS_LOG_UPDATES updates instead
+ */
+class ProgressReporter
+{
+public:
+  explicit ProgressReporter(const QString &verb);
+  ~ProgressReporter();
+
+  void start();
+  void stop();
+
+  void addBytes(qint64 bytes) { m_bytes.fetch_add(bytes, std::memory_order_relaxed); }
+  void addFile() { m_files.fetch_add(1, std::memory_order_relaxed); }
+  void expect(qint64 bytes) { m_expected.fetch_add(bytes, std::memory_order_relaxed); }
+
+private:
+  QString m_verb;           //"Gorged" or "Zorged"
+  std::atomic<qint64> m_bytes;
+  std::atomic<qint64> m_files;
+  std::atomic<qint64> m_expected; //Bytes announced so far, so the ETA is the time left to transfer them
+
+  std::thread m_thread;
+  std::mutex m_mutex;
+  std::condition_variable m_wake;
+  bool m_stopping;
+
+  bool m_terminal;          //Whether stdout was a terminal when the reporter started
+  int m_rows;               //Rows of the terminal when the scrolling region was set (0 means it was not)
+  double m_byteRate;        //Smoothed bytes per second
+  double m_fileRate;        //Smoothed files per second
+
+  void run();
+  QString statusLine(qint64 bytes, qint64 files, qint64 expected) const;
+  void draw(const QString &line, int rows, int columns);
+  void log(const QString &line);
+};
+
+#endif // PROGRESSREPORTER_H
@@ -0,0 +1,151 @@
+/*
+* This file is part of GorgZorg, a simple multiplatform CLI network file transfer tool.
+* Copyright (C) 2021 Alexandre Albuquerque Arnt
+*
+* This program is distributed in the hope that it will be useful,
+* but WITHOUT ANY WARRANTY; without even the implied warranty of
+* MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.
+*
+* Source code hosted on: https://github.com/aarnt/gorgzorg
+*/
+
+#include "protocol.h"
+
+#include <QIODevice>
+#include <QtEndian>
+
+QByteArray Protocol::message(MessageType type, quint32 sequence, const QByteArray &payload)
+{
+  QByteArray out(ctn_MESSAGE_PREFIX_SIZE, '\0');
+  qToBigEndian<quint32>(quint32(ctn_MESSAGE_PREFIX_SIZE - 4 + payload.size()), reinterpret_cast<uchar*>(out.data()));
+  out[4] = char(type);
+  qToBigEndian<quint32>(sequence, reinterpret_cast<uchar*>(out.data() + 5));
+
+  return out + payload;
+}
+
+/*
+ * Takes the next message from device, whatever the way its bytes arrived (split or glued to others).
+ * Returns false if it has not fully arrived yet, or setting invalid if the bytes can't be a message.
+ *
+ * Only the replies which carry data (a delta signature, a dedup bitmap or a sync manifest) may be large, and only
+ * once the hello exchange is done (handshaken). Anything else longer than a few KB is refused before it is buffered
+ */
+bool Protocol::readMessage(QIODevice *device, Message &message, bool &invalid, bool handshaken)
+{
+  invalid = false;
+  if (device->bytesAvailable() < ctn_MESSAGE_PREFIX_SIZE) return false;
+
+  QByteArray prefix = device->peek(ctn_MESSAGE_PREFIX_SIZE);
+  qint64 length = qFromBigEndian<quint32>(prefix.constData());
+  MessageType type = MessageType(quint8(prefix.at(4)));
+  qint64 maxLength = ctn_MAX_CONTROL_MESSAGE_SIZE;
+
+  if (handshaken && (type == MessageType::Delta || type == MessageType::Dedup || type == MessageType::Sync))
+    maxLength = ctn_MAX_MESSAGE_SIZE;
+
+  if (length < ctn_MESSAGE_PREFIX_SIZE - 4 || length > maxLength)
+  {
+    invalid = true;
+    return false;
+  }
+
+  if (device->bytesAvailable() < 4 + length) return false;
+
+  device->read(ctn_MESSAGE_PREFIX_SIZE);
+  message.type = type;
+  message.sequence = qFromBigEndian<quint32>(prefix.constData() + 5);
+  message.payload = device->read(length - (ctn_MESSAGE_PREFIX_SIZE - 4));
+
+  return true;
+}
+
+QByteArray Protocol::hello()
+{
+  QByteArray payload(10, '\0');
+  qToBigEndian<quint32>(ctn_PROTOCOL_MAGIC, reinterpret_cast<uchar*>(payload.data()));
+  qToBigEndian<quint16>(ctn_PROTOCOL_VERSION, reinterpret_cast<uchar*>(payload.data() + 4));
+  qToBigEndian<quint32>(capabilities(), reinterpret_cast<uchar*>(payload.data() + 6));
+
+  return message(MessageType::Hello, 0, payload);
+}
+
+bool Protocol::parseHello(const QByteArray &payload, quint16 &version, quint32 &capabilities)
+{
+  if (payload.size() < 10 || qFromBigEndian<quint32>(payload.constData()) != ctn_PROTOCOL_MAGIC) return false;
+
+  version = qFromBigEndian<quint16>(payload.constData() + 4);
+  capabilities = qFromBigEndian<quint32>(payload.constData() + 6);
+  return true;
+}
+
+quint32 Protocol::capabilities()
+{
+  quint32 caps = 0;
+  if (StreamCompressor::isAvailable(Codec::Zstd)) caps |= ctn_CAP_ZSTD;
+  if (StreamCompressor::isAvailable(Codec::Lz4)) caps |= ctn_CAP_LZ4;
+  if (BodyDigest::isAvailable(DigestType::Xxh3)) caps |= ctn_CAP_XXH3;
+
+  return caps;
+}
+
+QByteArray Protocol::header(quint32 sequence, const FileHeader &header)
+{
+  QByteArray payload(ctn_HEADER_FIELDS_SIZE, '\0');
+  uchar *fields = reinterpret_cast<uchar*>(payload.data());
+  qToBigEndian<qint64>(header.bodySize, fields);
+  fields[8] = header.flags;
+  fields[9] = quint8(header.mode);
+  fields[10] = quint8(header.digest);
+  fields[11] = quint8(header.codec);
+  qToBigEndian<qint64>(header.fileSize, fields + 12);
+  qToBigEndian<qint64>(header.offset, fields + 20);
+  qToBigEndian<qint64>(header.mtime, fields + 28);
+  qToBigEndian<quint64>(header.transferId, fields + 36);
+  payload.append(header.fileName.toUtf8());
+
+  return message(MessageType::Header, sequence, payload);
+}
+
+/*
+ * Returns false if a field is out of its range (like a mode, digest or codec this zorg has never heard of)
+ */
+bool Protocol::parseHeader(const QByteArray &payload, FileHeader &header)
+{
+  if (payload.size() < ctn_HEADER_FIELDS_SIZE) return false;
+
+  const char *fields = payload.constData();
+  quint8 mode = quint8(fields[9]);
+  quint8 digest = quint8(fields[10]);
+  quint8 codec = quint8(fields[11]);
+  if (mode > quint8(BodyMode::Dedup) || digest > quint8(DigestType::Xxh3) || codec > quint8(Codec::Lz4)) return false;
+
+  header.bodySize = qFromBigEndian<qint64>(fields);
+  header.flags = quint8(fields[8]);
+  header.mode = BodyMode(mode);
+  header.digest = DigestType(digest);
+  header.codec = Codec(codec);
+  header.fileSize = qFromBigEndian<qint64>(fields + 12);
+  header.offset = qFromBigEndian<qint64>(fields + 20);
+  header.mtime = qFromBigEndian<qint64>(fields + 28);
+  header.transferId = qFromBigEndian<quint64>(fields + 36);
+  header.fileName = QString::fromUtf8(fields + ctn_HEADER_FIELDS_SIZE, payload.size() - ctn_HEADER_FIELDS_SIZE);
+
+  return header.bodySize >= 0 && header.fileSize >= 0 && header.offset >= 0;
+}
+
+QByteArray Protocol::tune(int bufferSize)
+{
+  QByteArray payload(4, '\0');
+  qToBigEndian<quint32>(quint32(bufferSize), reinterpret_cast<uchar*>(payload.data()));
+
+  return message(MessageType::Tune, 0, payload);
+}
+
+bool Protocol::parseTune(const QByteArray &payload, int &bufferSize)
+{
+  if (payload.size() != 4) return false;
+
+  bufferSize = int(qFromBigEndian<quint32>(payload.constData()));
+  return bufferSize > 0;
+}
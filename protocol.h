@@ -0,0 +1,119 @@
+/*
+* This file is part of GorgZorg, a simple multiplatform CLI network file transfer tool.
+* Copyright (C) 2021 Alexandre Albuquerque Arnt
+*
+* This program is distributed in the hope that it will be useful,
+* but WITHOUT ANY WARRANTY; without even the implied warranty of
+* MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.
+*
+* Source code hosted on: https://github.com/aarnt/gorgzorg
+*/
+
+#ifndef PROTOCOL_H
+#define PROTOCOL_H
+
+#include "bodydigest.h"
+#include "streamcompressor.h"
+
+#include <QByteArray>
+#include <QString>
+
+class QIODevice;
+
+const quint32 ctn_PROTOCOL_MAGIC = 0x475a5247;          //"GZRG", the first bytes of a hello
+const quint16 ctn_PROTOCOL_VERSION = 1;
+const int ctn_MESSAGE_PREFIX_SIZE = 9;                  //Length (4 bytes), type (1 byte) and sequence (4 bytes)
+const qint64 ctn_MAX_MESSAGE_SIZE = 1024 * 1024 * 1024; //Anything longer is a broken (or hostile) peer
+const qint64 ctn_MAX_CONTROL_MESSAGE_SIZE = 16 * 1024;  //Limit of messages which carry no data (or come before the hello)
+
+//What a peer can do besides the basics of its protocol version (build time options)
+const quint32 ctn_CAP_ZSTD = 0x1;
+const quint32 ctn_CAP_LZ4 = 0x2;
+const quint32 ctn_CAP_XXH3 = 0x4;
+
+/*
+ * Every control message, on both directions, is: length of what follows (4 bytes), type (1 byte), sequence
+ * (4 bytes) and a payload. Gorg numbers its file headers and zorg answers each one with the same sequence:
+ * first an accept reply (Accept, Resume, Delta, Dedup or Sync, which carry data, or Cancel), then a
+ * Done/Error reply. File bodies are raw bytes following their Header, whose size it carries
+ */
+enum class MessageType: quint8
+{
+  Hello = 1,                //Magic, version (2 bytes) and capabilities (4 bytes). Gorg sends it first, zorg answers
+  Header,                   //A FileHeader: fixed size fields (ctn_HEADER_FIELDS_SIZE bytes) and the UTF-8 file name
+  Goodbye,                  //Gorg has nothing more to send
+  Accept,                   //Transfer id (8 bytes) of a striped file, which the headers of its stripes echo
+  Cancel,
+  Resume,                   //Size of our partial copy (8 bytes) and the checksum of its end
+  Delta,                    //Block size, block count (4 bytes each) and the signature of our copy
+  Dedup,                    //Chunk count (4 bytes) and a bitmap of the chunks we are missing
+  Sync,                     //Manifest of what we have under the synced dir
+  Done,
+  Error,
+  Tune                      //Socket buffer size (4 bytes) gorg wants zorg to receive with. Sent between files
+};
+
+const int ctn_HEADER_FIELDS_SIZE = 44;          //Body size, flags, mode, digest, codec, file size, offset, mtime and transfer id
+
+//Header flags
+const quint8 ctn_HEADER_SINGLE_TRANSFER = 0x1; //The file is not the first of a dir traverse
+const quint8 ctn_HEADER_DIR = 0x2;             //The name is a dir to be created, which has no body
+const quint8 ctn_HEADER_RESUME = 0x4;          //Zorg may answer with the size of a partial copy it already has
+const quint8 ctn_HEADER_SYNC = 0x8;            //Zorg answers the synced dir with the manifest of what it has under it
+const quint8 ctn_HEADER_DIGEST = 0x10;         //The body is followed by its digest
+
+//How the body of a file travels after its header
+enum class BodyMode: quint8
+{
+  Raw,                      //The bytes of the file, as they are
+  Striped,                  //Byte ranges sent through other connections (nothing follows the header here)
+  Stripe,                   //The byte range of a striped file starting at offset
+  Compressed,               //Compressed frames, until an end frame
+  Delta,                    //Delta ops against the copy zorg has, after zorg replied with its signature
+  Dedup                     //A chunk list, then the chunks zorg replied it is missing
+};
+
+//Everything zorg needs to know about a file. Options are typed fields, so the name is only ever a name
+struct FileHeader
+{
+  explicit FileHeader(const QString &name = QString(), qint64 size = 0, quint8 headerFlags = 0,
+                      BodyMode bodyMode = BodyMode::Raw):
+    fileName(name), bodySize(size), flags(headerFlags), mode(bodyMode) {}
+
+  QString fileName;
+  qint64 bodySize = 0;      //Bytes which follow the header, as the mode says
+  quint8 flags = 0;
+  BodyMode mode = BodyMode::Raw;
+  DigestType digest = DigestType::Xxh64; //Digest following the body, when flagged with ctn_HEADER_DIGEST
+  Codec codec = Codec::Zlib; //Codec of a compressed body
+  qint64 fileSize = 0;      //Size of the file, when its body is not the file itself (striped, compressed, delta, dedup)
+  qint64 offset = 0;        //Where the byte range of a stripe starts
+  qint64 mtime = -1;        //Mtime (ms since epoch) zorg saves the file with, or -1 to leave it alone
+  quint64 transferId = 0;   //Id zorg accepted the striped file of a stripe with
+};
+
+struct Message
+{
+  MessageType type;
+  quint32 sequence;
+  QByteArray payload;
+};
+
+class Protocol
+{
+public:
+  static QByteArray message(MessageType type, quint32 sequence, const QByteArray &payload = QByteArray());
+  static bool readMessage(QIODevice *device, Message &message, bool &invalid, bool handshaken);
+
+  static QByteArray hello();
+  static bool parseHello(const QByteArray &payload, quint16 &version, quint32 &capabilities);
+  static quint32 capabilities();
+
+  static QByteArray header(quint32 sequence, const FileHeader &header);
+  static bool parseHeader(const QByteArray &payload, FileHeader &header);
+
+  static QByteArray tune(int bufferSize);
+  static bool parseTune(const QByteArray &payload, int &bufferSize);
+};
+
+#endif // PROTOCOL_H
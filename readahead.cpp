@@ -0,0 +1,133 @@
+/*
+* This file is part of GorgZorg, a simple multiplatform CLI network file transfer tool.
+* Copyright (C) 2021 Alexandre Albuquerque Arnt
+*
+* This program is distributed in the hope that it will be useful,
+* but WITHOUT ANY WARRANTY; without even the implied warranty of
+* MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.
+*
+* Source code hosted on: https://github.com/aarnt/gorgzorg
+*/
+
+#include "readahead.h"
+
+#include <QIODevice>
+
+ReadAhead::ReadAhead(QIODevice *device):
+  m_device(device), m_offset(0), m_atEnd(false), m_emptyWaits(0), m_fullWaits(0),
+  m_written(0), m_taken(0), m_stop(false), m_readerWaiting(false), m_senderWaiting(false)
+{
+  for (QByteArray &slot: m_slots)
+    slot.reserve(ctn_READ_AHEAD_BLOCK_SIZE);
+
+  m_reader = std::thread(&ReadAhead::work, this);
+}
+
+ReadAhead::~ReadAhead()
+{
+  stop();
+}
+
+/*
+ * Stops the reader thread, wherever it is in the file
+ */
+void ReadAhead::stop()
+{
+  if (!m_reader.joinable()) return;
+
+  m_stop = true;
+  {
+    std::lock_guard<std::mutex> lock(m_mutex);
+    m_changed.notify_all();
+  }
+
+  m_reader.join();
+}
+
+/*
+ * Returns up to maxSize bytes of the file, waiting for the reader if it is behind. Returns an empty array at the end
+ */
+QByteArray ReadAhead::read(qint64 maxSize)
+{
+  if (m_atEnd) return QByteArray();
+
+  quint64 taken = m_taken.load(std::memory_order_relaxed);
+
+  if (m_written == taken)
+  {
+    m_emptyWaits++;
+    wait(m_senderWaiting, [this, taken]{ return m_written != taken; });
+  }
+
+  //The reader never touches a slot it has handed over, until we hand it back
+  const QByteArray &slot = m_slots[taken % ctn_READ_AHEAD_SLOTS];
+
+  if (slot.isEmpty())
+  {
+    m_atEnd = true;
+    return QByteArray();
+  }
+
+  //A copy of the piece asked for (or the slot itself, shared, when it is taken whole)
+  QByteArray block = slot.mid(m_offset, int(qMin(maxSize, qint64(slot.size() - m_offset))));
+  m_offset += block.size();
+
+  if (m_offset == slot.size())
+  {
+    m_offset = 0;
+    m_taken = taken + 1;
+    wake(m_readerWaiting);
+  }
+
+  return block;
+}
+
+void ReadAhead::work()
+{
+  while (true)
+  {
+    quint64 written = m_written.load(std::memory_order_relaxed);
+
+    if (written - m_taken == ctn_READ_AHEAD_SLOTS)
+    {
+      m_fullWaits++;
+      wait(m_readerWaiting, [this, written]{ return m_stop || written - m_taken < ctn_READ_AHEAD_SLOTS; });
+    }
+
+    if (m_stop) return;
+
+    //Slots are reused, but a block the sender took whole still shares its buffer, so refilling it detaches
+    //(allocates) then. Blocks taken in pieces are copies anyway
+    QByteArray &slot = m_slots[written % ctn_READ_AHEAD_SLOTS];
+    slot.resize(ctn_READ_AHEAD_BLOCK_SIZE);
+    qint64 size = m_device->read(slot.data(), slot.size());
+    slot.resize(int(qMax(size, qint64(0))));
+
+    //An empty slot tells the sender the file ended (or could not be read anymore)
+    bool atEnd = size <= 0;
+    m_written = written + 1;
+    wake(m_senderWaiting);
+
+    if (atEnd) return;
+  }
+}
+
+/*
+ * Sleeps until ready is true. The flag is raised before ready is checked under the mutex, so the other side
+ * either sees it and wakes us, or has already moved its index and ready sees it
+ */
+void ReadAhead::wait(std::atomic<bool> &waiting, const std::function<bool()> &ready)
+{
+  std::unique_lock<std::mutex> lock(m_mutex);
+  waiting = true;
+  m_changed.wait(lock, ready);
+  waiting = false;
+}
+
+void ReadAhead::wake(std::atomic<bool> &waiting)
+{
+  if (!waiting) return;
+
+  std::lock_guard<std::mutex> lock(m_mutex);
+  m_changed.notify_all();
+}
@@ -0,0 +1,69 @@
+/*
+* This file is part of GorgZorg, a simple multiplatform CLI network file transfer tool.
+* Copyright (C) 2021 Alexandre Albuquerque Arnt
+*
+* This program is distributed in the hope that it will be useful,
+* but WITHOUT ANY WARRANTY; without even the implied warranty of
+* MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.
+*
+* Source code hosted on: https://github.com/aarnt/gorgzorg
+*/
+
+#ifndef READAHEAD_H
+#define READAHEAD_H
+
+#include <QByteArray>
+
+#include <atomic>
+#include <condition_variable>
+#include <functional>
+#include <mutex>
+#include <thread>
+
+class QIODevice;
+
+const int ctn_READ_AHEAD_SLOTS = 4;                   //Blocks read ahead of the socket, so at most 4 MB are held
+const int ctn_READ_AHEAD_BLOCK_SIZE = 1024 * 1024;
+const qint64 ctn_READ_AHEAD_MIN_SIZE = 4 * 1024 * 1024; //Smaller files are read as they are sent
+
+/*
+ * Reads a file on its own thread into a ring of large blocks, ahead of the socket, so a disk stall does not
+ * stall the network nor the other way around. The ring is a single producer/single consumer queue: each side
+ * only moves its own index, and a side only sleeps (on a mutex) when the ring is empty or full.
+ *
+ * Once started, the device belongs to the reader thread until the ReadAhead is deleted
+ */
+class ReadAhead
+{
+public:
+  explicit ReadAhead(QIODevice *device);
+  ~ReadAhead();
+
+  QByteArray read(qint64 maxSize);
+  void stop();
+  inline qint64 emptyWaits() const { return m_emptyWaits; }
+  inline qint64 fullWaits() const { return m_fullWaits; }
+
+private:
+  QIODevice *m_device;
+  QByteArray m_slots[ctn_READ_AHEAD_SLOTS];
+  int m_offset;                         //Bytes of the oldest slot already handed to the sender
+  bool m_atEnd;
+  qint64 m_emptyWaits;                  //Times the sender found the ring empty (the disk was behind)
+  std::atomic<qint64> m_fullWaits;      //Times the reader found the ring full (the network was behind)
+
+  std::atomic<quint64> m_written;       //Slots filled by the reader
+  std::atomic<quint64> m_taken;         //Slots the sender is done with
+  std::atomic<bool> m_stop;
+  std::atomic<bool> m_readerWaiting;
+  std::atomic<bool> m_senderWaiting;
+  std::mutex m_mutex;
+  std::condition_variable m_changed;
+  std::thread m_reader;
+
+  void work();
+  void wait(std::atomic<bool> &waiting, const std::function<bool()> &ready);
+  void wake(std::atomic<bool> &waiting);
+};
+
+#endif // READAHEAD_H
@@ -0,0 +1,341 @@
+/*
+* This file is part of GorgZorg, a simple multiplatform CLI network file transfer tool.
+* Copyright (C) 2021 Alexandre Albuquerque Arnt
+*
+* This program is distributed in the hope that it will be useful,
+* but WITHOUT ANY WARRANTY; without even the implied warranty of
+* MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.
+*
+* Source code hosted on: https://github.com/aarnt/gorgzorg
+*/
+
+#include "streamcompressor.h"
+
+#include <QtEndian>
+
+#ifdef GORGZORG_HAVE_ZSTD
+  #include <zstd.h>
+#endif
+
+#ifdef GORGZORG_HAVE_LZ4
+  #include <lz4.h>
+  #include <lz4hc.h>
+#endif
+
+/*
+ * Builds the 9 byte header which precedes every frame payload
+ */
+static QByteArray frameHeader(bool compressed, quint32 payloadSize, quint32 rawSize)
+{
+  QByteArray header(ctn_FRAME_HEADER_SIZE, '\0');
+  header[0] = compressed ? 1 : 0;
+  qToBigEndian<quint32>(payloadSize, reinterpret_cast<uchar*>(header.data() + 1));
+  qToBigEndian<quint32>(rawSize, reinterpret_cast<uchar*>(header.data() + 5));
+  return header;
+}
+
+StreamCompressor::StreamCompressor(Codec codec, int level, int threads):
+  m_codec(codec), m_level(level), m_submitted(0), m_taken(0), m_stop(false),
+  m_rawBytes(0), m_frameBytes(0), m_skippedBytes(0)
+{
+  if (threads <= 0) threads = int(std::thread::hardware_concurrency());
+  if (threads <= 0) threads = 1;
+
+  for (int i=0; i<threads; ++i)
+    m_workers.emplace_back(&StreamCompressor::work, this);
+}
+
+StreamCompressor::~StreamCompressor()
+{
+  {
+    std::lock_guard<std::mutex> lock(m_mutex);
+    m_stop = true;
+  }
+
+  m_jobReady.notify_all();
+  for (std::thread &worker: m_workers)
+    worker.join();
+}
+
+/*
+ * Queues a raw block to be compressed by the next idle thread. Blocks of a group must be submitted in a row,
+ * so only the sampling state of the newest group is kept
+ */
+void StreamCompressor::submit(const QByteArray &raw, int group)
+{
+  {
+    std::lock_guard<std::mutex> lock(m_mutex);
+
+    if (group >= 0)
+    {
+      m_groups.erase(m_groups.begin(), m_groups.lower_bound(group));
+      m_groups.emplace(group, Group());
+    }
+
+    m_jobs.push_back(Job{m_submitted++, group, raw});
+  }
+
+  m_jobReady.notify_one();
+}
+
+/*
+ * Waits for the oldest submitted block and returns its frame, so frames always leave in stream order
+ */
+QByteArray StreamCompressor::takeFrame()
+{
+  if (pending() == 0) return QByteArray();
+
+  std::unique_lock<std::mutex> lock(m_mutex);
+  m_frameReady.wait(lock, [this]{ return m_frames.count(m_taken) > 0; });
+
+  auto it = m_frames.find(m_taken);
+  QByteArray frame = it->second;
+  m_frames.erase(it);
+  m_taken++;
+  return frame;
+}
+
+void StreamCompressor::work()
+{
+  while (true)
+  {
+    Job job;
+    bool sample = false;
+    bool skip = false;
+    {
+      std::unique_lock<std::mutex> lock(m_mutex);
+      m_jobReady.wait(lock, [this]{ return m_stop || !m_jobs.empty(); });
+      if (m_jobs.empty()) return;
+
+      job = m_jobs.front();
+      m_jobs.pop_front();
+
+      //Jobs leave in order, so the first blocks of a group are its samples
+      auto it = m_groups.find(job.group);
+      if (it != m_groups.end())
+      {
+        Group &group = it->second;
+
+        if (group.samples < ctn_SAMPLE_BLOCKS)
+        {
+          group.samples++;
+          sample = true;
+        }
+        else if (group.sampled == group.samples && group.incompressible == group.sampled)
+        {
+          skip = true;
+        }
+      }
+    }
+
+    const QByteArray &raw = job.raw;
+    QByteArray payload;
+    QByteArray frame;
+
+    if (!skip) payload = compressBlock(m_codec, m_level, raw);
+
+    //Blocks which do not shrink travel as they are
+    if (payload.isEmpty() || payload.size() >= raw.size())
+      frame = frameHeader(false, quint32(raw.size()), quint32(raw.size())) + raw;
+    else
+      frame = frameHeader(true, quint32(payload.size()), quint32(raw.size())) + payload;
+
+    {
+      std::lock_guard<std::mutex> lock(m_mutex);
+      m_frames[job.sequence] = frame;
+      m_rawBytes += raw.size();
+      m_frameBytes += frame.size();
+      if (skip) m_skippedBytes += raw.size();
+
+      auto it = m_groups.find(job.group);
+      if (sample && it != m_groups.end())
+      {
+        it->second.sampled++;
+        if (payload.isEmpty() || qint64(payload.size()) * 100 >= qint64(raw.size()) * ctn_INCOMPRESSIBLE_PERCENT)
+          it->second.incompressible++;
+      }
+    }
+
+    m_frameReady.notify_all();
+  }
+}
+
+qint64 StreamCompressor::rawBytes()
+{
+  std::lock_guard<std::mutex> lock(m_mutex);
+  return m_rawBytes;
+}
+
+qint64 StreamCompressor::frameBytes()
+{
+  std::lock_guard<std::mutex> lock(m_mutex);
+  return m_frameBytes;
+}
+
+qint64 StreamCompressor::skippedBytes()
+{
+  std::lock_guard<std::mutex> lock(m_mutex);
+  return m_skippedBytes;
+}
+
+/*
+ * The frame which tells the receiver the stream is over
+ */
+QByteArray StreamCompressor::endFrame()
+{
+  return frameHeader(false, 0, 0);
+}
+
+QString StreamCompressor::codecName(Codec codec)
+{
+  switch (codec)
+  {
+  case Codec::Zstd: return QStringLiteral("zstd");
+  case Codec::Lz4: return QStringLiteral("lz4");
+  default: return QStringLiteral("zlib");
+  }
+}
+
+bool StreamCompressor::codecFromName(const QString &name, Codec &codec)
+{
+  if (name == QLatin1String("zstd")) codec = Codec::Zstd;
+  else if (name == QLatin1String("lz4")) codec = Codec::Lz4;
+  else if (name == QLatin1String("zlib")) codec = Codec::Zlib;
+  else return false;
+
+  return true;
+}
+
+/*
+ * zlib always comes with Qt. zstd and lz4 depend on the libraries found at build time
+ */
+bool StreamCompressor::isAvailable(Codec codec)
+{
+  switch (codec)
+  {
+#ifdef GORGZORG_HAVE_ZSTD
+  case Codec::Zstd: return true;
+#endif
+#ifdef GORGZORG_HAVE_LZ4
+  case Codec::Lz4: return true;
+#endif
+  case Codec::Zlib: return true;
+  default: return false;
+  }
+}
+
+Codec StreamCompressor::defaultCodec()
+{
+#ifdef GORGZORG_HAVE_ZSTD
+  return Codec::Zstd;
+#elif defined(GORGZORG_HAVE_LZ4)
+  return Codec::Lz4;
+#else
+  return Codec::Zlib;
+#endif
+}
+
+/*
+ * Compresses a block with the given codec. A negative level means the codec default.
+ * Returns an empty array if the codec could not compress it
+ */
+QByteArray StreamCompressor::compressBlock(Codec codec, int level, const QByteArray &raw)
+{
+  QByteArray out;
+
+  if (codec == Codec::Zstd)
+  {
+#ifdef GORGZORG_HAVE_ZSTD
+    out.resize(int(ZSTD_compressBound(size_t(raw.size()))));
+    size_t res = ZSTD_compress(out.data(), size_t(out.size()), raw.constData(), size_t(raw.size()),
+                               level < 0 ? ZSTD_CLEVEL_DEFAULT : level);
+    if (ZSTD_isError(res)) return QByteArray();
+    out.resize(int(res));
+#endif
+  }
+  else if (codec == Codec::Lz4)
+  {
+#ifdef GORGZORG_HAVE_LZ4
+    out.resize(LZ4_compressBound(raw.size()));
+    int res;
+    //Levels above 1 use the slower high compression mode
+    if (level > 1)
+      res = LZ4_compress_HC(raw.constData(), out.data(), raw.size(), out.size(), level);
+    else
+      res = LZ4_compress_default(raw.constData(), out.data(), raw.size(), out.size());
+    if (res <= 0) return QByteArray();
+    out.resize(res);
+#endif
+  }
+  else
+  {
+    //qCompress prepends the raw size, which the frame header already carries
+    out = qCompress(raw, level < 0 ? -1 : qMin(level, 9));
+    if (out.size() > 4) out.remove(0, 4);
+    else out.clear();
+  }
+
+  return out;
+}
+
+/*
+ * Decompresses a frame payload which is known to expand to rawSize bytes
+ */
+bool StreamCompressor::decompressBlock(Codec codec, const char *data, int size, int rawSize, QByteArray &raw)
+{
+  if (rawSize <= 0 || rawSize > ctn_COMPRESSION_BLOCK_SIZE || size < 0) return false;
+  raw.resize(rawSize);
+
+  if (codec == Codec::Zstd)
+  {
+#ifdef GORGZORG_HAVE_ZSTD
+    size_t res = ZSTD_decompress(raw.data(), size_t(rawSize), data, size_t(size));
+    return !ZSTD_isError(res) && res == size_t(rawSize);
+#endif
+  }
+  else if (codec == Codec::Lz4)
+  {
+#ifdef GORGZORG_HAVE_LZ4
+    return LZ4_decompress_safe(data, raw.data(), size, rawSize) == rawSize;
+#endif
+  }
+  else
+  {
+    QByteArray in(4, '\0');
+    qToBigEndian<quint32>(quint32(rawSize), reinterpret_cast<uchar*>(in.data()));
+    in.append(data, size);
+    raw = qUncompress(in);
+    return raw.size() == rawSize;
+  }
+
+  return false;
+}
+
+/*
+ * Returns the largest payload a frame of rawSize bytes may carry with codec (the compressed block, or the raw
+ * block itself when it did not shrink)
+ */
+qint64 StreamCompressor::frameBound(Codec codec, int rawSize)
+{
+  qint64 bound = rawSize;
+
+  if (codec == Codec::Zstd)
+  {
+#ifdef GORGZORG_HAVE_ZSTD
+    bound = qint64(ZSTD_compressBound(size_t(rawSize)));
+#endif
+  }
+  else if (codec == Codec::Lz4)
+  {
+#ifdef GORGZORG_HAVE_LZ4
+    bound = LZ4_compressBound(rawSize);
+#endif
+  }
+  else
+  {
+    //The compressBound of zlib
+    bound = qint64(rawSize) + (rawSize >> 12) + (rawSize >> 14) + (rawSize >> 25) + 13;
+  }
+
+  return qMax(bound, qint64(rawSize));
+}
@@ -0,0 +1,105 @@
+/*
+* This file is part of GorgZorg, a simple multiplatform CLI network file transfer tool.
+* Copyright (C) 2021 Alexandre Albuquerque Arnt
+*
+* This program is distributed in the hope that it will be useful,
+* but WITHOUT ANY WARRANTY; without even the implied warranty of
+* MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.
+*
+* Source code hosted on: https://github.com/aarnt/gorgzorg
+*/
+
+#ifndef STREAMCOMPRESSOR_H
+#define STREAMCOMPRESSOR_H
+
+#include <QByteArray>
+#include <QString>
+
+#include <condition_variable>
+#include <deque>
+#include <map>
+#include <mutex>
+#include <thread>
+#include <vector>
+
+const int ctn_COMPRESSION_BLOCK_SIZE = 1024 * 1024; //Raw bytes compressed as an independent block
+const int ctn_FRAME_HEADER_SIZE = 9;                //Flags (1 byte), payload size and raw size (4 bytes each)
+const int ctn_SAMPLE_BLOCKS = 2;                    //Blocks of a file compressed to decide whether the rest is worth it
+const int ctn_INCOMPRESSIBLE_PERCENT = 95;          //Samples which keep this much of their size did not compress
+
+enum class Codec
+{
+  Zlib,
+  Zstd,
+  Lz4
+};
+
+/*
+ * Compresses independent blocks of a stream on a pool of threads and hands them back as frames, in order.
+ *
+ * A frame is a 9 byte header (flags, payload size and raw size, big endian) followed by the payload. Blocks
+ * which do not shrink are framed raw. A frame with zero raw size ends the stream.
+ *
+ * Blocks may belong to a group (a file of the stream): its first blocks are compressed as samples and, if none of
+ * them shrinks, the remaining blocks of the group skip compression (think of .jpg, .mp4 or .zst files)
+ */
+class StreamCompressor
+{
+public:
+  explicit StreamCompressor(Codec codec, int level, int threads);
+  ~StreamCompressor();
+
+  void submit(const QByteArray &raw, int group = -1);
+  QByteArray takeFrame();
+  int pending() const { return int(m_submitted - m_taken); }
+  int threads() const { return int(m_workers.size()); }
+  qint64 rawBytes();
+  qint64 frameBytes();
+  qint64 skippedBytes();
+
+  static QByteArray endFrame();
+  static QString codecName(Codec codec);
+  static bool codecFromName(const QString &name, Codec &codec);
+  static bool isAvailable(Codec codec);
+  static Codec defaultCodec();
+  static QByteArray compressBlock(Codec codec, int level, const QByteArray &raw);
+  static bool decompressBlock(Codec codec, const char *data, int size, int rawSize, QByteArray &raw);
+  static qint64 frameBound(Codec codec, int rawSize);
+
+private:
+  struct Job
+  {
+    qint64 sequence;
+    int group;
+    QByteArray raw;
+  };
+
+  //Sampling state of a group
+  struct Group
+  {
+    int samples = 0;          //Blocks handed out to be compressed as samples
+    int sampled = 0;          //Samples already compressed
+    int incompressible = 0;   //Samples which did not shrink
+  };
+
+  Codec m_codec;
+  int m_level;
+  qint64 m_submitted;
+  qint64 m_taken;
+  bool m_stop;
+  qint64 m_rawBytes;        //Raw bytes framed so far
+  qint64 m_frameBytes;      //Bytes of the frames built so far
+  qint64 m_skippedBytes;    //Raw bytes which skipped compression because their group did not compress
+
+  std::vector<std::thread> m_workers;
+  std::deque<Job> m_jobs;
+  std::map<qint64, QByteArray> m_frames;
+  std::map<int, Group> m_groups;
+  std::mutex m_mutex;
+  std::condition_variable m_jobReady;
+  std::condition_variable m_frameReady;
+
+  void work();
+};
+
+#endif // STREAMCOMPRESSOR_H
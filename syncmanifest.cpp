@@ -0,0 +1,178 @@
+/*
+* This file is part of GorgZorg, a simple multiplatform CLI network file transfer tool.
+* Copyright (C) 2021 Alexandre Albuquerque Arnt
+*
+* This program is distributed in the hope that it will be useful,
+* but WITHOUT ANY WARRANTY; without even the implied warranty of
+* MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.
+*
+* Source code hosted on: https://github.com/aarnt/gorgzorg
+*/
+
+#include "syncmanifest.h"
+
+#include <QFile>
+#include <QFileInfo>
+#include <QDir>
+#include <QDateTime>
+#include <QDirIterator>
+#include <QtEndian>
+
+#ifdef Q_OS_LINUX
+  #include <dirent.h>
+  #include <fcntl.h>
+  #include <sys/stat.h>
+  #include <unistd.h>
+#endif
+
+/*
+ * Every entry is the path size (2 bytes), the UTF-8 path, the size and the mtime (8 bytes each)
+ */
+static void appendEntry(QByteArray &out, const QByteArray &path, qint64 size, qint64 mtime)
+{
+  char field[8];
+  qToBigEndian<quint16>(quint16(path.size()), reinterpret_cast<uchar*>(field));
+  out.append(field, 2);
+  out.append(path);
+  qToBigEndian<qint64>(size, reinterpret_cast<uchar*>(field));
+  out.append(field, 8);
+  qToBigEndian<qint64>(mtime, reinterpret_cast<uchar*>(field));
+  out.append(field, 8);
+}
+
+#ifdef Q_OS_LINUX
+/*
+ * Walks the tree with openat/fstatat relative to each directory, so no full path is resolved again by the
+ * kernel, and directories are recognized by d_type without a stat. Takes ownership of dirFd
+ */
+static void walk(int dirFd, const QByteArray &prefix, QByteArray &out, int &count)
+{
+  DIR *dir = fdopendir(dirFd);
+  if (dir == nullptr)
+  {
+    close(dirFd);
+    return;
+  }
+
+  while (struct dirent *entry = readdir(dir))
+  {
+    const char *name = entry->d_name;
+    if (name[0] == '.' && (name[1] == '\0' || (name[1] == '.' && name[2] == '\0'))) continue;
+
+    QByteArray path = prefix + name;
+    bool isDir = entry->d_type == DT_DIR;
+    struct stat st;
+
+    if (!isDir)
+    {
+      if (fstatat(dirfd(dir), name, &st, AT_SYMLINK_NOFOLLOW) != 0) continue;
+      isDir = S_ISDIR(st.st_mode);
+    }
+
+    if (isDir)
+    {
+      appendEntry(out, path, ctn_MANIFEST_DIR_SIZE, 0);
+      count++;
+
+      int fd = openat(dirfd(dir), name, O_RDONLY | O_DIRECTORY | O_NOFOLLOW | O_CLOEXEC);
+      if (fd >= 0) walk(fd, path + '/', out, count);
+    }
+    else if (S_ISREG(st.st_mode))
+    {
+      appendEntry(out, path, qint64(st.st_size), qint64(st.st_mtim.tv_sec) * 1000 + st.st_mtim.tv_nsec / 1000000);
+      count++;
+    }
+  }
+
+  closedir(dir);
+}
+#endif
+
+/*
+ * Returns the compressed manifest of root (empty if root does not exist), storing the number of entries in count
+ */
+QByteArray SyncManifest::build(const QString &root, int *count)
+{
+  QByteArray out;
+  int entries = 0;
+
+#ifdef Q_OS_LINUX
+  //Names are kept as the bytes readdir returns, which match the UTF-8 names gorg sends
+  int fd = open(QFile::encodeName(root.isEmpty() ? QLatin1String(".") : root).constData(),
+                O_RDONLY | O_DIRECTORY | O_CLOEXEC);
+  if (fd >= 0) walk(fd, QByteArray(), out, entries);
+#else
+  QDir dir(root.isEmpty() ? QLatin1String(".") : root);
+
+  if (dir.exists())
+  {
+    QDirIterator it(dir.path(), QDir::AllEntries | QDir::Hidden | QDir::System | QDir::NoDotAndDotDot,
+                    QDirIterator::Subdirectories);
+
+    while (it.hasNext())
+    {
+      it.next();
+      QFileInfo info = it.fileInfo();
+      QByteArray path = dir.relativeFilePath(info.filePath()).toUtf8();
+
+      if (info.isDir())
+        appendEntry(out, path, ctn_MANIFEST_DIR_SIZE, 0);
+      else
+        appendEntry(out, path, info.size(), info.lastModified().toMSecsSinceEpoch());
+
+      entries++;
+    }
+  }
+#endif
+
+  if (count != nullptr) *count = entries;
+
+  //Paths of a tree repeat a lot, so even the fastest zlib level shrinks the manifest many times
+  return qCompress(out, 1);
+}
+
+/*
+ * Fills entries with the contents of a manifest built by build(). Returns false if it is malformed
+ */
+bool SyncManifest::parse(const QByteArray &data, QHash<QString, ManifestEntry> &entries)
+{
+  QByteArray raw = qUncompress(data);
+  if (raw.isEmpty() && data.size() != 4) return false; //Only an empty manifest expands to nothing
+
+  const char *p = raw.constData();
+  const char *end = p + raw.size();
+
+  while (p < end)
+  {
+    if (end - p < 2) return false;
+    int pathSize = qFromBigEndian<quint16>(p);
+    p += 2;
+    if (end - p < pathSize + 16) return false;
+
+    ManifestEntry entry;
+    QString path = QString::fromUtf8(p, pathSize);
+    p += pathSize;
+    entry.size = qFromBigEndian<qint64>(p);
+    entry.mtime = qFromBigEndian<qint64>(p + 8);
+    p += 16;
+
+    entries.insert(path, entry);
+  }
+
+  return true;
+}
+
+/*
+ * A file is unchanged when zorg has it with the same size and mtime. A directory, when zorg has it at all
+ */
+bool SyncManifest::isUnchanged(const QHash<QString, ManifestEntry> &entries, const QString &relativePath,
+                               bool isDir, qint64 size, qint64 mtime)
+{
+  auto it = entries.constFind(relativePath);
+  if (it == entries.constEnd()) return false;
+
+  if (isDir)
+    return it->size == ctn_MANIFEST_DIR_SIZE;
+
+  return it->size == size && it->mtime == mtime;
+}
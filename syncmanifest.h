@@ -0,0 +1,40 @@
+/*
+* This file is part of GorgZorg, a simple multiplatform CLI network file transfer tool.
+* Copyright (C) 2021 Alexandre Albuquerque Arnt
+*
+* This program is distributed in the hope that it will be useful,
+* but WITHOUT ANY WARRANTY; without even the implied warranty of
+* MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.
+*
+* Source code hosted on: https://github.com/aarnt/gorgzorg
+*/
+
+#ifndef SYNCMANIFEST_H
+#define SYNCMANIFEST_H
+
+#include <QByteArray>
+#include <QHash>
+#include <QString>
+
+const qint64 ctn_MANIFEST_DIR_SIZE = -1;  //Size of the directory entries of a manifest
+
+struct ManifestEntry
+{
+  qint64 size;              //ctn_MANIFEST_DIR_SIZE for directories
+  qint64 mtime;             //Last modification, in ms since epoch
+};
+
+/*
+ * What zorg already has under a directory: (relative path, size, mtime) of every entry, so a syncing gorg
+ * only sends new or changed files. Paths always use '/' and are relative to the synced directory
+ */
+class SyncManifest
+{
+public:
+  static QByteArray build(const QString &root, int *count = nullptr);
+  static bool parse(const QByteArray &data, QHash<QString, ManifestEntry> &entries);
+  static bool isUnchanged(const QHash<QString, ManifestEntry> &entries, const QString &relativePath,
+                          bool isDir, qint64 size, qint64 mtime);
+};
+
+#endif // SYNCMANIFEST_H
@@ -0,0 +1,434 @@
+/*
+* This file is part of GorgZorg, a simple multiplatform CLI network file transfer tool.
+* Copyright (C) 2021 Alexandre Albuquerque Arnt
+*
+* This program is distributed in the hope that it will be useful,
+* but WITHOUT ANY WARRANTY; without even the implied warranty of
+* MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.
+*
+* Source code hosted on: https://github.com/aarnt/gorgzorg
+*/
+
+#include "tararchive.h"
+
+#include <QDateTime>
+#include <QDir>
+#include <QDirIterator>
+#include <QFile>
+
+#include <algorithm>
+#include <cstring>
+
+const int ctn_TAR_BLOCK = 512;
+const int ctn_TAR_RECORD = 20 * ctn_TAR_BLOCK;    //Archives are padded to records, as GNU tar does
+const qint64 ctn_TAR_MAX_OCTAL_SIZE = 077777777777LL; //Largest size an ustar header can hold
+const uint ctn_TAR_MAX_OCTAL_ID = 07777777;          //Largest uid or gid an ustar header can hold
+
+/*
+ * Rounds value up to a multiple of the tar block size
+ */
+static qint64 padded(qint64 value)
+{
+  return (value + ctn_TAR_BLOCK - 1) / ctn_TAR_BLOCK * ctn_TAR_BLOCK;
+}
+
+/*
+ * Writes value as a zero filled, NUL terminated octal number in a header field of the given width
+ */
+static void writeOctal(char *field, int width, qint64 value)
+{
+  QByteArray octal = QByteArray::number(value, 8).rightJustified(width - 1, '0');
+  memcpy(field, octal.constData(), size_t(width - 1));
+  field[width - 1] = '\0';
+}
+
+/*
+ * Writes a string in a header field, truncating it if needed
+ */
+static void writeString(char *field, int width, const QByteArray &value)
+{
+  memcpy(field, value.constData(), size_t(qMin(width, value.size())));
+}
+
+/*
+ * Builds a pax "length key=value\n" record, where length counts its own digits
+ */
+static QByteArray paxRecord(const QByteArray &key, const QByteArray &value)
+{
+  int base = key.size() + value.size() + 3;
+  int length = base + QByteArray::number(base).size();
+  if (QByteArray::number(length).size() > QByteArray::number(base).size()) length++;
+
+  return QByteArray::number(length) + ' ' + key + '=' + value + '\n';
+}
+
+/*
+ * Converts Qt permissions to unix mode bits
+ */
+static int unixMode(QFile::Permissions permissions)
+{
+  int mode = 0;
+
+  if (permissions & QFile::ReadOwner) mode |= 0400;
+  if (permissions & QFile::WriteOwner) mode |= 0200;
+  if (permissions & QFile::ExeOwner) mode |= 0100;
+  if (permissions & QFile::ReadGroup) mode |= 040;
+  if (permissions & QFile::WriteGroup) mode |= 020;
+  if (permissions & QFile::ExeGroup) mode |= 010;
+  if (permissions & QFile::ReadOther) mode |= 04;
+  if (permissions & QFile::WriteOther) mode |= 02;
+  if (permissions & QFile::ExeOther) mode |= 01;
+
+  return mode;
+}
+
+/*
+ * TarArchive class methods
+ */
+
+TarArchive::TarArchive(const QString &path, const QString &nameFilter, QObject *parent):
+  QIODevice(parent), m_path(path), m_nameFilter(nameFilter)
+{
+  m_archiveSize = 0;
+  m_current = -1;
+  m_currentFile = nullptr;
+}
+
+TarArchive::~TarArchive()
+{
+  delete m_currentFile;
+}
+
+/*
+ * Scans the tree, so the archive layout and size are known, and opens the device
+ */
+bool TarArchive::open(OpenMode mode)
+{
+  if (mode & QIODevice::WriteOnly) return false;
+
+  scan();
+  return QIODevice::open(mode | QIODevice::Unbuffered);
+}
+
+void TarArchive::close()
+{
+  delete m_currentFile;
+  m_currentFile = nullptr;
+  m_current = -1;
+  QIODevice::close();
+}
+
+bool TarArchive::seek(qint64 pos)
+{
+  if (pos < 0 || pos > m_archiveSize) return false;
+  return QIODevice::seek(pos);
+}
+
+/*
+ * Collects the entries the archive will hold. Without a name filter this is the path itself and, if it is a
+ * directory, all its contents. With a name filter (ex: *.txt) these are the matching files below the path
+ */
+void TarArchive::scan()
+{
+  m_entries.clear();
+  m_archiveSize = 0;
+
+  if (m_nameFilter.isEmpty())
+  {
+    QFileInfo root(m_path);
+    addEntry(root);
+
+    if (root.isDir() && !root.isSymLink())
+      addTree(root.filePath());
+  }
+  else
+  {
+    QStringList files;
+    QDirIterator it(m_path, QStringList() << m_nameFilter, QDir::Files | QDir::Hidden | QDir::System, QDirIterator::Subdirectories);
+
+    while (it.hasNext())
+      files << it.next();
+
+    files.sort();
+
+    for (const QString &file: files)
+      addEntry(QFileInfo(file));
+  }
+
+  //End of archive is marked by two zeroed blocks, and the whole thing fills complete records
+  m_archiveSize += 2 * ctn_TAR_BLOCK;
+  m_archiveSize = (m_archiveSize + ctn_TAR_RECORD - 1) / ctn_TAR_RECORD * ctn_TAR_RECORD;
+}
+
+/*
+ * Adds every entry below dirPath, depth first and sorted by name, so archives are reproducible
+ */
+void TarArchive::addTree(const QString &dirPath)
+{
+  QDir dir(dirPath);
+  const QFileInfoList list = dir.entryInfoList(QDir::AllEntries | QDir::Hidden | QDir::System | QDir::NoDotAndDotDot, QDir::Name);
+
+  for (const QFileInfo &fi: list)
+  {
+    addEntry(fi);
+
+    if (fi.isDir() && !fi.isSymLink())
+      addTree(fi.filePath());
+  }
+}
+
+void TarArchive::addEntry(const QFileInfo &fi)
+{
+  char type;
+  qint64 size = 0;
+  QString name = entryName(fi.filePath());
+  QString linkTarget;
+
+  if (fi.isSymLink())
+  {
+    type = '2';
+    linkTarget = fi.symLinkTarget();
+  }
+  else if (fi.isDir())
+  {
+    type = '5';
+    if (!name.endsWith(QLatin1Char('/'))) name += QLatin1Char('/');
+  }
+  else if (fi.isFile())
+  {
+    type = '0';
+    size = fi.size();
+  }
+  else return; //Sockets, fifos and devices are not archived
+
+  Entry entry;
+  entry.path = fi.filePath();
+  entry.header = makeHeader(name, fi, type, size, linkTarget);
+  entry.size = size;
+  entry.offset = m_archiveSize;
+
+  m_entries.append(entry);
+  m_archiveSize += entry.header.size() + padded(size);
+}
+
+/*
+ * Name of a path inside the archive: no drive, no leading separator and no "." or ".." components, as tar does
+ */
+QString TarArchive::entryName(const QString &path)
+{
+  QString name = QDir::fromNativeSeparators(path);
+
+  if (name.size() > 1 && name.at(1) == QLatin1Char(':')) name.remove(0, 2);
+
+  QStringList parts = name.split(QLatin1Char('/'));
+  QStringList result;
+
+  for (const QString &part: parts)
+  {
+    if (part.isEmpty() || part == QLatin1String(".") || part == QLatin1String("..")) continue;
+    result << part;
+  }
+
+  return result.join(QLatin1Char('/'));
+}
+
+/*
+ * Builds the ustar header of an entry, preceded by a pax extended header when name, link, size or owner do not fit on it
+ */
+QByteArray TarArchive::makeHeader(const QString &name, const QFileInfo &fi, char type, qint64 size, const QString &linkTarget)
+{
+  QByteArray utf8Name = name.toUtf8();
+  QByteArray utf8Link = linkTarget.toUtf8();
+  QByteArray ustarName = utf8Name;
+  QByteArray ustarPrefix;
+  QByteArray pax;
+
+  //Try to split long names between the prefix and name fields
+  if (utf8Name.size() > 100)
+  {
+    int slash = -1;
+
+    //Going left the prefix gets shorter and the name longer (a trailing '/' of directories is kept in the name)
+    for (int i = utf8Name.size() - 2; i > 0; --i)
+    {
+      if (utf8Name.at(i) != '/') continue;
+      if (utf8Name.size() - i - 1 > 100) break;
+
+      if (i <= 155)
+      {
+        slash = i;
+        break;
+      }
+    }
+
+    if (slash > 0)
+    {
+      ustarPrefix = utf8Name.left(slash);
+      ustarName = utf8Name.mid(slash + 1);
+    }
+    else
+    {
+      pax += paxRecord("path", utf8Name);
+      ustarName = utf8Name.left(100);
+    }
+  }
+
+  if (utf8Link.size() > 100) pax += paxRecord("linkpath", utf8Link);
+  if (size > ctn_TAR_MAX_OCTAL_SIZE) pax += paxRecord("size", QByteArray::number(size));
+
+  uint uid = fi.ownerId();
+  uint gid = fi.groupId();
+  if (uid == uint(-2)) uid = 0;
+  if (gid == uint(-2)) gid = 0;
+  if (uid > ctn_TAR_MAX_OCTAL_ID) pax += paxRecord("uid", QByteArray::number(uid));
+  if (gid > ctn_TAR_MAX_OCTAL_ID) pax += paxRecord("gid", QByteArray::number(gid));
+
+  qint64 mtime = fi.lastModified().toMSecsSinceEpoch() / 1000;
+  if (mtime < 0) mtime = 0;
+
+  int mode = unixMode(fi.permissions());
+  if (mode == 0) mode = (type == '5') ? 0755 : 0644;
+
+  QByteArray block(ctn_TAR_BLOCK, '\0');
+  char *h = block.data();
+
+  writeString(h, 100, ustarName);
+  writeOctal(h + 100, 8, mode);
+  writeOctal(h + 108, 8, qMin(uid, ctn_TAR_MAX_OCTAL_ID));
+  writeOctal(h + 116, 8, qMin(gid, ctn_TAR_MAX_OCTAL_ID));
+  writeOctal(h + 124, 12, qMin(size, ctn_TAR_MAX_OCTAL_SIZE));
+  writeOctal(h + 136, 12, qMin(mtime, ctn_TAR_MAX_OCTAL_SIZE));
+  h[156] = type;
+  writeString(h + 157, 100, utf8Link);
+  memcpy(h + 257, "ustar\0" "00", 8);
+  writeString(h + 345, 155, ustarPrefix);
+
+  //The checksum is computed with its own field filled with spaces
+  memset(h + 148, ' ', 8);
+  unsigned int checksum = 0;
+  for (int i=0; i<ctn_TAR_BLOCK; ++i)
+    checksum += static_cast<unsigned char>(h[i]);
+
+  writeOctal(h + 148, 7, checksum);
+  h[155] = ' ';
+
+  if (pax.isEmpty()) return block;
+
+  //An extended header goes right before the entry it describes
+  QByteArray paxBlock(ctn_TAR_BLOCK, '\0');
+  char *p = paxBlock.data();
+
+  writeString(p, 100, QByteArray("PaxHeaders/") + ustarName.right(89));
+  writeOctal(p + 100, 8, 0644);
+  writeOctal(p + 108, 8, 0);
+  writeOctal(p + 116, 8, 0);
+  writeOctal(p + 124, 12, pax.size());
+  writeOctal(p + 136, 12, qMin(mtime, ctn_TAR_MAX_OCTAL_SIZE));
+  p[156] = 'x';
+  memcpy(p + 257, "ustar\0" "00", 8);
+
+  memset(p + 148, ' ', 8);
+  checksum = 0;
+  for (int i=0; i<ctn_TAR_BLOCK; ++i)
+    checksum += static_cast<unsigned char>(p[i]);
+
+  writeOctal(p + 148, 7, checksum);
+  p[155] = ' ';
+
+  pax.append(QByteArray(int(padded(pax.size()) - pax.size()), '\0'));
+
+  return paxBlock + pax + block;
+}
+
+/*
+ * Returns the index of the entry holding archive position pos, or -1 if pos is in the end of archive blocks
+ */
+int TarArchive::entryAt(qint64 pos) const
+{
+  if (m_current >= 0 && m_current < m_entries.size())
+  {
+    const Entry &e = m_entries.at(m_current);
+    if (pos >= e.offset && pos < e.offset + e.header.size() + padded(e.size)) return m_current;
+  }
+
+  auto it = std::upper_bound(m_entries.constBegin(), m_entries.constEnd(), pos,
+                             [](qint64 value, const Entry &e) { return value < e.offset; });
+
+  if (it == m_entries.constBegin()) return -1;
+
+  int index = int(it - m_entries.constBegin()) - 1;
+  const Entry &e = m_entries.at(index);
+
+  if (pos < e.offset + e.header.size() + padded(e.size)) return index;
+
+  return -1;
+}
+
+/*
+ * Produces the next archive bytes: headers, file contents (read right now from disk), paddings and the trailer
+ */
+qint64 TarArchive::readData(char *data, qint64 maxSize)
+{
+  qint64 pos = this->pos();
+  qint64 done = 0;
+
+  while (done < maxSize && pos < m_archiveSize)
+  {
+    int index = entryAt(pos);
+    qint64 chunk;
+
+    if (index < 0)
+    {
+      chunk = qMin(maxSize - done, m_archiveSize - pos);
+      memset(data + done, 0, size_t(chunk));
+    }
+    else
+    {
+      const Entry &e = m_entries.at(index);
+      qint64 rel = pos - e.offset;
+
+      if (index != m_current)
+      {
+        delete m_currentFile;
+        m_currentFile = nullptr;
+        m_current = index;
+      }
+
+      if (rel < e.header.size())
+      {
+        chunk = qMin(maxSize - done, e.header.size() - rel);
+        memcpy(data + done, e.header.constData() + rel, size_t(chunk));
+      }
+      else if (rel - e.header.size() < e.size)
+      {
+        rel -= e.header.size();
+        chunk = qMin(maxSize - done, e.size - rel);
+
+        if (m_currentFile == nullptr)
+        {
+          m_currentFile = new QFile(e.path);
+          m_currentFile->open(QFile::ReadOnly);
+        }
+
+        if (m_currentFile->pos() != rel) m_currentFile->seek(rel);
+
+        qint64 got = m_currentFile->isOpen() ? m_currentFile->read(data + done, chunk) : -1;
+        if (got < 0) got = 0;
+
+        //The file shrank after it was scanned, so let's keep the archive layout with zeros
+        if (got < chunk) memset(data + done + got, 0, size_t(chunk - got));
+      }
+      else
+      {
+        rel -= e.header.size() + e.size;
+        chunk = qMin(maxSize - done, padded(e.size) - e.size - rel);
+        memset(data + done, 0, size_t(chunk));
+      }
+    }
+
+    done += chunk;
+    pos += chunk;
+  }
+
+  return done;
+}
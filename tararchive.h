@@ -0,0 +1,69 @@
+/*
+* This file is part of GorgZorg, a simple multiplatform CLI network file transfer tool.
+* Copyright (C) 2021 Alexandre Albuquerque Arnt
+*
+* This program is distributed in the hope that it will be useful,
+* but WITHOUT ANY WARRANTY; without even the implied warranty of
+* MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.
+*
+* Source code hosted on: https://github.com/aarnt/gorgzorg
+*/
+
+#ifndef TARARCHIVE_H
+#define TARARCHIVE_H
+
+#include <QIODevice>
+#include <QFileInfo>
+#include <QVector>
+
+class QFile;
+
+/*
+ * A read only device which produces a ustar/pax archive of a path on the fly, while it is being read.
+ *
+ * The tree is scanned when the device is opened, so the archive size is known before its first byte is sent.
+ * Files which change size while being read are zero padded or cut to their scanned size, as tar does
+ */
+class TarArchive: public QIODevice
+{
+  Q_OBJECT
+public:
+  explicit TarArchive(const QString &path, const QString &nameFilter = QString(), QObject *parent = nullptr);
+  ~TarArchive();
+
+  bool open(OpenMode mode) override;
+  void close() override;
+  bool isSequential() const override { return false; }
+  bool seek(qint64 pos) override;
+  qint64 size() const override { return m_archiveSize; }
+  int entryCount() const { return m_entries.size(); }
+  int entryAt(qint64 pos) const;
+
+protected:
+  qint64 readData(char *data, qint64 maxSize) override;
+  qint64 writeData(const char *, qint64) override { return -1; }
+
+private:
+  struct Entry
+  {
+    QString path;           //Local path of the file
+    QByteArray header;      //Pax extended header (if needed) plus the ustar header
+    qint64 size;            //Number of data bytes (regular files only)
+    qint64 offset;          //Offset of the header inside the archive
+  };
+
+  QString m_path;
+  QString m_nameFilter;
+  QVector<Entry> m_entries;
+  qint64 m_archiveSize;
+  int m_current;            //Entry being read
+  QFile *m_currentFile;
+
+  void scan();
+  void addTree(const QString &dirPath);
+  void addEntry(const QFileInfo &fi);
+  static QString entryName(const QString &path);
+  static QByteArray makeHeader(const QString &name, const QFileInfo &fi, char type, qint64 size, const QString &linkTarget);
+};
+
+#endif // TARARCHIVE_H
@@ -0,0 +1,170 @@
+/*
+* This file is part of GorgZorg, a simple multiplatform CLI network file transfer tool.
+* Copyright (C) 2021 Alexandre Albuquerque Arnt
+*
+* This program is distributed in the hope that it will be useful,
+* but WITHOUT ANY WARRANTY; without even the implied warranty of
+* MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.
+*
+* Source code hosted on: https://github.com/aarnt/gorgzorg
+*/
+
+#include "transferstats.h"
+
+#include <QFile>
+#include <QJsonDocument>
+
+#include <algorithm>
+
+TransferStats::TransferStats(bool zorgSide):
+  m_zorgSide(zorgSide), m_phase(zorgSide ? Phase::Idle : Phase::Body), m_phaseStart(0), m_files(0), m_failedFiles(0),
+  m_dirs(0), m_bytes(0)
+{
+}
+
+void TransferStats::start()
+{
+  m_timer.start();
+  m_phaseStart = 0;
+}
+
+/*
+ * Time goes to phase from now on. Returns the phase it was going to, so it can be restored
+ */
+Phase TransferStats::enter(Phase phase)
+{
+  Phase previous = m_phase;
+  if (!m_timer.isValid() || phase == m_phase) return previous;
+
+  qint64 now = m_timer.nsecsElapsed();
+  m_phaseTime[int(m_phase)] += now - m_phaseStart;
+  m_phaseStart = now;
+  m_phase = phase;
+
+  return previous;
+}
+
+void TransferStats::headerSent(quint32 sequence, bool isDir)
+{
+  if (m_timer.isValid()) m_requests.insert(sequence, Request{m_timer.nsecsElapsed(), isDir});
+}
+
+void TransferStats::accepted(quint32 sequence)
+{
+  auto it = m_requests.constFind(sequence);
+  if (it != m_requests.constEnd()) m_acceptLatency.append((m_timer.nsecsElapsed() - it->time) / 1000);
+}
+
+/*
+ * The final reply (Done or Error) of the header with sequence was sent (or received)
+ */
+void TransferStats::done(quint32 sequence, bool ok)
+{
+  auto it = m_requests.find(sequence);
+  if (it == m_requests.end()) return;
+
+  m_doneLatency.append((m_timer.nsecsElapsed() - it->time) / 1000);
+
+  if (it->isDir)
+    m_dirs++;
+  else if (ok)
+    m_files++;
+  else
+    m_failedFiles++;
+
+  m_requests.erase(it);
+}
+
+QJsonObject TransferStats::toJson() const
+{
+  QVector<Phase> sidePhases;
+  if (m_zorgSide)
+    sidePhases << Phase::Idle << Phase::Header << Phase::Receive << Phase::Finish;
+  else
+    sidePhases << Phase::Scan << Phase::Archive << Phase::Connect << Phase::AckWait << Phase::Body << Phase::EndOfTransfer;
+
+  qint64 elapsed = m_timer.isValid() ? m_timer.nsecsElapsed() : 0;
+  double seconds = elapsed / 1e9;
+  QJsonObject phases;
+
+  //The current phase has not been counted yet
+  for (Phase phase: sidePhases)
+  {
+    qint64 time = m_phaseTime.value(int(phase)) + (phase == m_phase ? elapsed - m_phaseStart : 0);
+    phases.insert(phaseName(phase), time / 1e9);
+  }
+
+  QJsonObject report;
+  report.insert(QLatin1String("seconds"), seconds);
+  report.insert(QLatin1String("phaseSeconds"), phases);
+  report.insert(QLatin1String("files"), m_files);
+  report.insert(QLatin1String("failedFiles"), m_failedFiles);
+  report.insert(QLatin1String("dirs"), m_dirs);
+  report.insert(QLatin1String("bytes"), m_bytes);
+  report.insert(QLatin1String("mbPerSec"), seconds > 0 ? (m_bytes / (1024.0 * 1024.0)) / seconds : 0);
+  report.insert(QLatin1String("filesPerSec"), seconds > 0 ? m_files / seconds : 0);
+
+  if (m_zorgSide)
+  {
+    report.insert(QLatin1String("saveLatencyUs"), distribution(m_doneLatency));
+  }
+  else
+  {
+    report.insert(QLatin1String("acceptLatencyUs"), distribution(m_acceptLatency));
+    report.insert(QLatin1String("ackLatencyUs"), distribution(m_doneLatency));
+  }
+
+  return report;
+}
+
+bool TransferStats::write(const QString &fileName, const QJsonObject &report)
+{
+  QFile file(fileName);
+  QByteArray json = QJsonDocument(report).toJson();
+
+  return file.open(QFile::WriteOnly) && file.write(json) == json.size();
+}
+
+QString TransferStats::phaseName(Phase phase)
+{
+  switch (phase)
+  {
+  case Phase::Scan: return QLatin1String("scan");
+  case Phase::Archive: return QLatin1String("archive");
+  case Phase::Connect: return QLatin1String("connect");
+  case Phase::AckWait: return QLatin1String("ackWait");
+  case Phase::Body: return QLatin1String("body");
+  case Phase::EndOfTransfer: return QLatin1String("endOfTransfer");
+  case Phase::Idle: return QLatin1String("idle");
+  case Phase::Header: return QLatin1String("header");
+  case Phase::Receive: return QLatin1String("receive");
+  case Phase::Finish: return QLatin1String("finish");
+  }
+
+  return QString();
+}
+
+/*
+ * Count, mean and percentiles of values
+ */
+QJsonObject TransferStats::distribution(QVector<qint64> values)
+{
+  QJsonObject result;
+  result.insert(QLatin1String("count"), values.size());
+  if (values.isEmpty()) return result;
+
+  std::sort(values.begin(), values.end());
+  double sum = 0;
+  for (qint64 value: values) sum += value;
+
+  auto percentile = [&values](int p) { return values.at(int((qint64(values.size() - 1) * p) / 100)); };
+
+  result.insert(QLatin1String("min"), values.first());
+  result.insert(QLatin1String("mean"), sum / values.size());
+  result.insert(QLatin1String("p50"), percentile(50));
+  result.insert(QLatin1String("p90"), percentile(90));
+  result.insert(QLatin1String("p99"), percentile(99));
+  result.insert(QLatin1String("max"), values.last());
+
+  return result;
+}
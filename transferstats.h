@@ -0,0 +1,83 @@
+/*
+* This file is part of GorgZorg, a simple multiplatform CLI network file transfer tool.
+* Copyright (C) 2021 Alexandre Albuquerque Arnt
+*
+* This program is distributed in the hope that it will be useful,
+* but WITHOUT ANY WARRANTY; without even the implied warranty of
+* MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.
+*
+* Source code hosted on: https://github.com/aarnt/gorgzorg
+*/
+
+#ifndef TRANSFERSTATS_H
+#define TRANSFERSTATS_H
+
+#include <QElapsedTimer>
+#include <QHash>
+#include <QJsonObject>
+#include <QVector>
+
+//What a side of a transfer is doing. Every moment of a transfer is counted in exactly one of them
+enum class Phase
+{
+  Scan,                     //Gorg: waiting for the tree walker
+  Archive,                  //Gorg: preparing the "-tar"/"-zip" archive
+  Connect,                  //Gorg: connecting to zorg and saying hello
+  AckWait,                  //Gorg: waiting for zorg to accept or finish a file
+  Body,                     //Gorg: streaming file headers and bodies
+  EndOfTransfer,            //Gorg: saying goodbye
+  Idle,                     //Zorg: waiting for the client to send something
+  Header,                   //Zorg: parsing a header, creating its dirs and file
+  Receive,                  //Zorg: reading bodies and writing them to disk
+  Finish                    //Zorg: closing a received file and replying
+};
+
+/*
+ * Statistics of a transfer, for "--stats-json": the time spent on each phase, counts of files and bytes, and
+ * the distribution of the time between a file header and its replies (the ack round trip, seen from gorg, or
+ * the time zorg took to save the file, seen from zorg)
+ */
+class TransferStats
+{
+public:
+  explicit TransferStats(bool zorgSide = false);
+
+  void start();
+  Phase enter(Phase phase);
+
+  void addBytes(qint64 bytes) { m_bytes += bytes; }
+
+  void headerSent(quint32 sequence, bool isDir);
+  void accepted(quint32 sequence);
+  void done(quint32 sequence, bool ok);
+
+  QJsonObject toJson() const;
+  static bool write(const QString &fileName, const QJsonObject &report);
+
+private:
+  //A file header still waiting for its final reply
+  struct Request
+  {
+    qint64 time;            //ns (on m_timer) it was sent (or received)
+    bool isDir;
+  };
+
+  bool m_zorgSide;
+  QElapsedTimer m_timer;
+  Phase m_phase;
+  qint64 m_phaseStart;      //ns (on m_timer) the current phase was entered
+  QHash<int, qint64> m_phaseTime; //ns spent on each phase
+  QHash<quint32, Request> m_requests;
+  QVector<qint64> m_acceptLatency; //us
+  QVector<qint64> m_doneLatency; //us
+
+  qint64 m_files;
+  qint64 m_failedFiles;
+  qint64 m_dirs;
+  qint64 m_bytes;
+
+  static QString phaseName(Phase phase);
+  static QJsonObject distribution(QVector<qint64> values);
+};
+
+#endif // TRANSFERSTATS_H
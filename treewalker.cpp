@@ -0,0 +1,291 @@
+/*
+* This file is part of GorgZorg, a simple multiplatform CLI network file transfer tool.
+* Copyright (C) 2021 Alexandre Albuquerque Arnt
+*
+* This program is distributed in the hope that it will be useful,
+* but WITHOUT ANY WARRANTY; without even the implied warranty of
+* MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.
+*
+* Source code hosted on: https://github.com/aarnt/gorgzorg
+*/
+
+#include "treewalker.h"
+
+#include <QDir>
+#include <QFile>
+#include <QFileInfo>
+#include <QDateTime>
+
+#include <algorithm>
+
+#ifdef Q_OS_LINUX
+  #include <dirent.h>
+  #include <fcntl.h>
+  #include <sys/stat.h>
+#endif
+
+TreeWalker::Dir::~Dir()
+{
+  for (Item &item: items)
+    delete item.subdir;
+}
+
+TreeWalker::TreeWalker(const QString &root, const QStringList &nameFilters, int threads, bool ordered):
+  m_ordered(ordered), m_stop(false), m_pending(1), m_unread(0), m_wanted(nullptr)
+{
+  //Name filters match as QDir's do: wildcards, case insensitive
+  for (const QString &filter: nameFilters)
+  {
+    m_nameFilters.append(QRegularExpression(QRegularExpression::wildcardToRegularExpression(filter),
+                                            QRegularExpression::CaseInsensitiveOption));
+  }
+
+  Dir *dir = new Dir;
+  dir->path = QDir::cleanPath(root);
+  m_queue.push_back(dir);
+  if (m_ordered) m_path.emplace_back(dir, 0);
+
+  if (threads <= 0) threads = int(std::thread::hardware_concurrency());
+  if (threads <= 0) threads = 1;
+
+  for (int i=0; i<threads; ++i)
+    m_workers.emplace_back(&TreeWalker::work, this);
+}
+
+TreeWalker::~TreeWalker()
+{
+  {
+    std::lock_guard<std::mutex> lock(m_mutex);
+    m_stop = true;
+  }
+
+  m_dirQueued.notify_all();
+  for (std::thread &worker: m_workers)
+    worker.join();
+
+  //Ordered, every dir belongs to the item it was found in, and the sender owns the dirs it is in.
+  //Otherwise the queue owns the dirs nobody scanned
+  if (m_ordered)
+  {
+    for (auto &level: m_path)
+      delete level.first;
+  }
+  else
+  {
+    for (Dir *dir: m_queue)
+      delete dir;
+  }
+}
+
+/*
+ * Waits for the next entry of the tree. Returns false when the whole tree has been walked
+ */
+bool TreeWalker::next(WalkEntry &entry)
+{
+  std::unique_lock<std::mutex> lock(m_mutex);
+
+  if (!m_ordered)
+  {
+    m_dirScanned.wait(lock, [this]{ return !m_ready.empty() || m_pending == 0; });
+    if (m_ready.empty()) return false;
+
+    entry = m_ready.front();
+    m_ready.pop_front();
+    lock.unlock();
+
+    //A thread may be waiting for room to scan more
+    m_dirQueued.notify_one();
+    return true;
+  }
+
+  while (!m_path.empty())
+  {
+    Dir *dir = m_path.back().first;
+
+    if (!dir->scanned)
+    {
+      //Threads which scanned too far ahead must take this dir next
+      m_wanted = dir;
+      m_dirQueued.notify_all();
+      m_dirScanned.wait(lock, [dir]{ return dir->scanned; });
+      m_wanted = nullptr;
+    }
+
+    size_t index = m_path.back().second++;
+    if (index == dir->items.size())
+    {
+      delete dir;
+      m_path.pop_back();
+      continue;
+    }
+
+    //A thread may be waiting for room to scan more
+    if (m_unread-- == size_t(ctn_WALK_QUEUE_SIZE)) m_dirQueued.notify_one();
+
+    //The contents of a dir come right after it, so the sender walks into it now
+    Item &item = dir->items[index];
+    if (item.matches) entry = item.entry;
+
+    if (item.subdir != nullptr)
+    {
+      m_path.emplace_back(item.subdir, 0);
+      item.subdir = nullptr;
+    }
+
+    if (item.matches) return true;
+  }
+
+  return false;
+}
+
+void TreeWalker::work()
+{
+  while (true)
+  {
+    Dir *dir;
+    {
+      //Scanning too far ahead of the sender would only fill memory. Ordered, the dir the sender waits for
+      //is still scanned, or it would never catch up
+      std::unique_lock<std::mutex> lock(m_mutex);
+      m_dirQueued.wait(lock, [this]{
+        if (m_stop || m_pending == 0) return true;
+        if (m_queue.empty()) return false;
+        if (!m_ordered) return m_ready.size() < size_t(ctn_WALK_QUEUE_SIZE);
+
+        return m_unread < size_t(ctn_WALK_QUEUE_SIZE) ||
+            std::find(m_queue.begin(), m_queue.end(), m_wanted) != m_queue.end(); });
+      if (m_stop || m_queue.empty()) return;
+
+      auto it = m_queue.end() - 1;
+      if (m_ordered && m_unread >= size_t(ctn_WALK_QUEUE_SIZE))
+        it = std::find(m_queue.begin(), m_queue.end(), m_wanted);
+
+      dir = *it;
+      m_queue.erase(it);
+    }
+
+    scan(dir);
+
+    {
+      std::lock_guard<std::mutex> lock(m_mutex);
+
+      //Subdirs are queued in reverse, so the first one is the next to be scanned
+      for (auto it = dir->items.rbegin(); it != dir->items.rend(); ++it)
+      {
+        if (it->subdir == nullptr) continue;
+
+        m_queue.push_back(it->subdir);
+        m_pending++;
+      }
+
+      if (m_ordered)
+      {
+        dir->scanned = true;
+        m_unread += dir->items.size();
+      }
+      else
+      {
+        for (Item &item: dir->items)
+        {
+          if (item.matches) m_ready.push_back(item.entry);
+          item.subdir = nullptr;  //The queue owns it now
+        }
+
+        delete dir;
+      }
+
+      m_pending--;
+    }
+
+    m_dirQueued.notify_all();
+    m_dirScanned.notify_all();
+  }
+}
+
+/*
+ * Lists the entries of dir, with what the sender needs to know about each one
+ */
+void TreeWalker::scan(Dir *dir)
+{
+#ifdef Q_OS_LINUX
+  //Dirs are recognized by d_type, and the rest stat'ed relative to their dir, so no full path is resolved again
+  DIR *handle = opendir(QFile::encodeName(dir->path).constData());
+  if (handle == nullptr) return;
+
+  int dirFd = dirfd(handle);
+
+  while (struct dirent *entry = readdir(handle))
+  {
+    const char *name = entry->d_name;
+    if (name[0] == '.' && (name[1] == '\0' || (name[1] == '.' && name[2] == '\0'))) continue;
+
+    if (entry->d_type == DT_DIR)
+    {
+      addItem(dir, QFile::decodeName(name), true, true, 0, 0);
+      continue;
+    }
+
+    struct stat st;
+    bool walkInto = false;
+    bool found = fstatat(dirFd, name, &st, AT_SYMLINK_NOFOLLOW) == 0;
+
+    if (found)
+    {
+      walkInto = S_ISDIR(st.st_mode);
+
+      //Like QFileInfo, a symlink is taken for its target
+      if (S_ISLNK(st.st_mode)) found = fstatat(dirFd, name, &st, 0) == 0;
+    }
+
+    if (!found)
+      addItem(dir, QFile::decodeName(name), false, false, 0, 0);
+    else
+      addItem(dir, QFile::decodeName(name), S_ISDIR(st.st_mode), walkInto, qint64(st.st_size),
+              qint64(st.st_mtim.tv_sec) * 1000 + st.st_mtim.tv_nsec / 1000000);
+  }
+
+  closedir(handle);
+#else
+  const QFileInfoList infos = QDir(dir->path).entryInfoList(QDir::AllEntries | QDir::Hidden | QDir::System | QDir::NoDotAndDotDot);
+
+  for (const QFileInfo &info: infos)
+  {
+    addItem(dir, info.fileName(), info.isDir(), info.isDir() && !info.isSymLink(), info.size(),
+            info.lastModified().toMSecsSinceEpoch());
+  }
+#endif
+
+  if (m_ordered)
+  {
+    std::sort(dir->items.begin(), dir->items.end(),
+              [](const Item &a, const Item &b){ return a.entry.path < b.entry.path; });
+  }
+}
+
+void TreeWalker::addItem(Dir *dir, const QString &name, bool isDir, bool walkInto, qint64 size, qint64 mtime)
+{
+  Item item;
+  item.entry.path = dir->path == QLatin1String("/") ? dir->path + name : dir->path + QLatin1Char('/') + name;
+  item.entry.isDir = isDir;
+  item.entry.size = isDir ? 0 : size;
+  item.entry.mtime = mtime;
+  item.matches = m_nameFilters.isEmpty();
+  item.subdir = nullptr;
+
+  for (const QRegularExpression &filter: m_nameFilters)
+  {
+    if (filter.match(name).hasMatch())
+    {
+      item.matches = true;
+      break;
+    }
+  }
+
+  if (walkInto)
+  {
+    item.subdir = new Dir;
+    item.subdir->path = item.entry.path;
+  }
+
+  dir->items.push_back(item);
+}
@@ -0,0 +1,92 @@
+/*
+* This file is part of GorgZorg, a simple multiplatform CLI network file transfer tool.
+* Copyright (C) 2021 Alexandre Albuquerque Arnt
+*
+* This program is distributed in the hope that it will be useful,
+* but WITHOUT ANY WARRANTY; without even the implied warranty of
+* MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.
+*
+* Source code hosted on: https://github.com/aarnt/gorgzorg
+*/
+
+#ifndef TREEWALKER_H
+#define TREEWALKER_H
+
+#include <QString>
+#include <QStringList>
+#include <QVector>
+#include <QRegularExpression>
+
+#include <condition_variable>
+#include <deque>
+#include <mutex>
+#include <thread>
+#include <utility>
+#include <vector>
+
+const int ctn_WALK_QUEUE_SIZE = 4096;     //Entries scanned ahead of the sender
+
+struct WalkEntry
+{
+  QString path;             //Path under the walked root, as QDirIterator gives it
+  bool isDir;               //Symlinks are taken for their targets, but never walked into
+  qint64 size;
+  qint64 mtime;             //Last modification, in ms since epoch
+};
+
+/*
+ * Walks a tree on a pool of threads, each one scanning a different dir, while the sender takes the entries
+ * already found. A dir always comes before its contents.
+ *
+ * By default entries come as soon as their dir is scanned, so their order depends on the timing of the threads.
+ * When ordered, they come depth first and sorted by name, as if a single thread had walked the tree
+ */
+class TreeWalker
+{
+public:
+  explicit TreeWalker(const QString &root, const QStringList &nameFilters, int threads, bool ordered);
+  ~TreeWalker();
+
+  bool next(WalkEntry &entry);
+
+private:
+  struct Dir;
+
+  //An entry of a scanned dir, which is only yielded if it matches the name filters
+  struct Item
+  {
+    WalkEntry entry;
+    bool matches;
+    Dir *subdir;            //The dir to walk into, if entry is a real dir
+  };
+
+  struct Dir
+  {
+    QString path;
+    bool scanned = false;
+    std::vector<Item> items;
+
+    ~Dir();
+  };
+
+  bool m_ordered;
+  bool m_stop;
+  int m_pending;            //Dirs queued or being scanned
+  size_t m_unread;          //Items of scanned dirs the sender has not reached yet (ordered)
+  Dir *m_wanted;            //Dir the sender waits to be scanned, which is scanned even when too far ahead (ordered)
+  QVector<QRegularExpression> m_nameFilters;
+
+  std::vector<std::thread> m_workers;
+  std::vector<Dir*> m_queue;                    //Dirs waiting for a thread, taken from the back (depth first)
+  std::deque<WalkEntry> m_ready;                //Entries the sender has not taken yet (relaxed order)
+  std::vector<std::pair<Dir*, size_t>> m_path;  //Dirs the sender is in, and its next item in each one (ordered)
+  std::mutex m_mutex;
+  std::condition_variable m_dirQueued;
+  std::condition_variable m_dirScanned;
+
+  void work();
+  void scan(Dir *dir);
+  void addItem(Dir *dir, const QString &name, bool isDir, bool walkInto, qint64 size, qint64 mtime);
+};
+
+#endif // TREEWALKER_H
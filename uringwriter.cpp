@@ -0,0 +1,247 @@
+/*
+* This file is part of GorgZorg, a simple multiplatform CLI network file transfer tool.
+* Copyright (C) 2021 Alexandre Albuquerque Arnt
+*
+* This program is distributed in the hope that it will be useful,
+* but WITHOUT ANY WARRANTY; without even the implied warranty of
+* MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.
+*
+* Source code hosted on: https://github.com/aarnt/gorgzorg
+*/
+
+#include "uringwriter.h"
+
+#include <QFile>
+
+#ifdef GORGZORG_HAVE_URING
+  #include <liburing.h>
+  #include <errno.h>
+  #include <fcntl.h>
+  #include <sys/eventfd.h>
+  #include <unistd.h>
+#endif
+
+//The low bits of the user data of an operation tell which one of the operations of its file completed
+static const quint64 s_tagOpen = 0;
+static const quint64 s_tagWrite = 1;
+static const quint64 s_tagClose = 2;
+static const quint64 s_tagMask = 3;
+
+/*
+ * Sets up the ring. If the kernel lacks io_uring (or the operations we need), isReady() is false and
+ * nothing else may be called
+ */
+UringWriter::UringWriter(): m_ring(nullptr), m_eventFd(-1), m_ready(false)
+{
+#ifdef GORGZORG_HAVE_URING
+  m_ring = new io_uring;
+
+  if (io_uring_queue_init(ctn_URING_QUEUE_DEPTH, m_ring, 0) != 0)
+  {
+    delete m_ring;
+    m_ring = nullptr;
+    return;
+  }
+
+  io_uring_probe *probe = io_uring_get_probe_ring(m_ring);
+  bool supported = probe != nullptr && io_uring_opcode_supported(probe, IORING_OP_OPENAT) &&
+      io_uring_opcode_supported(probe, IORING_OP_WRITE) && io_uring_opcode_supported(probe, IORING_OP_CLOSE);
+  if (probe != nullptr) io_uring_free_probe(probe);
+
+  m_eventFd = eventfd(0, EFD_NONBLOCK | EFD_CLOEXEC);
+  m_ready = supported && m_eventFd >= 0 && io_uring_register_eventfd(m_ring, m_eventFd) == 0;
+#endif
+}
+
+UringWriter::~UringWriter()
+{
+#ifdef GORGZORG_HAVE_URING
+  if (m_ring == nullptr) return;
+
+  //Files still in flight must reach the disk
+  if (m_ready)
+  {
+    submit();
+    while (!isIdle()) reap(true);
+  }
+
+  io_uring_queue_exit(m_ring);
+  delete m_ring;
+  if (m_eventFd >= 0) close(m_eventFd);
+
+  for (File *file: m_files)
+    delete file;
+#endif
+}
+
+bool UringWriter::isAvailable()
+{
+#ifdef GORGZORG_HAVE_URING
+  return true;
+#else
+  return false;
+#endif
+}
+
+/*
+ * Queues the creation of path with data as its contents. It is only submitted by the next submit() (or when
+ * the ring is full), so the files of a burst go to the kernel together
+ */
+void UringWriter::write(const QString &path, const QByteArray &data, quint32 sequence)
+{
+#ifdef GORGZORG_HAVE_URING
+  //Too many files in flight, so let's wait for the oldest ones
+  while (int(m_files.size()) >= ctn_URING_MAX_FILES)
+  {
+    submit();
+    reap(true);
+  }
+
+  File *file = new File;
+  file->path = QFile::encodeName(path);
+  file->data = data;
+  file->sequence = sequence;
+  file->fd = -1;
+  file->stage = Stage::Opening;
+  file->ok = true;
+  m_files.push_back(file);
+
+  io_uring_sqe *sqe = io_uring_get_sqe(m_ring);
+  if (sqe == nullptr)
+  {
+    submit();
+    sqe = io_uring_get_sqe(m_ring);
+  }
+
+  io_uring_prep_openat(sqe, AT_FDCWD, file->path.constData(), O_WRONLY | O_CREAT | O_TRUNC | O_CLOEXEC, 0666);
+  sqe->user_data = reinterpret_cast<quint64>(file) | s_tagOpen;
+#else
+  Q_UNUSED(path)
+  Q_UNUSED(data)
+  Q_UNUSED(sequence)
+#endif
+}
+
+void UringWriter::submit()
+{
+#ifdef GORGZORG_HAVE_URING
+  if (io_uring_sq_ready(m_ring) > 0) io_uring_submit(m_ring);
+#endif
+}
+
+/*
+ * Handles every completion already there (waiting for at least one, if wait is true), then submits
+ * the operations they started
+ */
+void UringWriter::reap(bool wait)
+{
+#ifdef GORGZORG_HAVE_URING
+  eventfd_t count;
+  eventfd_read(m_eventFd, &count);
+
+  io_uring_cqe *cqe;
+
+  //Files at the front which are not done have operations in flight, so there is always something to wait for
+  if (wait && !isIdle() && m_files.front()->stage != Stage::Done && io_uring_wait_cqe(m_ring, &cqe) == 0)
+  {
+    complete(cqe->user_data, cqe->res);
+    io_uring_cqe_seen(m_ring, cqe);
+  }
+
+  while (io_uring_peek_cqe(m_ring, &cqe) == 0)
+  {
+    complete(cqe->user_data, cqe->res);
+    io_uring_cqe_seen(m_ring, cqe);
+  }
+
+  while (!m_files.empty() && m_files.front()->stage == Stage::Done)
+  {
+    File *file = m_files.front();
+    m_files.pop_front();
+    m_results.append(Result{file->sequence, QFile::decodeName(file->path), file->ok});
+    delete file;
+  }
+
+  submit();
+#else
+  Q_UNUSED(wait)
+#endif
+}
+
+/*
+ * Returns the files finished since the last call, in the order they were written
+ */
+QVector<UringWriter::Result> UringWriter::takeResults()
+{
+  QVector<Result> results;
+  results.swap(m_results);
+
+  return results;
+}
+
+void UringWriter::complete(quint64 userData, int result)
+{
+#ifdef GORGZORG_HAVE_URING
+  File *file = reinterpret_cast<File *>(userData & ~s_tagMask);
+
+  switch (userData & s_tagMask)
+  {
+  case s_tagOpen:
+    if (result < 0)
+    {
+      file->ok = false;
+      file->stage = Stage::Done;
+    }
+    else
+    {
+      file->fd = result;
+      queueWrite(file);
+    }
+    break;
+
+  case s_tagWrite:
+    //A failed (or short) write cancels the close linked to it
+    if (result != file->data.size()) file->ok = false;
+    break;
+
+  case s_tagClose:
+    if (result == -ECANCELED)
+      close(file->fd);
+    else if (result < 0)
+      file->ok = false;
+
+    file->data.clear();
+    file->stage = Stage::Done;
+    break;
+  }
+#else
+  Q_UNUSED(userData)
+  Q_UNUSED(result)
+#endif
+}
+
+/*
+ * Queues the write of the whole file and, linked to it, its close
+ */
+void UringWriter::queueWrite(File *file)
+{
+#ifdef GORGZORG_HAVE_URING
+  //Both operations go in a row, as a linked chain can't be split between submissions
+  if (io_uring_sq_space_left(m_ring) < 2) submit();
+
+  if (!file->data.isEmpty())
+  {
+    io_uring_sqe *sqe = io_uring_get_sqe(m_ring);
+    io_uring_prep_write(sqe, file->fd, file->data.constData(), unsigned(file->data.size()), 0);
+    sqe->user_data = reinterpret_cast<quint64>(file) | s_tagWrite;
+    sqe->flags |= IOSQE_IO_LINK;
+  }
+
+  io_uring_sqe *sqe = io_uring_get_sqe(m_ring);
+  io_uring_prep_close(sqe, file->fd);
+  sqe->user_data = reinterpret_cast<quint64>(file) | s_tagClose;
+  file->stage = Stage::Closing;
+#else
+  Q_UNUSED(file)
+#endif
+}
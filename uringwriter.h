@@ -0,0 +1,86 @@
+/*
+* This file is part of GorgZorg, a simple multiplatform CLI network file transfer tool.
+* Copyright (C) 2021 Alexandre Albuquerque Arnt
+*
+* This program is distributed in the hope that it will be useful,
+* but WITHOUT ANY WARRANTY; without even the implied warranty of
+* MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.
+*
+* Source code hosted on: https://github.com/aarnt/gorgzorg
+*/
+
+#ifndef URINGWRITER_H
+#define URINGWRITER_H
+
+#include <QByteArray>
+#include <QString>
+#include <QVector>
+
+#include <deque>
+
+struct io_uring;
+
+const unsigned ctn_URING_QUEUE_DEPTH = 256;          //Operations which can wait in the ring to be submitted
+const int ctn_URING_MAX_FILES = 128;                 //Files being written at the same time (each one takes up to 2 operations)
+const qint64 ctn_URING_MAX_FILE_SIZE = 512 * 1024;   //Bigger files are written the usual way, as they arrive
+
+/*
+ * Writes small received files through io_uring (liburing, Linux only): the openat of every file is queued
+ * and, as it completes, a linked write and close. Operations are submitted in batches and many files
+ * are in flight at the same time, so the event loop never waits for the disk.
+ *
+ * Files finish in any order, but their results are handed out in the order they were written
+ */
+class UringWriter
+{
+public:
+  struct Result
+  {
+    quint32 sequence;       //Sequence of the header of the file, so its reply can be sent
+    QString path;
+    bool ok;
+  };
+
+  UringWriter();
+  ~UringWriter();
+
+  bool isReady() const { return m_ready; }
+  bool isIdle() const { return m_files.empty(); }
+  int eventFd() const { return m_eventFd; }
+
+  void write(const QString &path, const QByteArray &data, quint32 sequence);
+  void submit();
+  void reap(bool wait);
+  QVector<Result> takeResults();
+
+  static bool isAvailable();
+
+private:
+  enum class Stage
+  {
+    Opening,
+    Closing,                //Writing, then closing (the close is linked to the write)
+    Done
+  };
+
+  struct File
+  {
+    QByteArray path;        //Encoded, as the kernel reads it until the openat completes
+    QByteArray data;
+    quint32 sequence;
+    int fd;
+    Stage stage;
+    bool ok;
+  };
+
+  io_uring *m_ring;
+  int m_eventFd;            //Signaled by the kernel on every completion
+  bool m_ready;
+  std::deque<File*> m_files; //Files not handed out yet, in the order they were written
+  QVector<Result> m_results;
+
+  void complete(quint64 userData, int result);
+  void queueWrite(File *file);
+};
+
+#endif // URINGWRITER_H
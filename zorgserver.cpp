@@ -0,0 +1,65 @@
+/*
+* This file is part of GorgZorg, a simple multiplatform CLI network file transfer tool.
+* Copyright (C) 2021 Alexandre Albuquerque Arnt
+*
+* This program is distributed in the hope that it will be useful,
+* but WITHOUT ANY WARRANTY; without even the implied warranty of
+* MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.
+*
+* Source code hosted on: https://github.com/aarnt/gorgzorg
+*/
+
+#include "zorgserver.h"
+#include "progressreporter.h"
+#include <iostream>
+
+#include <QThread>
+
+ZorgServer::ZorgServer(const ZorgSettings &settings, int threads, QObject *parent):
+  QTcpServer(parent), m_settings(settings), m_nextWorker(0)
+{
+  if (threads <= 0) threads = QThread::idealThreadCount();
+  if (threads <= 0) threads = 1;
+
+  for (int i=0; i<threads; ++i)
+  {
+    QThread *worker = new QThread(this);
+    worker->start();
+    m_workers.append(worker);
+  }
+
+  //Sessions of every worker add to a single status line
+  if (m_settings.verbose)
+  {
+    m_settings.progress = new ProgressReporter(QLatin1String("Zorged"));
+    m_settings.progress->start();
+  }
+}
+
+ZorgServer::~ZorgServer()
+{
+  for (QThread *worker: m_workers)
+  {
+    worker->quit();
+    worker->wait();
+  }
+
+  delete m_settings.progress;
+}
+
+/*
+ * Every new client gets its own session, handed to the worker threads in a round-robin fashion.
+ * The socket itself is created by the session, inside its worker thread
+ */
+void ZorgServer::incomingConnection(qintptr socketDescriptor)
+{
+  std::cout << std::endl << "Connected, preparing to zorg files!" << std::endl;
+
+  ZorgSession *session = new ZorgSession(socketDescriptor, m_settings);
+  QThread *worker = m_workers.at(m_nextWorker);
+  m_nextWorker = (m_nextWorker + 1) % m_workers.size();
+
+  session->moveToThread(worker);
+  QObject::connect(session, &ZorgSession::finished, session, &QObject::deleteLater);
+  QMetaObject::invokeMethod(session, "start", Qt::QueuedConnection);
+}
@@ -0,0 +1,41 @@
+/*
+* This file is part of GorgZorg, a simple multiplatform CLI network file transfer tool.
+* Copyright (C) 2021 Alexandre Albuquerque Arnt
+*
+* This program is distributed in the hope that it will be useful,
+* but WITHOUT ANY WARRANTY; without even the implied warranty of
+* MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.
+*
+* Source code hosted on: https://github.com/aarnt/gorgzorg
+*/
+
+#ifndef ZORGSERVER_H
+#define ZORGSERVER_H
+
+#include "zorgsession.h"
+
+#include <QTcpServer>
+#include <QList>
+
+class QThread;
+
+/*
+ * Listens for gorg clients and hands every connection to a ZorgSession running on a pool of worker threads
+ */
+class ZorgServer: public QTcpServer
+{
+  Q_OBJECT
+public:
+  explicit ZorgServer(const ZorgSettings &settings, int threads, QObject *parent = nullptr);
+  ~ZorgServer();
+
+protected:
+  void incomingConnection(qintptr socketDescriptor) override;
+
+private:
+  ZorgSettings m_settings;
+  QList<QThread *> m_workers;
+  int m_nextWorker;
+};
+
+#endif // ZORGSERVER_H
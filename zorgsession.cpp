@@ -0,0 +1,1791 @@
+/*
+* This file is part of GorgZorg, a simple multiplatform CLI network file transfer tool.
+* Copyright (C) 2021 Alexandre Albuquerque Arnt
+*
+* This program is distributed in the hope that it will be useful,
+* but WITHOUT ANY WARRANTY; without even the implied warranty of
+* MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.
+*
+* Source code hosted on: https://github.com/aarnt/gorgzorg
+*/
+
+#include "zorgsession.h"
+#include "gorgzorg.h"
+#include "console.h"
+#include "deltasync.h"
+#include "syncmanifest.h"
+#include "protocol.h"
+#include "uringwriter.h"
+#include "pagecache.h"
+#include "progressreporter.h"
+#include <iostream>
+
+#ifdef Q_OS_LINUX
+  #include <errno.h>
+  #include <fcntl.h>
+  #include <unistd.h>
+#endif
+
+#include <QtEndian>
+#include <QCoreApplication>
+#include <QTcpSocket>
+#include <QHostAddress>
+#include <QFile>
+#include <QSaveFile>
+#include <QCryptographicHash>
+#include <QDir>
+#include <QDateTime>
+#include <QTextStream>
+#include <QHash>
+#include <QMutex>
+#include <QMutexLocker>
+#include <QSocketNotifier>
+#include <QJsonArray>
+#include <QRandomGenerator>
+
+//A striped file being zorged, keyed by the random transfer id its accept reply gave the client
+struct StripedFile
+{
+  QString path;             //Local path of the preallocated file
+  ZorgSession *session;     //Session of the main connection, waiting for the final Done reply
+  quint32 sequence;         //Sequence of the header which announced the file on the main connection
+  qint64 size;
+  qint64 received;
+  bool failed;
+};
+
+//Striped files are shared by the sessions of their ranges, which may run on any worker thread
+static QMutex s_stripedMutex;
+static QHash<quint64, StripedFile> s_stripedFiles;
+
+//Sessions asking the user to accept a transfer must take turns
+static QMutex s_questionMutex;
+
+//Statistics of every session that has finished, rewritten to the "--stats-json" file as each one ends
+static QMutex s_statsMutex;
+static QJsonArray s_statsSessions;
+
+/*
+ * Gives a received file its final size upfront, so striped ranges can be written at any offset
+ */
+static bool preallocateFile(QFile *file, qint64 size)
+{
+#ifdef Q_OS_LINUX
+  if (size > 0 && ::posix_fallocate(file->handle(), 0, off_t(size)) == 0) return true;
+#endif
+
+  return file->resize(size);
+}
+
+/*
+ * ZorgSession class methods
+ */
+
+ZorgSession::ZorgSession(qintptr socketDescriptor, const ZorgSettings &settings)
+{
+  m_settings = settings;
+  m_socketDescriptor = socketDescriptor;
+  m_socket = nullptr;
+  m_newFile = nullptr;
+  m_createMasterDir = false;
+  m_singleTransfer = false;
+  m_helloReceived = false;
+  m_sequence = 0;
+  m_receivingADir = false;
+  m_askForAccept = true;
+  m_spliceReceive = settings.spliceReceive;
+  m_receiveError = false;
+  m_batchFile = false;
+  m_receivingStriped = false;
+  m_receivingStripe = false;
+  m_receivingCompressed = false;
+  m_resuming = false;
+  m_awaitingResumeOffset = false;
+  m_receivingDelta = false;
+  m_receivingDedup = false;
+  m_syncing = false;
+  m_awaitingDigest = false;
+  m_fileTime = -1;
+  m_byteReceived = 0;
+  m_byteReported = 0;
+  m_totalSize = 0;
+  m_stripeHeaderSize = 0;
+  m_stripeId = 0;
+  m_pipe[0] = m_pipe[1] = -1;
+  m_pipeSize = 0;
+  m_batchWriter = nullptr;
+  m_batchNotifier = nullptr;
+  m_cacheDropper = nullptr;
+  m_codec = Codec::Zlib;
+  m_rawReceived = 0;
+  m_deltaFile = nullptr;
+  m_deltaDigest = nullptr;
+  m_deltaBlockSize = 0;
+  m_chunkIndex = 0;
+  m_digest = nullptr;
+  m_digestSize = 0;
+  m_stats = TransferStats(true);
+  m_statsWritten = false;
+}
+
+ZorgSession::~ZorgSession()
+{
+  writeStats();
+
+  //What we have of an interrupted file stays on disk, so it can be resumed
+  if (m_newFile != nullptr && m_newFile->isOpen() && !m_receiveError) flushBody();
+
+  //Small files already handed to io_uring are written before we go
+  delete m_batchNotifier;
+  delete m_batchWriter;
+  delete m_cacheDropper;
+
+  //An unfinished delta never replaces the old file
+  delete m_deltaFile;
+  delete m_deltaDigest;
+  delete m_digest;
+
+#ifdef Q_OS_LINUX
+  if (m_pipe[0] != -1) ::close(m_pipe[0]);
+  if (m_pipe[1] != -1) ::close(m_pipe[1]);
+#endif
+
+  //No one will be waiting for our striped files anymore
+  QMutexLocker locker(&s_stripedMutex);
+  auto it = s_stripedFiles.begin();
+  while (it != s_stripedFiles.end())
+  {
+    if (it->session == this)
+      it = s_stripedFiles.erase(it);
+    else
+      ++it;
+  }
+}
+
+/*
+ * Runs on the worker thread: creates the socket of this session
+ */
+void ZorgSession::start()
+{
+  m_socket = new QTcpSocket(this);
+
+  if (!m_socket->setSocketDescriptor(m_socketDescriptor))
+  {
+    emit finished();
+    return;
+  }
+
+  m_stats.start();
+
+#ifdef Q_OS_LINUX
+  //The pipe splice(2) uses to move file bodies from the socket to the disk
+  if (m_spliceReceive)
+  {
+    if (::pipe(m_pipe) == 0)
+    {
+      ::fcntl(m_pipe[1], F_SETPIPE_SZ, ctn_SPLICE_PIPE_SIZE);
+      m_pipeSize = ::fcntl(m_pipe[1], F_GETPIPE_SZ);
+    }
+
+    if (m_pipeSize <= 0)
+    {
+      std::cout << "WARNING: Could not create a pipe for splice, falling back to the read/write loop" << std::endl;
+      m_spliceReceive = false;
+    }
+  }
+#else
+  m_spliceReceive = false;
+#endif
+
+  if (m_settings.uringReceive)
+  {
+    m_batchWriter = new UringWriter();
+
+    if (m_batchWriter->isReady())
+    {
+      m_batchNotifier = new QSocketNotifier(m_batchWriter->eventFd(), QSocketNotifier::Read, this);
+      QObject::connect(m_batchNotifier, &QSocketNotifier::activated, this, &ZorgSession::batchWritten);
+    }
+    else
+    {
+      std::cout << "WARNING: io_uring is not available, falling back to writing files as they arrive" << std::endl;
+      delete m_batchWriter;
+      m_batchWriter = nullptr;
+    }
+  }
+
+  QObject::connect(m_socket, &QTcpSocket::readyRead, this, &ZorgSession::readClient);
+  QObject::connect(m_socket, &QTcpSocket::disconnected, this, &ZorgSession::finished);
+}
+
+/*
+ * Called (queued) by the session which wrote the last range of our striped file
+ */
+void ZorgSession::stripedFileZorged(bool ok, quint32 sequence)
+{
+  drainBatch(true);
+
+  m_stats.done(sequence, ok);
+
+  if (ok)
+  {
+    std::cout << "Zorging of " << m_currentFileName.toLatin1().data() << " completed" << std::endl;
+    m_socket->write(Protocol::message(MessageType::Done, sequence));
+  }
+  else
+  {
+    std::cout << std::endl << "ERROR: " << m_currentFileName.toLatin1().data() << " could not be zorged" << std::endl;
+    m_socket->write(Protocol::message(MessageType::Error, sequence));
+  }
+}
+
+/*
+ * Prepares this session to write the byte range of the striped file accepted with transferId, starting at offset,
+ * which a stripe header says follows
+ */
+bool ZorgSession::readStripeHeader(quint64 transferId, qint64 offset, qint64 length)
+{
+  m_stripeId = transferId;
+  m_stripeHeaderSize = m_byteReceived;
+  m_receivingADir = false;
+  m_receivingStripe = true;
+
+  QString path;
+  {
+    QMutexLocker locker(&s_stripedMutex);
+    auto it = s_stripedFiles.constFind(m_stripeId);
+    if (it != s_stripedFiles.constEnd()) path = it->path;
+  }
+
+  //No one accepted this striped file
+  if (path.isEmpty() || length <= 0)
+  {
+    m_byteReceived = 0;
+    m_totalSize = 0;
+    m_receivingStripe = false;
+    reply(MessageType::Cancel);
+    m_socket->disconnectFromHost();
+    return false;
+  }
+
+  m_newFile = new QFile(path);
+
+  if (!m_newFile->open(QFile::ReadWrite) || !m_newFile->seek(offset))
+  {
+    std::cout << std::endl << "ERROR: Could not write a range of " << path.toLatin1().data() << std::endl;
+    m_receiveError = true;
+  }
+  else
+  {
+    startDroppingCache();
+  }
+
+  reply(MessageType::Accept);
+  return true;
+}
+
+/*
+ * Sends a reply to the file header with sequence m_sequence
+ */
+void ZorgSession::reply(MessageType type, const QByteArray &payload)
+{
+  //Done/Error replies go in sequence, so the ones of files still being written by io_uring go first
+  if (type == MessageType::Done || type == MessageType::Error)
+  {
+    drainBatch(true);
+    m_stats.done(m_sequence, type == MessageType::Done);
+  }
+
+  m_socket->write(Protocol::message(type, m_sequence, payload));
+}
+
+/*
+ * Whenever clients send bytes, readClient is called!
+ */
+void ZorgSession::readClient()
+{
+  m_stats.enter(Phase::Receive);
+
+  //A pipelining client may have put many files in the socket, so let's consume all of them
+  while (m_socket->bytesAvailable() > 0)
+  {
+    if (!readClientData()) break;
+  }
+
+  //Small files read in this round go to the kernel together
+  if (m_batchWriter != nullptr) m_batchWriter->submit();
+
+  reportProgress();
+  m_stats.enter(Phase::Idle);
+}
+
+/*
+ * Called when io_uring has completed operations of the small files we handed to it
+ */
+void ZorgSession::batchWritten()
+{
+  drainBatch(false);
+}
+
+/*
+ * Replies to the small files m_batchWriter has finished, in the order they were received.
+ * If wait is true, only returns when every one of them has been written
+ */
+void ZorgSession::drainBatch(bool wait)
+{
+  if (m_batchWriter == nullptr) return;
+
+  if (wait)
+  {
+    m_batchWriter->submit();
+    while (!m_batchWriter->isIdle()) m_batchWriter->reap(true);
+  }
+  else
+  {
+    m_batchWriter->reap(false);
+  }
+
+  const QVector<UringWriter::Result> results = m_batchWriter->takeResults();
+  for (const UringWriter::Result &result: results)
+  {
+    m_stats.done(result.sequence, result.ok);
+
+    if (result.ok)
+    {
+      m_socket->write(Protocol::message(MessageType::Done, result.sequence));
+    }
+    else
+    {
+      std::cout << std::endl << "ERROR: " << result.path.toLatin1().data() << " could not be zorged" << std::endl;
+      m_socket->write(Protocol::message(MessageType::Error, result.sequence));
+    }
+  }
+}
+
+/*
+ * Reads a file header or a piece of the current file body, never going past the end of the current file.
+ * Returns false when there is nothing more to be read now (incomplete header, end of transfer or cancel)
+ */
+bool ZorgSession::readClientData()
+{
+  m_stats.enter(Phase::Receive);
+
+  if (m_receivingCompressed)
+  {
+    return readCompressedFrames();
+  }
+
+  if (m_awaitingResumeOffset)
+  {
+    return readResumeOffset();
+  }
+
+  if (m_receivingDelta)
+  {
+    return readDeltaOps();
+  }
+
+  if (m_receivingDedup)
+  {
+    return readDedupData();
+  }
+
+  if (m_awaitingDigest)
+  {
+    return readDigest();
+  }
+
+  if (m_byteReceived == 0) // just started to receive data, this data is file information
+  {
+    m_stats.enter(Phase::Header);
+    m_byteReported = 0;
+    m_receivingADir = false;
+    m_createMasterDir = false;
+    m_receiveError = false;
+    m_batchFile = false;
+    m_resuming = false;
+    m_syncing = false;
+    m_fileTime = -1;
+
+    //ui->receivedProgressBar->setValue(0);
+    Message message;
+    bool invalid = false;
+    FileHeader fileHeader;
+
+    if (!Protocol::readMessage(m_socket, message, invalid, m_helloReceived)) //The header has not fully arrived yet
+    {
+      if (invalid)
+      {
+        std::cout << std::endl << "ERROR: Client sent an invalid message" << std::endl;
+        m_socket->disconnectFromHost();
+      }
+
+      return false;
+    }
+
+    //Clients say hello before anything else, so we know they speak our protocol
+    if (!m_helloReceived && message.type != MessageType::Hello)
+    {
+      std::cout << std::endl << "ERROR: Client did not say hello (is it an older GorgZorg?)" << std::endl;
+      m_socket->disconnectFromHost();
+      return false;
+    }
+
+    if (message.type == MessageType::Hello)
+    {
+      quint16 version = 0;
+      quint32 capabilities = 0;
+      bool ok = Protocol::parseHello(message.payload, version, capabilities);
+
+      m_socket->write(Protocol::hello());
+
+      if (!ok || version != ctn_PROTOCOL_VERSION)
+      {
+        std::cout << std::endl << "ERROR: Client speaks protocol version " << QString::number(version).toLatin1().data() <<
+                     ", but this zorg speaks version " << QString::number(ctn_PROTOCOL_VERSION).toLatin1().data() << std::endl;
+        m_socket->disconnectFromHost();
+        return false;
+      }
+
+      m_helloReceived = true;
+      return true;
+    }
+
+    //Gorg auto tunes its socket buffers, so we follow with ours (unless the OS already gave us a larger one,
+    //as setting it would also turn off its autotuning)
+    if (message.type == MessageType::Tune)
+    {
+      int bufferSize = 0;
+
+      if (Protocol::parseTune(message.payload, bufferSize) &&
+          bufferSize > m_socket->socketOption(QAbstractSocket::ReceiveBufferSizeSocketOption).toInt())
+      {
+        m_socket->setSocketOption(QAbstractSocket::ReceiveBufferSizeSocketOption, bufferSize);
+
+        if (m_settings.verbose)
+          std::cout << "Receive buffer set to " << QString::number(bufferSize / 1024).toLatin1().data() << " KB" << std::endl;
+      }
+
+      return true;
+    }
+
+    if (message.type == MessageType::Header && !Protocol::parseHeader(message.payload, fileHeader))
+    {
+      //We would not even know how much of the body to read
+      std::cout << std::endl << "ERROR: Client sent an invalid file header" << std::endl;
+      m_socket->disconnectFromHost();
+      return false;
+    }
+    else if (message.type == MessageType::Header)
+    {
+      //Replies to this file carry its sequence. What we count as received includes the header
+      m_sequence = message.sequence;
+      m_byteReceived = ctn_MESSAGE_PREFIX_SIZE + message.payload.size();
+      m_totalSize = m_byteReceived + fileHeader.bodySize;
+      m_fileName = fileHeader.fileName;
+      m_singleTransfer = fileHeader.flags & ctn_HEADER_SINGLE_TRANSFER;
+    }
+    else if (message.type != MessageType::Goodbye)
+    {
+      std::cout << std::endl << "ERROR: Client sent an unexpected message" << std::endl;
+      m_socket->disconnectFromHost();
+      return false;
+    }
+
+    if (message.type == MessageType::Goodbye)
+    {
+      m_masterDir.clear();
+      m_byteReceived = 0;
+      m_totalSize = 0;
+
+      drainBatch(true);
+      writeStats();
+
+      //Client is saying goodbye...
+      std::cout << std::endl << "See you next time!" << std::endl << std::endl;
+
+      //We run on a worker thread, so the app is told to quit and the server shuts its workers down
+      if (m_settings.quitServer)
+        QMetaObject::invokeMethod(qApp, "quit", Qt::QueuedConnection);
+
+      return false;
+    }
+
+    //This connection carries a byte range of a striped file accepted on another connection
+    if (fileHeader.mode == BodyMode::Stripe)
+    {
+      return readStripeHeader(fileHeader.transferId, fileHeader.offset, fileHeader.bodySize);
+    }
+
+    //The body of a striped file will arrive in byte ranges through other connections
+    m_receivingStriped = false;
+    qint64 fileSize = fileHeader.mode == BodyMode::Raw ? fileHeader.bodySize : fileHeader.fileSize;
+
+    //The body of a verified file is followed by its digest
+    if (fileHeader.flags & ctn_HEADER_DIGEST)
+    {
+      m_digestSize = BodyDigest::size(fileHeader.digest);
+
+      if (BodyDigest::isAvailable(fileHeader.digest))
+      {
+        m_digest = new BodyDigest(fileHeader.digest);
+      }
+      else
+      {
+        //The trailer is read all the same, so the stream stays in step
+        std::cout << std::endl << "ERROR: This zorg can not check " <<
+                     BodyDigest::typeName(fileHeader.digest).toLatin1().data() << " digests" << std::endl;
+        m_receiveError = true;
+      }
+    }
+
+    //Files of a synced dir are saved with the mtime they have on the client
+    m_fileTime = fileHeader.mtime;
+    //And the accept reply of a synced dir is only sent when its manifest is ready
+    m_syncing = fileHeader.flags & ctn_HEADER_SYNC;
+    //The accept reply of a resumable file is only sent when we know if there is a partial copy of it
+    m_resuming = fileHeader.flags & ctn_HEADER_RESUME;
+
+    switch (fileHeader.mode)
+    {
+    //The same goes for a delta, whose accept reply carries the signature of our copy
+    case BodyMode::Delta:
+      m_receivingDelta = true;
+      m_rawReceived = 0;
+      break;
+    //And for chunks, whose accept reply says which of them we are missing
+    case BodyMode::Dedup:
+      m_receivingDedup = true;
+      m_rawReceived = 0;
+      break;
+    case BodyMode::Striped:
+      m_receivingStriped = true;
+      break;
+    //The body of a compressed file arrives as frames, until an end frame
+    case BodyMode::Compressed:
+      m_codec = fileHeader.codec;
+      m_receivingCompressed = true;
+      m_rawReceived = 0;
+
+      if (!StreamCompressor::isAvailable(m_codec))
+      {
+        //Frames are read up to the end frame anyway, then the Error reply goes
+        std::cout << std::endl << "ERROR: This zorg can not decompress " <<
+                     StreamCompressor::codecName(m_codec).toLatin1().data() << " streams" << std::endl;
+        m_receiveError = true;
+      }
+      break;
+    default:
+      break;
+    }
+
+    double totalSize;
+    QString strTotalSize;
+
+    if (!m_settings.alwaysAccept)
+    {
+      if (m_singleTransfer == false && m_askForAccept == false)
+      {
+        m_askForAccept = true;
+      }
+    }
+
+    //Check if we have to replace directory separators
+    QChar here = QDir::separator();
+    int i=m_fileName.indexOf(here);
+
+    if (i == -1)
+    {
+      if (here == '/')
+      {
+        m_fileName.replace(QChar('\\'), QChar('/'));
+      }
+      else
+      {
+        m_fileName.replace(QChar('/'), QChar('\\'));
+      }
+    }
+
+#ifdef Q_OS_WIN
+    if (m_fileName.startsWith(QDir::separator()))
+    {
+      m_fileName.remove(0, 1);
+    }
+#endif
+
+    //qout << Qt::endl << QLatin1String("Received: %1").arg(m_fileName) << Qt::endl;
+    int cutName=m_fileName.size()-m_fileName.lastIndexOf(QDir::separator())-1;
+    m_currentFileName = m_fileName.right(cutName);
+
+    if (m_currentFileName == ".")
+    {
+      m_currentPath = m_fileName.remove(QString(QDir::separator())+QLatin1String("."));
+      m_currentFileName = m_currentPath;
+      m_createMasterDir = true;
+    }
+    else
+    {
+      m_currentPath = m_fileName.left(m_fileName.size()-cutName);
+      //qout << QLatin1String("First Path: %1").arg(m_currentPath) << Qt::endl;
+    }
+
+    if (!m_createMasterDir)
+    {
+      if (fileSize >= 1073741824)
+      {
+        totalSize = (fileSize / 1024.0) / 1024.0;
+        strTotalSize = QString::number(totalSize, 'f', 2) + " MB";
+      }
+      else
+      {
+        totalSize = fileSize / 1024.0;
+        strTotalSize = QString::number(totalSize, 'f', 2) + " KB";
+      }
+    }
+
+    QTextStream s(stdin);
+
+    if (m_askForAccept && !m_settings.alwaysAccept)
+    {
+      //Only one session at a time may talk to the user
+      QMutexLocker locker(&s_questionMutex);
+
+      while(true)
+      {
+        QString query;
+
+        if (m_createMasterDir)
+          query = QString("\nDo you want to zorg dir %1 (y/N)? ").arg(m_currentFileName);
+        else
+          query = QString("\nDo you want to zorg %1 with %2 (y/N)? ").arg(m_currentFileName).arg(strTotalSize);
+
+        char value = Console::question(query);
+
+        if (value == 'Y' || value == 'y')
+        {
+          m_askForAccept = true;
+
+          if (!acceptLater())
+          {
+            reply(MessageType::Accept);
+            m_socket->waitForBytesWritten(-1);
+          }
+          break;
+        }
+        else if (value == 'N' || value == 'n' || value == '\n')
+        {
+          std::cout << std::endl << "Sending CANCEL_SEND..." << std::endl;
+          reply(MessageType::Cancel);
+          m_socket->waitForBytesWritten(-1);
+          m_byteReceived = 0;
+          m_totalSize = 0;
+          m_receivingCompressed = false;
+          m_receivingDelta = false;
+          m_receivingDedup = false;
+          m_syncing = false;
+          delete m_digest;
+          m_digest = nullptr;
+          m_digestSize = 0;
+
+          return false;
+        }
+      }
+    }
+    else if (!m_askForAccept || m_settings.alwaysAccept)
+    {
+      //The accept leaves with our next write, as does the Done reply of finishReceivingFile
+      m_askForAccept = true;
+      if (!acceptLater()) reply(MessageType::Accept);
+    }
+
+    //A dir of the traverse, which has no body
+    if (fileHeader.flags & ctn_HEADER_DIR)
+    {
+      m_receivingADir = true;
+    }
+
+    std::cout << std::endl << "Zorging " << m_currentFileName.toLatin1().data() << std::endl;
+    m_stats.headerSent(m_sequence, m_receivingADir || m_createMasterDir);
+
+    if (m_createMasterDir)
+    {
+      makePath(m_currentPath);
+
+#ifdef Q_OS_WIN
+      //qout << QLatin1String("Master DIR: %1").arg(m_currentPath) << Qt::endl;
+      m_masterDir = m_currentPath;
+#endif
+
+      m_byteReceived = 0;
+      m_totalSize = 0;
+
+      if (m_syncing)
+      {
+        //Tell the client what we already have under the dir (where its files are going to be saved), so
+        //it sends only new or changed files
+        QString root = m_currentPath;
+#ifndef Q_OS_WIN
+        if (root.startsWith(QDir::separator()))
+          root.remove(0,1);
+#endif
+        root.remove(QLatin1String("..") + QString(QDir::separator()));
+        root.remove(QLatin1String(".") + QString(QDir::separator()));
+
+        int entries = 0;
+        QByteArray manifest = SyncManifest::build(root, &entries);
+        reply(MessageType::Sync, manifest);
+        m_syncing = false;
+
+        if (m_settings.verbose)
+        {
+          std::cout << "Manifest of " << QString::number(entries).toLatin1().data() << " entries (" <<
+                       QString::number(manifest.size()).toLatin1().data() << " bytes)" << std::endl;
+        }
+      }
+
+      //Send an OK to the other side
+      std::cout << "Zorging of master directory completed" << std::endl;
+      reply(MessageType::Done);
+      m_socket->waitForBytesWritten(-1);
+
+      if (m_singleTransfer == false && m_askForAccept == false)
+        m_askForAccept = true;
+      else
+        m_askForAccept = false;
+
+      return true;
+    }
+
+    if (!m_currentPath.isEmpty())
+    {
+#ifndef Q_OS_WIN
+      if (m_currentPath.startsWith(QDir::separator()))
+        m_currentPath.remove(0,1);
+#else
+      bool hasDrive=m_currentPath.contains(QLatin1Char(':'));
+
+      if (hasDrive)
+      {
+        int s = m_currentPath.indexOf(QDir::separator());
+        if (s > -1)
+        {
+          m_winDrive = m_currentPath.left(s+1);
+          m_currentPath.remove(m_winDrive);
+        }
+      }
+#endif
+      m_currentPath.remove(QLatin1String("..") + QString(QDir::separator()));
+      m_currentPath.remove(QLatin1String(".") + QString(QDir::separator()));
+
+#ifndef Q_OS_WIN
+      if (!m_currentPath.isEmpty())
+      {
+        makePath(m_currentPath);
+      }
+#else
+      if (!m_currentPath.isEmpty())
+      {
+        if (!m_masterDir.isEmpty())
+        {
+          if (!QString(m_winDrive+m_currentPath).startsWith(m_masterDir))
+            m_currentPath = m_masterDir + m_currentPath;
+        }
+        makePath(m_currentPath);
+      }
+#endif
+    }
+
+    if (m_receivingADir)
+    {
+
+#ifndef Q_OS_WIN
+      makePath(m_currentPath + QDir::separator() + m_currentFileName);
+#else
+      if (!m_masterDir.isEmpty())
+      {
+        if (!QString(m_winDrive+m_currentPath).startsWith(m_masterDir))
+          m_currentPath = m_masterDir + m_currentPath;
+      }
+
+      //qout << QLatin1String("Creating DIR: %1").arg(m_currentPath) << Qt::endl;
+      makePath(m_currentPath + QDir::separator() + m_currentFileName);
+#endif
+
+      m_inBlock = m_socket->read(m_totalSize - m_byteReceived);
+      m_byteReceived += m_inBlock.size();
+    }
+    else
+    {
+      if (m_currentPath.isEmpty())
+      {
+#ifndef Q_OS_WIN
+        m_newFile = new QFile(m_currentFileName);
+#else
+        if (!m_masterDir.isEmpty())
+        {
+          if (!QString(m_winDrive+m_currentFileName).startsWith(m_masterDir))
+            m_currentFileName = m_masterDir + m_currentFileName;
+        }
+
+        //qout << QLatin1String("Creating file: %1").arg(m_currentFileName) << Qt::endl;
+        m_newFile = new QFile(m_currentFileName);
+#endif
+      }
+      else
+      {
+#ifndef Q_OS_WIN
+        m_newFile = new QFile(m_currentPath + QDir::separator() + m_currentFileName);
+#else
+        if (!m_masterDir.isEmpty())
+        {
+          if (!QString(m_winDrive+m_currentPath).startsWith(m_masterDir))
+            m_currentPath = m_masterDir + m_currentPath;
+        }
+
+        //qout << QLatin1String("Creating file: %1").arg(m_currentPath + m_currentFileName) << Qt::endl;
+        m_newFile = new QFile(m_currentPath + QDir::separator() + m_currentFileName);
+#endif
+      }
+
+      //qout << Qt::endl << QLatin1String("Path: %1").arg(m_currentPath) << Qt::endl;
+      //qout << QLatin1String("FileName: %1").arg(m_currentFileName) << Qt::endl;
+
+      if (m_receivingDedup)
+      {
+        //The chunk list (header body) is read by readDedupData
+        if (!m_newFile->open(QFile::WriteOnly))
+        {
+          std::cout << std::endl << "ERROR: " << m_newFile->fileName().toLatin1().data() << " could not be created" << std::endl;
+          m_receiveError = true;
+        }
+        else
+        {
+          startDroppingCache();
+        }
+
+        return true;
+      }
+
+      if (m_receivingDelta)
+      {
+        //Send the signature of our copy, so the client sends only what changed. The new version is built
+        //aside (QSaveFile) and only takes the place of the old one when it is complete
+        QByteArray signature;
+        m_deltaBlockSize = 0;
+
+        if (m_newFile->exists() && m_newFile->open(QFile::ReadOnly))
+        {
+          m_deltaBlockSize = DeltaSync::blockSizeFor(m_newFile->size());
+          signature = DeltaSync::signature(m_newFile, m_deltaBlockSize);
+        }
+
+        m_deltaFile = new QSaveFile(m_newFile->fileName());
+        m_deltaDigest = new QCryptographicHash(QCryptographicHash::Sha1);
+
+        if (!m_deltaFile->open(QIODevice::WriteOnly))
+        {
+          std::cout << std::endl << "ERROR: " << m_newFile->fileName().toLatin1().data() << " could not be created" << std::endl;
+          m_receiveError = true;
+        }
+
+        QByteArray header(8, '\0');
+        qToBigEndian<quint32>(quint32(m_deltaBlockSize), reinterpret_cast<uchar*>(header.data()));
+        qToBigEndian<quint32>(quint32(signature.size() / ctn_DELTA_ENTRY_SIZE), reinterpret_cast<uchar*>(header.data() + 4));
+        reply(MessageType::Delta, header + signature);
+
+        return true;
+      }
+
+      if (m_resuming)
+      {
+        //Offer the partial copy we have, with the checksum of its end, so the client sends only the rest
+        QByteArray checksum;
+        qint64 partial = 0;
+
+        if (m_newFile->exists() && m_newFile->open(QFile::ReadWrite))
+        {
+          partial = m_newFile->size();
+          if (partial <= fileSize) checksum = GorgZorg::prefixChecksum(m_newFile, partial);
+          if (checksum.isEmpty()) m_newFile->close();
+        }
+
+        if (!checksum.isEmpty())
+        {
+          QByteArray size(8, '\0');
+          qToBigEndian<qint64>(partial, reinterpret_cast<uchar*>(size.data()));
+          reply(MessageType::Resume, size + checksum);
+
+          m_awaitingResumeOffset = true;
+          return true;
+        }
+
+        reply(MessageType::Accept);
+      }
+
+      //Small files are created, written and closed through io_uring once their whole body is here
+      m_batchFile = m_batchWriter != nullptr && !m_receiveError && !m_resuming && !m_receivingStriped &&
+          !m_receivingCompressed && m_fileTime < 0 && fileSize < ctn_URING_MAX_FILE_SIZE;
+
+      if (!m_batchFile && !m_receiveError && !m_newFile->open(QFile::WriteOnly))
+      {
+        //The body is still read (and dropped) before the Error reply goes
+        std::cout << std::endl << "ERROR: " << m_newFile->fileName().toLatin1().data() << " could not be created" << std::endl;
+        m_receiveError = true;
+      }
+      else if (!m_batchFile && !m_receiveError)
+      {
+        startDroppingCache();
+      }
+
+      m_inBlock = m_socket->read(m_totalSize - m_byteReceived);
+      m_byteReceived += m_inBlock.size();
+
+      if (m_receivingStriped)
+      {
+        QByteArray transferId;
+
+        if (!m_receiveError && !preallocateFile(m_newFile, fileSize))
+        {
+          std::cout << std::endl << "ERROR: " << m_newFile->fileName().toLatin1().data() << " could not be preallocated" << std::endl;
+          m_receiveError = true;
+        }
+        else if (!m_receiveError)
+        {
+          StripedFile stripedFile;
+          stripedFile.path = m_newFile->fileName();
+          stripedFile.session = this;
+          stripedFile.sequence = m_sequence;
+          stripedFile.size = fileSize;
+          stripedFile.received = 0;
+          stripedFile.failed = false;
+
+          //Ids are random, so no other client (or file of the same name) can write into this one
+          QMutexLocker locker(&s_stripedMutex);
+          do
+            m_stripeId = QRandomGenerator::system()->generate64();
+          while (m_stripeId == 0 || s_stripedFiles.contains(m_stripeId));
+          s_stripedFiles.insert(m_stripeId, stripedFile);
+
+          transferId.resize(8);
+          qToBigEndian<quint64>(m_stripeId, reinterpret_cast<uchar*>(transferId.data()));
+        }
+
+        //Stripe sessions look the file up as soon as the client has our accept, so it only goes now that the
+        //file is registered. A file we could not register gets no id, and is followed by the Error reply right away
+        reply(MessageType::Accept, transferId);
+      }
+      else if (m_receivingCompressed)
+      {
+        return true;
+      }
+      else if (!m_receiveError)
+      {
+        //A body which came whole with its header (like the ones of packed files) has nothing to wait for
+        if (!m_batchFile && m_byteReceived < m_totalSize) reserveBody(fileSize);
+        if (m_digest != nullptr) m_digest->addData(m_inBlock);
+        writeBody(m_inBlock);
+        receiveFileZeroCopy();
+      }
+    }
+  }
+  else // Officially read the file content
+  {
+    m_inBlock = m_socket->read(m_totalSize - m_byteReceived);
+    m_byteReceived += m_inBlock.size();
+    if (!m_receivingADir && !m_receiveError)
+    {
+      if (m_digest != nullptr) m_digest->addData(m_inBlock);
+      writeBody(m_inBlock);
+      receiveFileZeroCopy();
+    }
+  }
+
+  //ui-> receivedProgressBar->setMaximum(totalSize);
+  //ui-> receivedProgressBar->setValue(byteReceived);
+
+  if (m_byteReceived == m_totalSize && m_receivingStripe)
+  {
+    if (!m_receiveError) flushBody();
+    stopDroppingCache();
+    m_newFile->close();
+    delete m_newFile;
+    m_newFile = nullptr;
+    m_stats.addBytes(m_totalSize);
+    reportProgress();
+
+    QMutexLocker locker(&s_stripedMutex);
+    auto it = s_stripedFiles.find(m_stripeId);
+
+    if (it != s_stripedFiles.end())
+    {
+      if (m_receiveError) it->failed = true;
+      it->received += m_totalSize - m_stripeHeaderSize;
+
+      //Every range is on disk, so let's tell the session holding the main connection
+      if (it->received == it->size)
+      {
+        QMetaObject::invokeMethod(it->session, "stripedFileZorged", Qt::QueuedConnection, Q_ARG(bool, !it->failed),
+                                  Q_ARG(quint32, it->sequence));
+        s_stripedFiles.erase(it);
+      }
+    }
+
+    m_byteReceived = 0;
+    m_byteReported = 0;
+    m_totalSize = 0;
+    m_receivingStripe = false;
+
+    if (m_receiveError)
+      reply(MessageType::Error);
+    else
+      reply(MessageType::Done);
+
+    return true;
+  }
+
+  if (m_byteReceived == m_totalSize)
+  {
+    bodyReceived();
+  }
+
+  return true;
+}
+
+/*
+ * Reads the offset the client starts the body of a resumed file at: the size of our partial copy when its
+ * checksum matched, or zero when the whole file is coming again
+ */
+bool ZorgSession::readResumeOffset()
+{
+  if (m_socket->bytesAvailable() < 8) return false;
+
+  QByteArray bytes = m_socket->read(8);
+  qint64 offset = qFromBigEndian<qint64>(bytes.constData());
+  m_awaitingResumeOffset = false;
+
+  if (offset < 0 || offset > m_totalSize - m_byteReceived)
+  {
+    std::cout << std::endl << "ERROR: Client sent an invalid offset to resume " << m_currentFileName.toLatin1().data() << std::endl;
+    m_socket->disconnectFromHost();
+    return false;
+  }
+
+  //Anything past the offset is going to be received again
+  if (!m_newFile->resize(offset) || !m_newFile->seek(offset))
+  {
+    std::cout << std::endl << "ERROR: " << m_newFile->fileName().toLatin1().data() << " could not be resumed" << std::endl;
+    m_receiveError = true;
+  }
+  else if (offset > 0)
+  {
+    std::cout << "Resuming at byte " << QString::number(offset).toLatin1().data() << std::endl;
+  }
+
+  if (!m_receiveError) startDroppingCache();
+
+  m_byteReceived += offset;
+  if (!m_receiveError) reserveBody(m_totalSize - m_byteReceived);
+
+  if (!m_receiveError) receiveFileZeroCopy();
+
+  if (m_byteReceived == m_totalSize)
+    bodyReceived();
+
+  return true;
+}
+
+/*
+ * Applies the delta ops of the current file: literal data is written as it comes and copy ops read blocks
+ * of our old copy. The end op carries the digest of the whole file, which must match before the swap.
+ * Returns false when the next op has not fully arrived yet
+ */
+bool ZorgSession::readDeltaOps()
+{
+  while (m_socket->bytesAvailable() > 0)
+  {
+    uchar head[9];
+    qint64 available = m_socket->peek(reinterpret_cast<char*>(head), 9);
+    char op = char(head[0]);
+
+    if (op == ctn_DELTA_OP_LITERAL)
+    {
+      if (available < 5) return false;
+
+      quint32 size = qFromBigEndian<quint32>(head + 1);
+
+      //Bigger literals are a protocol error, handled below
+      if (size <= quint32(ctn_DELTA_LITERAL_SIZE))
+      {
+        if (m_socket->bytesAvailable() < 5 + qint64(size)) return false;
+
+        m_socket->read(5);
+        m_inBlock = m_socket->read(size);
+        m_byteReceived += 5 + m_inBlock.size();
+        writeDeltaData(m_inBlock);
+        continue;
+      }
+    }
+    else if (op == ctn_DELTA_OP_COPY)
+    {
+      if (available < 9) return false;
+
+      m_socket->read(9);
+      m_byteReceived += 9;
+      if (m_receiveError) continue;
+
+      qint64 offset = qint64(qFromBigEndian<quint32>(head + 1)) * m_deltaBlockSize;
+      qint64 left = qint64(qFromBigEndian<quint32>(head + 5)) * m_deltaBlockSize;
+
+      if (!m_newFile->isOpen() || !m_newFile->seek(offset))
+        left = -1;
+
+      while (left > 0)
+      {
+        QByteArray data = m_newFile->read(qMin(left, qint64(ctn_DELTA_READ_SIZE)));
+        if (data.isEmpty()) break;
+
+        writeDeltaData(data);
+        left -= data.size();
+      }
+
+      if (left != 0)
+      {
+        std::cout << std::endl << "ERROR: Blocks of " << m_newFile->fileName().toLatin1().data() << " could not be read" << std::endl;
+        m_receiveError = true;
+      }
+
+      continue;
+    }
+    else if (op == ctn_DELTA_OP_END)
+    {
+      if (m_socket->bytesAvailable() < 1 + ctn_DELTA_DIGEST_SIZE) return false;
+
+      m_socket->read(1);
+      QByteArray digest = m_socket->read(ctn_DELTA_DIGEST_SIZE);
+      m_byteReceived += 1 + ctn_DELTA_DIGEST_SIZE;
+
+      if (!m_receiveError && digest != m_deltaDigest->result())
+      {
+        std::cout << std::endl << "ERROR: " << m_currentFileName.toLatin1().data() << " arrived corrupted" << std::endl;
+        m_receiveError = true;
+      }
+
+      //The old copy must be closed before it is replaced (Windows won't rename over an open file)
+      m_newFile->close();
+
+      if (!m_receiveError && !m_deltaFile->commit())
+      {
+        std::cout << std::endl << "ERROR: " << m_newFile->fileName().toLatin1().data() << " could not be replaced" << std::endl;
+        m_receiveError = true;
+      }
+
+      if (m_settings.verbose)
+      {
+        std::cout << "Rebuilt " << QString::number(m_rawReceived).toLatin1().data() << " bytes from " <<
+                     QString::number(m_byteReceived).toLatin1().data() << " received" << std::endl;
+      }
+
+      delete m_deltaFile;
+      m_deltaFile = nullptr;
+      delete m_deltaDigest;
+      m_deltaDigest = nullptr;
+
+      m_totalSize = m_byteReceived;
+      finishReceivingFile();
+      return true;
+    }
+
+    std::cout << std::endl << "ERROR: Client sent an invalid delta of " << m_currentFileName.toLatin1().data() << std::endl;
+    m_socket->disconnectFromHost();
+    return false;
+  }
+
+  return false;
+}
+
+void ZorgSession::writeDeltaData(const QByteArray &data)
+{
+  m_rawReceived += data.size();
+  if (m_receiveError) return;
+
+  m_deltaFile->write(data);
+  m_deltaDigest->addData(data);
+}
+
+/*
+ * Creates path and its missing parents (as "mkdir -p" does), but in process and at most once per session:
+ * received trees have many files in each dir, and forking a mkdir for every one of them was most of the work
+ */
+void ZorgSession::makePath(const QString &path)
+{
+  if (path.isEmpty() || m_createdDirs.contains(path)) return;
+
+  if (!QDir().mkpath(path))
+  {
+    std::cout << std::endl << "ERROR: Directory " << path.toLatin1().data() << " could not be created" << std::endl;
+    return;
+  }
+
+  //Every parent exists now too
+  QString dir = path;
+  while (!dir.isEmpty() && !m_createdDirs.contains(dir))
+  {
+    m_createdDirs.insert(dir);
+
+    int separator = dir.lastIndexOf(QDir::separator());
+    if (separator <= 0) break;
+    dir.truncate(separator);
+  }
+}
+
+/*
+ * Reserves disk space for the size bytes of body still to come, so the file does not grow (and fragment)
+ * one write at a time. Its size is left alone, as a partial copy must keep the size of what it has
+ */
+void ZorgSession::reserveBody(qint64 size)
+{
+#ifdef Q_OS_LINUX
+  if (size > 0) ::fallocate(m_newFile->handle(), FALLOC_FL_KEEP_SIZE, off_t(m_newFile->pos()), off_t(size));
+#else
+  Q_UNUSED(size)
+#endif
+}
+
+/*
+ * Collects body bytes, so the disk gets large writes ending on page boundaries instead of one per TCP segment
+ */
+void ZorgSession::writeBody(const QByteArray &data)
+{
+  m_writeBuffer.append(data);
+  if (m_writeBuffer.size() < ctn_WRITE_BUFFER_SIZE) return;
+
+  //The tail past the last boundary waits for the next write
+  qint64 pos = m_newFile->pos();
+  qint64 size = ((pos + m_writeBuffer.size()) & ~qint64(ctn_WRITE_ALIGNMENT - 1)) - pos;
+
+  if (m_newFile->write(m_writeBuffer.constData(), size) != size || !m_newFile->flush())
+  {
+    //The rest of the body is drained, and the client told this file could not be zorged
+    std::cout << std::endl << "ERROR: " << m_newFile->fileName().toLatin1().data() << " could not be written" << std::endl;
+    m_receiveError = true;
+  }
+  else if (m_cacheDropper != nullptr)
+  {
+    m_cacheDropper->advance(size);
+  }
+
+  m_writeBuffer.remove(0, int(size));
+}
+
+/*
+ * Writes whatever body bytes are still buffered
+ */
+void ZorgSession::flushBody()
+{
+  //The body of a batch file stays here until it is complete
+  if (m_writeBuffer.isEmpty() || m_batchFile) return;
+
+  if (m_newFile->write(m_writeBuffer) != m_writeBuffer.size() || !m_newFile->flush())
+  {
+    std::cout << std::endl << "ERROR: " << m_newFile->fileName().toLatin1().data() << " could not be written" << std::endl;
+    m_receiveError = true;
+  }
+  else if (m_cacheDropper != nullptr)
+  {
+    m_cacheDropper->advance(m_writeBuffer.size());
+  }
+
+  m_writeBuffer.clear();
+}
+
+/*
+ * With "-nocache", starts dropping m_newFile from the page cache as it is written, from its current position
+ */
+void ZorgSession::startDroppingCache()
+{
+  if (m_settings.noCache && m_cacheDropper == nullptr)
+    m_cacheDropper = new PageCacheDropper(m_newFile->handle(), m_newFile->pos(), true);
+}
+
+/*
+ * Drops what is left of m_newFile from the page cache. Called before it is closed
+ */
+void ZorgSession::stopDroppingCache()
+{
+  if (m_cacheDropper == nullptr) return;
+
+  m_newFile->flush();
+  m_cacheDropper->finish();
+
+  if (m_settings.verbose)
+  {
+    qint64 resident = PageCacheDropper::residentBytes(m_newFile->fileName());
+    std::cout << "Dropped " << QString::number((m_cacheDropper->dropped() / 1024.0) / 1024.0, 'f', 2).toLatin1().data() <<
+                 " MB from the page cache (" << QString::number(qMax(resident, qint64(0)) / 1024.0, 'f', 2).toLatin1().data() <<
+                 " KB left resident)" << std::endl;
+  }
+
+  delete m_cacheDropper;
+  m_cacheDropper = nullptr;
+}
+
+/*
+ * Called when the whole body of the current file is on disk. A verified file is only finished by its trailer
+ */
+void ZorgSession::bodyReceived()
+{
+  if (!m_receiveError) flushBody();
+
+  if (m_digestSize > 0)
+    m_awaitingDigest = true;
+  else
+    finishReceivingFile();
+}
+
+/*
+ * Reads the digest trailer of the current file and checks it against the digest of what we received.
+ * A file which does not match is removed and the client told it could not be zorged
+ */
+bool ZorgSession::readDigest()
+{
+  if (m_socket->bytesAvailable() < m_digestSize) return false;
+
+  QByteArray trailer = m_socket->read(m_digestSize);
+  m_awaitingDigest = false;
+
+  if (m_digest != nullptr && !m_receiveError)
+  {
+    if (m_digest->result() != trailer)
+    {
+      std::cout << std::endl << "ERROR: " << m_currentFileName.toLatin1().data() << " arrived corrupted (" <<
+                   BodyDigest::typeName(m_digest->type()).toLatin1().data() << " digest does not match)" << std::endl;
+      m_newFile->close();
+      m_newFile->remove();
+      m_receiveError = true;
+    }
+    else if (m_settings.verbose)
+    {
+      std::cout << "Digest " << BodyDigest::typeName(m_digest->type()).toLatin1().data() << " " <<
+                   trailer.toHex().data() << " verified" << std::endl;
+    }
+  }
+
+  finishReceivingFile();
+  return true;
+}
+
+/*
+ * Reads the chunk list of the current file (the header body) and replies with the bitmap of the chunks missing
+ * from our store. Then writes every chunk in order, taking it from the store or from the socket.
+ * Returns false when the list or the next missing chunk has not fully arrived yet
+ */
+bool ZorgSession::readDedupData()
+{
+  if (m_byteReceived < m_totalSize)
+  {
+    qint64 listSize = m_totalSize - m_byteReceived;
+    if (m_socket->bytesAvailable() < listSize) return false;
+
+    QByteArray list = m_socket->read(listSize);
+    m_byteReceived += list.size();
+
+    qint64 count = list.size() >= 4 ? qFromBigEndian<quint32>(list.constData()) : -1;
+
+    if (count < 0 || list.size() != 4 + count * ctn_CHUNK_ENTRY_SIZE)
+    {
+      std::cout << std::endl << "ERROR: Client sent an invalid chunk list of " << m_currentFileName.toLatin1().data() << std::endl;
+      m_socket->disconnectFromHost();
+      return false;
+    }
+
+    m_chunks.resize(int(count));
+    m_chunksNeeded = QByteArray(int((count + 7) / 8), '\0');
+    m_chunkIndex = 0;
+
+    for (int i=0; i<count; ++i)
+    {
+      const char *entry = list.constData() + 4 + i * ctn_CHUNK_ENTRY_SIZE;
+      Chunk &chunk = m_chunks[i];
+      chunk.offset = 0;
+      chunk.size = int(qFromBigEndian<quint32>(entry));
+      chunk.hash = QByteArray(entry + 4, ctn_CHUNK_HASH_SIZE);
+
+      //Chunks are never empty nor larger than the chunker cuts them, so we never buffer more than that
+      if (chunk.size <= 0 || chunk.size > ctn_CHUNK_MAX_SIZE)
+      {
+        std::cout << std::endl << "ERROR: Client sent an invalid chunk list of " << m_currentFileName.toLatin1().data() << std::endl;
+        m_socket->disconnectFromHost();
+        return false;
+      }
+
+      if (!m_chunkStore.contains(chunk.hash))
+        m_chunksNeeded[i / 8] = char(uchar(m_chunksNeeded.at(i / 8)) | (1 << (i % 8)));
+    }
+
+    QByteArray header(4, '\0');
+    qToBigEndian<quint32>(quint32(count), reinterpret_cast<uchar*>(header.data()));
+    reply(MessageType::Dedup, header + m_chunksNeeded);
+  }
+
+  while (m_chunkIndex < m_chunks.size())
+  {
+    const Chunk &chunk = m_chunks.at(m_chunkIndex);
+    bool needed = uchar(m_chunksNeeded.at(m_chunkIndex / 8)) & (1 << (m_chunkIndex % 8));
+    QByteArray data;
+
+    if (needed)
+    {
+      if (m_socket->bytesAvailable() < chunk.size) return false;
+
+      data = m_socket->read(chunk.size);
+      m_byteReceived += data.size();
+
+      if (QCryptographicHash::hash(data, QCryptographicHash::Sha256) != chunk.hash)
+      {
+        std::cout << std::endl << "ERROR: " << m_currentFileName.toLatin1().data() << " arrived corrupted" << std::endl;
+        m_receiveError = true;
+      }
+      else if (!m_chunkStore.write(chunk.hash, data))
+      {
+        std::cout << "WARNING: Could not store a chunk of " << m_currentFileName.toLatin1().data() << std::endl;
+      }
+    }
+    else
+    {
+      data = m_chunkStore.read(chunk.hash);
+
+      if (data.size() != chunk.size)
+      {
+        std::cout << std::endl << "ERROR: A stored chunk of " << m_currentFileName.toLatin1().data() << " could not be read" << std::endl;
+        m_receiveError = true;
+      }
+    }
+
+    if (!m_receiveError && m_newFile->write(data) != data.size())
+    {
+      std::cout << std::endl << "ERROR: " << m_newFile->fileName().toLatin1().data() << " could not be written" << std::endl;
+      m_receiveError = true;
+    }
+    else if (!m_receiveError && m_cacheDropper != nullptr)
+    {
+      m_cacheDropper->advance(data.size());
+    }
+
+    m_rawReceived += chunk.size;
+    m_chunkIndex++;
+  }
+
+  if (m_settings.verbose)
+  {
+    std::cout << "Built " << QString::number(m_rawReceived).toLatin1().data() << " bytes from " <<
+                 QString::number(m_chunks.size()).toLatin1().data() << " chunks, " <<
+                 QString::number(m_byteReceived).toLatin1().data() << " bytes received" << std::endl;
+  }
+
+  m_chunks.clear();
+  m_chunksNeeded.clear();
+  m_totalSize = m_byteReceived;
+  finishReceivingFile();
+  return true;
+}
+
+/*
+ * Reads the compressed frames of the current file, writing their decompressed contents.
+ * Returns false when the next frame has not fully arrived yet
+ */
+bool ZorgSession::readCompressedFrames()
+{
+  while (m_socket->bytesAvailable() >= ctn_FRAME_HEADER_SIZE)
+  {
+    uchar frameHeader[ctn_FRAME_HEADER_SIZE];
+    m_socket->peek(reinterpret_cast<char*>(frameHeader), ctn_FRAME_HEADER_SIZE);
+
+    bool compressed = frameHeader[0] != 0;
+    quint32 payloadSize = qFromBigEndian<quint32>(frameHeader + 1);
+    quint32 rawSize = qFromBigEndian<quint32>(frameHeader + 5);
+
+    //No gorg makes frames bigger than a block, so we do not buffer (nor allocate) whatever a broken peer asks for
+    if (rawSize > quint32(ctn_COMPRESSION_BLOCK_SIZE) ||
+        qint64(payloadSize) > StreamCompressor::frameBound(m_codec, int(rawSize)) ||
+        (!compressed && payloadSize != rawSize))
+    {
+      std::cout << std::endl << "ERROR: Client sent an invalid frame of " << m_currentFileName.toLatin1().data() << std::endl;
+
+      if (m_newFile != nullptr)
+      {
+        m_newFile->close();
+        m_newFile->remove();
+      }
+
+      m_receiveError = true;
+      m_socket->disconnectFromHost();
+      return false;
+    }
+
+    if (m_socket->bytesAvailable() < ctn_FRAME_HEADER_SIZE + qint64(payloadSize)) return false;
+
+    m_socket->read(ctn_FRAME_HEADER_SIZE);
+    m_inBlock = m_socket->read(payloadSize);
+    m_byteReceived += ctn_FRAME_HEADER_SIZE + m_inBlock.size();
+
+    if (rawSize == 0) //The end frame
+    {
+      if (m_settings.verbose)
+      {
+        std::cout << "Decompressed " << QString::number(m_rawReceived).toLatin1().data() << " bytes from " <<
+                     QString::number(m_byteReceived).toLatin1().data() << " received with " <<
+                     StreamCompressor::codecName(m_codec).toLatin1().data() << std::endl;
+      }
+
+      m_totalSize = m_byteReceived;
+      finishReceivingFile();
+      return true;
+    }
+
+    if (m_receiveError) continue;
+
+    m_rawReceived += rawSize;
+    QByteArray raw;
+
+    //The rest of the frames are drained and the client told at the end frame, so replies stay in sequence
+    if (compressed &&
+        !StreamCompressor::decompressBlock(m_codec, m_inBlock.constData(), m_inBlock.size(), int(rawSize), raw))
+    {
+      std::cout << std::endl << "ERROR: " << m_currentFileName.toLatin1().data() << " arrived corrupted" << std::endl;
+      m_newFile->close();
+      m_newFile->remove();
+      m_receiveError = true;
+      continue;
+    }
+
+    const QByteArray &data = compressed ? raw : m_inBlock;
+
+    if (m_newFile->write(data) != data.size() || !m_newFile->flush())
+    {
+      std::cout << std::endl << "ERROR: " << m_newFile->fileName().toLatin1().data() << " could not be written" << std::endl;
+      m_receiveError = true;
+    }
+    else if (m_cacheDropper != nullptr)
+    {
+      m_cacheDropper->advance(data.size());
+    }
+  }
+
+  return false;
+}
+
+/*
+ * The whole body of the current file has been received, so let's close it and reply to the client
+ */
+void ZorgSession::finishReceivingFile()
+{
+  m_stats.enter(Phase::Finish);
+  m_stats.addBytes(m_totalSize);
+
+  QString savedOn;
+  if (m_settings.zorgPath.isEmpty())
+    savedOn = QDir::currentPath();
+  else
+    savedOn = m_settings.zorgPath;
+
+  if (m_receivingStriped && !m_receiveError)
+  {
+    std::cout << "Waiting for the streams of " << m_currentFileName.toLatin1().data() << std::endl;
+  }
+  else if (!m_receiveError)
+  {
+    std::cout << "Zorging completed" << std::endl;
+    std::cout << "File saved on \"" << savedOn.toLatin1().data() << "\"" << std::endl;
+  }
+
+  //The body of a batch file is handed to io_uring, and its Done reply sent when it has been written
+  bool written = m_batchFile && !m_receivingADir && !m_receiveError;
+  if (written) m_batchWriter->write(m_newFile->fileName(), m_writeBuffer, m_sequence);
+
+  m_inBlock.clear();
+  m_writeBuffer.clear();
+  m_batchFile = false;
+
+  if (!m_receivingADir && !m_receiveError && !written)
+  {
+    stopDroppingCache();
+
+    //Anything still buffered must reach the file before its mtime is set
+    if (m_fileTime >= 0 && m_newFile->isOpen() && m_newFile->flush())
+      m_newFile->setFileTime(QDateTime::fromMSecsSinceEpoch(m_fileTime), QFileDevice::FileModificationTime);
+
+    m_newFile->close();
+  }
+
+  reportProgress();
+  if (m_settings.progress != nullptr && !m_receivingADir && !m_receiveError) m_settings.progress->addFile();
+
+  m_byteReceived = 0;
+  m_byteReported = 0;
+  m_fileTime = -1;
+  delete m_cacheDropper;
+  m_cacheDropper = nullptr;
+  delete m_digest;
+  m_digest = nullptr;
+  m_digestSize = 0;
+  m_totalSize = 0;
+  m_receivingCompressed = false;
+  m_receivingDelta = false;
+  m_receivingDedup = false;
+  m_resuming = false;
+
+  if (!m_settings.alwaysAccept)
+  {
+    if (m_singleTransfer == false && m_askForAccept == false)
+      m_askForAccept = true;
+    else
+      m_askForAccept = false;
+  }
+
+  //Send an OK (or the error) to the other side. Do not wait here, so replies to pipelined files leave in batches.
+  //Striped files are only OK after their stripe sessions have written all the ranges
+  if (m_receiveError)
+    reply(MessageType::Error);
+  else if (!m_receivingStriped && !written)
+    reply(MessageType::Done);
+}
+
+/*
+ * Moves what has arrived of the current file body from the socket to m_newFile with splice(2) through m_pipe,
+ * so body bytes never cross user space (the rest is moved on the next readyRead). Only the header is parsed by
+ * readClient.
+ *
+ * Returns false when splice is disabled or could not move anything, leaving the readyRead loop in charge
+ */
+bool ZorgSession::receiveFileZeroCopy()
+{
+#ifdef Q_OS_LINUX
+  //Only a body written as it arrives can bypass us: no dirs, packed files or digest trailers
+  if (!m_spliceReceive || m_receivingADir || m_batchFile || m_digestSize > 0 || m_byteReceived >= m_totalSize ||
+      m_socket->bytesAvailable() > 0) return false;
+
+  //splice writes to the file descriptor, behind our buffer
+  flushBody();
+  if (m_receiveError) return false;
+
+  int sock = int(m_socket->socketDescriptor());
+  int fd = m_newFile->handle();
+  bool started = false;
+
+  while (m_byteReceived < m_totalSize)
+  {
+    //Never ask for more than the pipe holds (we are its only reader) nor past this file's body
+    ssize_t in = ::splice(sock, nullptr, m_pipe[1], nullptr, size_t(qMin(m_totalSize - m_byteReceived, qint64(m_pipeSize))),
+                          SPLICE_F_MOVE | SPLICE_F_MORE);
+
+    if (in == 0) //Client has gone away
+    {
+      break;
+    }
+    else if (in < 0)
+    {
+      if (errno == EINTR) continue;
+
+      //Nothing more for now. readyRead brings us back, so the other sessions of this thread are not held up
+      if (errno == EAGAIN) break;
+
+      if (!started && (errno == EINVAL || errno == ENOSYS))
+      {
+        //This filesystem does not support splice, so stop trying it
+        m_spliceReceive = false;
+        return false;
+      }
+
+      //Only this client is dropped
+      std::cout << std::endl << "ERROR: splice failed while zorging " << m_currentFileName.toLatin1().data() << std::endl;
+      m_receiveError = true;
+      m_socket->disconnectFromHost();
+      break;
+    }
+
+    ssize_t left = in;
+    while (left > 0)
+    {
+      ssize_t out = ::splice(m_pipe[0], nullptr, fd, nullptr, size_t(left), SPLICE_F_MOVE | SPLICE_F_MORE);
+
+      if (out < 0 && errno == EINTR) continue;
+      if (out <= 0)
+      {
+        //What is left in the pipe is thrown away, and the rest of the body drained by readClientData
+        std::cout << std::endl << "ERROR: Could not write " << m_currentFileName.toLatin1().data() << " to disk" << std::endl;
+        m_receiveError = true;
+        if (!drainPipe(left)) m_socket->disconnectFromHost();
+        break;
+      }
+
+      left -= out;
+      if (m_cacheDropper != nullptr) m_cacheDropper->advance(out);
+    }
+
+    started = true;
+    m_byteReceived += in;
+    if (m_receiveError) break;
+  }
+
+  return started;
+#else
+  return false;
+#endif
+}
+
+#ifdef Q_OS_LINUX
+/*
+ * Reads and throws away the size bytes left in m_pipe, so it is empty for the next file
+ */
+bool ZorgSession::drainPipe(qint64 size)
+{
+  char buffer[4096];
+
+  while (size > 0)
+  {
+    ssize_t drained = ::read(m_pipe[0], buffer, size_t(qMin(size, qint64(sizeof(buffer)))));
+
+    if (drained < 0 && errno == EINTR) continue;
+    if (drained <= 0) return false;
+
+    size -= drained;
+  }
+
+  return true;
+}
+#endif
+
+
+/*
+ * Adds our statistics to the ones of the sessions which have already ended and rewrites the "--stats-json" file
+ */
+void ZorgSession::writeStats()
+{
+  if (m_settings.statsFile.isEmpty() || m_statsWritten) return;
+
+  QJsonObject report = m_stats.toJson();
+  if (m_socket != nullptr) report.insert(QLatin1String("client"), m_socket->peerAddress().toString());
+  m_statsWritten = true;
+
+  QMutexLocker locker(&s_statsMutex);
+  s_statsSessions.append(report);
+
+  QJsonObject stats;
+  stats.insert(QLatin1String("side"), QLatin1String("zorg"));
+  stats.insert(QLatin1String("version"), ctn_VERSION);
+  stats.insert(QLatin1String("sessions"), s_statsSessions);
+
+  if (!TransferStats::write(m_settings.statsFile, stats))
+    std::cout << std::endl << "WARNING: Statistics could not be written to " << m_settings.statsFile.toLatin1().data() << std::endl;
+}
+
+/*
+ * Adds what has been received of the current file since the last call to the status line
+ */
+void ZorgSession::reportProgress()
+{
+  if (m_settings.progress == nullptr || m_byteReceived <= m_byteReported) return;
+
+  m_settings.progress->addBytes(m_byteReceived - m_byteReported);
+  m_byteReported = m_byteReceived;
+}
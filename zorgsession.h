@@ -0,0 +1,165 @@
+/*
+* This file is part of GorgZorg, a simple multiplatform CLI network file transfer tool.
+* Copyright (C) 2021 Alexandre Albuquerque Arnt
+*
+* This program is distributed in the hope that it will be useful,
+* but WITHOUT ANY WARRANTY; without even the implied warranty of
+* MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.
+*
+* Source code hosted on: https://github.com/aarnt/gorgzorg
+*/
+
+#ifndef ZORGSESSION_H
+#define ZORGSESSION_H
+
+#include "streamcompressor.h"
+#include "dedup.h"
+#include "bodydigest.h"
+#include "protocol.h"
+#include "transferstats.h"
+
+#include <QObject>
+#include <QString>
+#include <QSet>
+
+class QTcpSocket;
+class QFile;
+class QSaveFile;
+class QCryptographicHash;
+class QSocketNotifier;
+class UringWriter;
+class PageCacheDropper;
+class ProgressReporter;
+
+const int ctn_WRITE_BUFFER_SIZE = 1024 * 1024; //Body bytes collected before each write to disk
+const int ctn_WRITE_ALIGNMENT = 4096;           //Buffered writes end on multiples of it inside the file
+
+//Command line params every zorg session shares
+struct ZorgSettings
+{
+  QString zorgPath;         //Directory where the server saves received files
+  QString statsFile;        //Where the JSON statistics of "--stats-json" are written
+  ProgressReporter *progress = nullptr; //Status line every session adds to (only when verbose), owned by ZorgServer
+  bool verbose = false;
+  bool alwaysAccept = false;
+  bool quitServer = false;
+  bool spliceReceive = false;
+  bool uringReceive = false;
+  bool noCache = false;
+};
+
+/*
+ * The receiving state of one client connection. Sessions live on the worker threads of ZorgServer,
+ * so many clients can zorg at the same time
+ */
+class ZorgSession: public QObject
+{
+  Q_OBJECT
+public:
+  explicit ZorgSession(qintptr socketDescriptor, const ZorgSettings &settings);
+  ~ZorgSession();
+
+private:
+  ZorgSettings m_settings;
+  qintptr m_socketDescriptor;
+  QTcpSocket *m_socket;
+  QByteArray m_inBlock;
+  QByteArray m_writeBuffer; //Body bytes not written to m_newFile yet
+  QFile *m_newFile;
+  QString m_fileName;
+  QString m_currentPath;
+  QString m_currentFileName;
+  QString m_masterDir;      //Directory which contains the path being received
+  QString m_winDrive;       //When running on Windows, this member holds the path drive (ex: "C:\")
+  QSet<QString> m_createdDirs; //Dirs this session has created (or found), so they are not created again
+
+  bool m_createMasterDir;
+  bool m_singleTransfer;
+  bool m_helloReceived;     //Client said hello, speaking our protocol version
+  quint32 m_sequence;       //Sequence of the current file header, which our replies carry
+  bool m_receivingADir;
+  bool m_askForAccept;
+  bool m_spliceReceive;     //Use splice(2) to save received file contents
+  bool m_receiveError;      //Current received file could not be saved
+  bool m_batchFile;         //Current received file is small, so it is kept in m_writeBuffer and written by m_batchWriter
+  bool m_receivingStriped;  //Current received file body arrives through stripe connections
+  bool m_receivingStripe;   //This connection carries a byte range of a striped file
+  bool m_receivingCompressed; //Current received file body arrives as compressed frames
+  bool m_resuming;          //Client lets us keep a partial copy of the current file
+  bool m_awaitingResumeOffset; //We offered a partial copy and the client is telling where its body starts
+  bool m_receivingDelta;    //Current received file body arrives as delta ops against our copy (m_newFile)
+  bool m_receivingDedup;    //Current received file is built from stored chunks plus the missing ones
+  bool m_syncing;           //Current received dir is synced, so its accept reply is the manifest of what we have
+  bool m_awaitingDigest;    //Body of the current file is complete and its digest trailer is expected
+
+  qint64 m_byteReceived;    //The size that has been received
+  qint64 m_byteReported;    //Part of m_byteReceived already added to the status line
+  qint64 m_fileTime;        //Mtime (ms since epoch) the current file is saved with, or -1 to leave it alone
+  qint64 m_totalSize;       //Total file size
+  qint64 m_stripeHeaderSize; //Header size of the byte range this connection carries
+  quint64 m_stripeId;       //Transfer id of the striped file being received (or of the one its byte range belongs to)
+
+  int m_pipe[2];            //Pipe used by splice to move data from the socket to the file
+  int m_pipeSize;
+
+  UringWriter *m_batchWriter; //Creates and writes small files in batches through io_uring (only with "-uring")
+  QSocketNotifier *m_batchNotifier; //Tells us when m_batchWriter has finished files
+  PageCacheDropper *m_cacheDropper; //Drops the file being received from the page cache behind our writes (only with "-nocache")
+
+  Codec m_codec;            //Codec of the compressed file being received
+  qint64 m_rawReceived;     //Bytes rebuilt from the compressed or delta file being received
+
+  QSaveFile *m_deltaFile;   //New version of the file being received as a delta
+  QCryptographicHash *m_deltaDigest; //Digest of m_deltaFile contents
+  int m_deltaBlockSize;
+
+  QVector<Chunk> m_chunks;  //Chunk list of the file being received as chunks
+  ChunkStore m_chunkStore;  //Chunks of earlier "-dedup" transfers, shared by every session (see ChunkStore)
+  QByteArray m_chunksNeeded; //Bitmap of the chunks we asked for
+  int m_chunkIndex;         //Next chunk to be written
+
+  BodyDigest *m_digest;     //Digest of the body being received, checked against the trailer
+  int m_digestSize;         //Size of the trailer following the current body (0 means there is none)
+
+  TransferStats m_stats;
+  bool m_statsWritten;      //Our statistics are already in m_settings.statsFile
+
+  bool readClientData();
+  bool readStripeHeader(quint64 transferId, qint64 offset, qint64 length);
+  bool readCompressedFrames();
+  bool readResumeOffset();
+  bool readDeltaOps();
+  void writeDeltaData(const QByteArray &data);
+  bool readDedupData();
+  void reply(MessageType type, const QByteArray &payload = QByteArray());
+  bool readDigest();
+  void makePath(const QString &path);
+  void reserveBody(qint64 size);
+  void writeBody(const QByteArray &data);
+  void flushBody();
+  void startDroppingCache();
+  void stopDroppingCache();
+  void bodyReceived();
+  void drainBatch(bool wait);
+  bool acceptLater() const { return m_resuming || m_receivingDelta || m_receivingDedup || m_syncing || m_receivingStriped; }
+  void finishReceivingFile();
+  bool receiveFileZeroCopy();
+#ifdef Q_OS_LINUX
+  bool drainPipe(qint64 size);
+#endif
+  void writeStats();
+  void reportProgress();
+
+private slots:
+  void readClient();
+  void batchWritten();
+
+public slots:
+  void start();
+  void stripedFileZorged(bool ok, quint32 sequence);
+
+signals:
+  void finished();
+};
+
+#endif // ZORGSESSION_H